@@ -127,6 +127,20 @@ static
 #endif
 float fMAX(float a, float b) { return MAX(a, b); }
 
+/*
+   Pixel loop kernels marked LIBRAW_SIMD_CLONES are compiled for several
+   instruction sets; the best one for the running CPU is selected once at
+   load time (GNU ifunc). Define LIBRAW_NO_SIMD_CLONES to disable.
+ */
+#if !defined(LIBRAW_NO_SIMD_CLONES) && defined(__x86_64__) &&                  \
+    defined(__GLIBC__) &&                                                      \
+    ((defined(__clang__) && __clang_major__ >= 14) ||                          \
+     (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 6))
+#define LIBRAW_SIMD_CLONES __attribute__((target_clones("avx2", "default")))
+#else
+#define LIBRAW_SIMD_CLONES
+#endif
+
 /*
    In order to inline this calculation, I make the risky
    assumption that all filter patterns can be described
@@ -30,6 +30,9 @@ it under the terms of the one of two licenses as you choose:
 #ifdef USE_ZLIB
 #include <zlib.h>
 #endif
+#if defined(LIBRAW_USE_THREAD_POOL) || defined(LIBRAW_USE_OPENMP)
+#include <mutex>
+#endif
 
 #ifndef LIBRAW_WIN32_CALLS
 #include <netinet/in.h>
@@ -116,4 +119,124 @@ void clear_dng_image(void*);
 
 #define ZERO(a) memset(&a, 0, sizeof(a))
 
+/* Bytes [start, start + size) of a stream read into memory, at the same
+   offsets. A parallel decode loop installs it as the input, so that its
+   units take get_span() instead of sharing the stream; anything outside
+   the range reads as end of data (seek and read under lock()) */
+class LibRaw_readahead_datastream : public LibRaw_abstract_datastream
+{
+public:
+  LibRaw_readahead_datastream(LibRaw_abstract_datastream *src, INT64 start, INT64 size)
+      : parent(src), base(start), pos(start)
+  {
+    size = MAX(0, MIN(size, src->size() - start));
+    data.resize(size_t(size));
+    src->seek(start, SEEK_SET);
+    int got = src->read(data.data(), 1, size_t(size));
+    data.resize(size_t(MAX(got, 0)));
+  }
+  virtual int valid() { return parent->valid(); }
+  virtual int read(void *ptr, size_t sz, size_t nmemb)
+  {
+    INT64 avail = base + INT64(data.size()) - pos;
+    if (pos < base || avail <= 0 || !sz)
+      return 0;
+    size_t n = size_t(MIN(INT64(sz * nmemb), avail));
+    memmove(ptr, &data[size_t(pos - base)], n);
+    pos += n;
+    return int(n / sz);
+  }
+  virtual int seek(INT64 o, int whence)
+  {
+    if (whence == SEEK_CUR)
+      o += pos;
+    else if (whence == SEEK_END)
+      o += size();
+    if (o < 0)
+      return -1;
+    pos = o;
+    return 0;
+  }
+  virtual INT64 tell() { return pos; }
+  virtual INT64 size() { return parent->size(); }
+  virtual int get_char()
+  {
+    if (pos < base || pos >= base + INT64(data.size()))
+      return -1;
+    return data[size_t(pos++ - base)];
+  }
+  virtual char *gets(char *, int) { return NULL; }
+  virtual int scanf_one(const char *, void *) { return -1; }
+  virtual int eof() { return pos < base || pos >= base + INT64(data.size()); }
+#if defined(LIBRAW_USE_THREAD_POOL) || defined(LIBRAW_USE_OPENMP)
+  virtual int lock()
+  {
+    access.lock();
+    return 1;
+  }
+  virtual void unlock() { access.unlock(); }
+#endif
+  virtual const char *fname() { return parent->fname(); }
+#ifdef LIBRAW_WIN32_UNICODEPATHS
+  virtual const wchar_t *wfname() { return parent->wfname(); }
+#endif
+  virtual const unsigned char *get_span(INT64 offset, INT64 sz)
+  {
+    if (offset < base || sz < 0 || offset - base > INT64(data.size()) - sz)
+      return NULL;
+    return data.data() + (offset - base);
+  }
+
+private:
+  LibRaw_abstract_datastream *parent;
+  INT64 base, pos;
+  std::vector<unsigned char> data;
+#if defined(LIBRAW_USE_THREAD_POOL) || defined(LIBRAW_USE_OPENMP)
+  std::mutex access;
+#endif
+};
+
+/* Input of a parallel decode loop over units in [start, start + size):
+   if the stream is not in memory, the range is read ahead and installed
+   in place of the input until the scope ends. workers() is 1 if the copy
+   would not fit into max_bytes, so the loop has to read the stream serially */
+class LibRaw_parallel_input_scope
+{
+public:
+  LibRaw_parallel_input_scope(LibRaw_abstract_datastream *&input, INT64 start, INT64 size, int workers,
+                              INT64 max_bytes)
+      : slot(input), saved(input), window(NULL), nworkers(workers)
+  {
+    if (workers < 2 || input->get_span(start, size))
+      return;
+    if (size < 0 || size > max_bytes || size > INT64(INT_MAX))
+    {
+      nworkers = 1;
+      return;
+    }
+    try
+    {
+      window = new LibRaw_readahead_datastream(input, start, size);
+      slot = window;
+    }
+    catch (const std::bad_alloc &)
+    {
+      nworkers = 1;
+    }
+  }
+  ~LibRaw_parallel_input_scope()
+  {
+    slot = saved;
+    delete window;
+  }
+  int workers() const { return nworkers; }
+
+private:
+  LibRaw_abstract_datastream *&slot, *saved;
+  LibRaw_readahead_datastream *window;
+  int nworkers;
+  LibRaw_parallel_input_scope(const LibRaw_parallel_input_scope &);
+  LibRaw_parallel_input_scope &operator=(const LibRaw_parallel_input_scope &);
+};
+
 #endif
@@ -158,6 +158,7 @@ it under the terms of the one of two licenses as you choose:
 	ushort *    ljpeg_row (int jrow, struct jhead *jh);
 	ushort *    ljpeg_row_unrolled (int jrow, struct jhead *jh);
 	void	    ljpeg_idct (struct jhead *jh);
+	int         ljpeg_read_data(std::vector<uchar> &buf, INT64 offset, INT64 size);
 	unsigned    ph1_bithuff (int nbits, ushort *huff);
 
 // Canon DSLRs
@@ -169,6 +170,7 @@ it under the terms of the one of two licenses as you choose:
 // Adobe DNG
 	void        adobe_copy_pixel (unsigned int row, unsigned int col, ushort **rp);
 	void        lossless_dng_load_raw();
+	void        lossless_dng_tile_table(std::vector<INT64> &toffsets, std::vector<INT64> &tbytes);
 	void        deflate_dng_load_raw();
 	void        packed_dng_load_raw();
     void        packed_tiled_dng_load_raw();
@@ -227,6 +229,8 @@ it under the terms of the one of two licenses as you choose:
 	void        imacon_full_load_raw();
 	void        hasselblad_full_load_raw();
 	void        packed_load_raw();
+	bool        packed_load_rows(int bwide, int rbits, int bite, int half);
+	void        packed_bits_row(int row, int bite, int lf, UINT64 &bitbuf, int &vbits);
 	float       find_green(int,int,int,int);
 	void        unpacked_load_raw();
 	void        unpacked_load_raw_FujiDBP();
@@ -299,6 +303,7 @@ it under the terms of the one of two licenses as you choose:
 	void        x3f_dpq_interpolate_rg();
 	void        x3f_dpq_interpolate_af(int xstep, int ystep, int scale); // 1x1 af pixels
 	void        x3f_dpq_interpolate_af_sd(int xstart,int ystart, int xend, int yend, int xstep, int ystep, int scale); // sd Quattro interpolation
+	static void x3f_parallel_run(void *ctx, int count, void (*task)(void *, int), void *data);
 #else
 	void        parse_x3f() {}
 	void        x3f_load_raw(){}
@@ -326,6 +331,99 @@ it under the terms of the one of two licenses as you choose:
 	char** malloc_omp_buffers(int buffer_count, size_t buffer_size);
 	void free_omp_buffers(char** buffers, int buffer_count);
 
+// Parallel loops: user executor, worker pool, OpenMP or serial
+	int parallel_workers();
+	int omp_threads();
+	void parallel_run(int count, parallel_task_callback task, void *task_data, int max_workers = 0);
+	template <class Body> struct parallel_task
+	{
+		Body *body;
+		std::atomic<int> error; /* first exception thrown by any worker */
+		void fail(int e)
+		{
+			int none = LIBRAW_EXCEPTION_NONE;
+			error.compare_exchange_strong(none, e);
+		}
+		static void run(void *data, int first, int last, int worker)
+		{
+			parallel_task *t = (parallel_task *)data;
+			try
+			{
+				for (int i = first; i < last && !t->error.load(std::memory_order_relaxed); i++)
+					(*t->body)(i, worker);
+			}
+			catch (const LibRaw_exceptions &e)
+			{
+				t->fail(e);
+			}
+			catch (const std::bad_alloc &)
+			{
+				t->fail(LIBRAW_EXCEPTION_ALLOC);
+			}
+			catch (...)
+			{
+				t->fail(LIBRAW_EXCEPTION_IO_CORRUPT);
+			}
+		}
+	};
+	/* body(i, worker) for i in [0, count) on at most max_workers workers (0: no limit) */
+	template <class Body> void parallel_for_workers(int count, int max_workers, Body body)
+	{
+		parallel_task<Body> t;
+		t.body = &body;
+		t.error = LIBRAW_EXCEPTION_NONE;
+		parallel_run(count, parallel_task<Body>::run, &t, max_workers);
+		if (t.error)
+			throw LibRaw_exceptions(t.error.load());
+	}
+	/* body(i, worker) for i in [0, count); worker < parallel_workers() */
+	template <class Body> void parallel_for(int count, Body body)
+	{
+		parallel_for_workers(count, 0, body);
+	}
+	/* body(i, worker) for i in [first, last) */
+	template <class Body> void parallel_for(int first, int last, Body body)
+	{
+		parallel_for(last - first,
+			[&](int i, int worker) { body(first + i, worker); });
+	}
+	/* body(data, first, n) over rows of stride bytes starting at start:
+	   in place for in-memory streams, otherwise in bands of about 16 MB
+	   (zero-filled past a short read). Leaves the stream after the rows */
+	template <class Body> void uncompressed_bands(INT64 start, INT64 stride, int rows, Body body)
+	{
+		LibRaw_abstract_datastream *in = libraw_internal_data.internal_data.input;
+		if (rows < 1 || stride < 1)
+			return;
+		if (const uchar *span = in->get_span(start, stride * rows))
+		{
+			in->seek(start + stride * rows, SEEK_SET);
+			body(span, 0, rows);
+			return;
+		}
+		const INT64 fit = INT64(16 << 20) / stride;
+		const int band = fit < 1 ? 1 : fit < rows ? int(fit) : rows;
+		std::vector<uchar> buf;
+		try
+		{
+			buf.resize(size_t(stride * band));
+		}
+		catch (...)
+		{
+			throw LIBRAW_EXCEPTION_ALLOC;
+		}
+		in->seek(start, SEEK_SET);
+		for (int first = 0; first < rows; first += band)
+		{
+			const int n = rows - first < band ? rows - first : band;
+			const size_t bytes = size_t(stride * n);
+			const int got = in->read(buf.data(), 1, bytes);
+			if (got < 0 || size_t(got) < bytes)
+				memset(buf.data() + (got > 0 ? got : 0), 0, bytes - (got > 0 ? got : 0));
+			body((const uchar *)buf.data(), first, n);
+		}
+	}
+
 
 // Tiff/Exif parsers
 	void        tiff_get (INT64 base,unsigned *tag, unsigned *type, unsigned *len, INT64 *save);
@@ -381,32 +479,35 @@ it under the terms of the one of two licenses as you choose:
 	void parse_fuji_compressed_header();
 	void crxLoadRaw();
 	int  crxParseImageHeader(uchar *cmp1TagData, int nTrack, INT64 size);
+	void panasonicC5_load_raw();
 	void panasonicC6_load_raw();
 	void panasonicC7_load_raw();
+	void panasonic_load_rows(int rowbytes);
 	void panasonicC8_load_raw();
 
 	void nikon_14bit_load_raw();
 
 // DCB
 	void  	dcb_pp();
-	void  	dcb_copy_to_buffer(float (*image2)[3]);
-	void  	dcb_restore_from_buffer(float (*image2)[3]);
+	void  	dcb_copy_to_buffer(ushort (*rb)[2]);
+	void  	dcb_restore_from_buffer(ushort (*rb)[2]);
 	void  	dcb_color();
 	void  	dcb_color_full();
 	void  	dcb_map();
 	void  	dcb_correction();
 	void  	dcb_correction2();
 	void  	dcb_refinement();
-	void  	rgb_to_lch(double (*image3)[3]);
-	void  	lch_to_rgb(double (*image3)[3]);
+	void  	rgb_to_lch(double (*lch)[3], int rfirst, int rlast);
+	void  	lch_to_rgb(double (*lch)[3], int rfirst, int rlast);
 	void  	fbdd_correction();
-	void  	fbdd_correction2(double (*image3)[3]);
+	void  	fbdd_correction2(double (*lch)[3], int row);
+	void  	fbdd_chroma();
 	void  	fbdd_green();
-	void  	dcb_ver(float (*image3)[3]);
-	void 	dcb_hor(float (*image2)[3]);
-	void 	dcb_color2(float (*image2)[3]);
-	void 	dcb_color3(float (*image3)[3]);
-	void 	dcb_decide(float (*image2)[3], float (*image3)[3]);
+	void  	dcb_ver(float (*image3)[3], int rfirst, int rlast, int boff);
+	void 	dcb_hor(float (*image2)[3], int rfirst, int rlast, int boff);
+	void 	dcb_color2(float (*image2)[3], int rfirst, int rlast, int boff);
+	void 	dcb_color3(float (*image3)[3], int rfirst, int rlast, int boff);
+	void 	dcb_decide(float (*image2)[3], float (*image3)[3], int rfirst, int rlast, int boff);
 	void 	dcb_nyquist();
 #endif
 
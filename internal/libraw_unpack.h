@@ -0,0 +1,42 @@
+/* -*- C++ -*-
+ * File: libraw_unpack.h
+ * Copyright (C) 2026 LibRaw LLC
+ *
+   Unpacking of uncompressed (packed or plain) sample rows, shared by the
+   generic, Nikon and Fuji loaders. Kernels are compiled for several
+   instruction sets (LIBRAW_SIMD_CLONES).
+
+LibRaw is free software; you can redistribute it and/or modify
+it under the terms of the one of two licenses as you choose:
+
+1. GNU LESSER GENERAL PUBLIC LICENSE version 2.1
+   (See file LICENSE.LGPL provided in LibRaw distribution archive for details).
+
+2. COMMON DEVELOPMENT AND DISTRIBUTION LICENSE (CDDL) Version 1.0
+   (See file LICENSE.CDDL provided in LibRaw distribution archive for details).
+
+ */
+#pragma once
+#include <stdint.h>
+
+/* count samples of bps (1..16) bits packed without gaps, starting at bit 0
+   of src: _be takes the most significant bit of each byte first (getbits()
+   order), _le the least significant one. Bytes past src_bytes read as zero */
+void libraw_unpack_be(const uint8_t *src, unsigned src_bytes, uint16_t *dst,
+                      int count, int bps);
+void libraw_unpack_le(const uint8_t *src, unsigned src_bytes, uint16_t *dst,
+                      int count, int bps);
+
+/* 16-bit samples in little or big endian byte order */
+void libraw_unpack16(const uint8_t *src, uint16_t *dst, int count,
+                     bool big_endian);
+
+/* 8-bit samples through a lookup table */
+void libraw_unpack8(const uint8_t *src, uint16_t *dst, int count,
+                    const uint16_t *tone);
+
+/* Copies bytes from src to dst (which may be the same buffer) reversing the
+   byte order within each whole group of 2, 3 or 4 bytes: streams stored as
+   little endian words but read most significant bit first */
+void libraw_swap_groups(const uint8_t *src, uint8_t *dst, unsigned bytes,
+                        int group);
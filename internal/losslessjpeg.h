@@ -156,13 +156,7 @@ struct HuffTable
       {
         uint32_t _bits = (cached >> 16) & 0xff;
         int16_t val = int16_t(cached & 0xffff);
-        if (val == -32768 && dng_bug)
-        {
-          if (_bits > 16)
-            pump.consume(_bits - 16);
-        }
-        else
-          pump.consume(_bits);
+        pump.consume(_bits);
         return val;
       }
       else
@@ -181,6 +175,8 @@ struct HuffTable
       int32_t _diff = diff(pump, _len);
       uint8_t bits8 = (_len >> 16) & 0xff;
       uint8_t len8 = (_len >> 8) & 0xff;
+      if (len8 == 16) // no diff bits follow unless dng_bug is set
+        len8 = dng_bug ? 16 : 0;
       outlen = bits8 + len8;
       return _diff;
     }
@@ -246,6 +242,7 @@ struct LibRaw_LjpegDecompressor
 	ByteStreamBE buffer;
 	LibRaw_SOFInfo sof;
 	uint32_t predictor, point_transform;
+	uint32_t restart_interval;
 	uint32_t datastart;
 	std::vector<HuffTable> dhts;
 	LibRaw_LjpegDecompressor(uint8_t *b, unsigned s);
@@ -266,7 +263,8 @@ struct LibRaw_LjpegDecompressor
 		InvalidDHT = 5,
 		InvalidSOF = 6,
         InvalidSOS = 7,
-		DQTPresent = 8
+		DQTPresent = 8,
+		InvalidDRI = 9
       };
 
 	};
@@ -279,6 +277,7 @@ struct LibRaw_LjpegDecompressor
 			EOI = 0xd9,  // end of image
 			SOS = 0xda,  // start of scan
 			DQT = 0xdb,  // quantization tables
+			DRI = 0xdd,  // restart interval
 			Fill = 0xff,
 		};
 	};
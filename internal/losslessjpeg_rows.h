@@ -0,0 +1,54 @@
+/* -*- C++ -*-
+ * File: losslessjpeg_rows.h
+ * Copyright (C) 2026 LibRaw LLC
+ *
+   Row-by-row interface to the table-driven lossless JPEG decoder.
+   Kept separate from losslessjpeg.h so it can be used from dcraw-style
+   sources (var_defines.h redefines width/height/order etc.)
+
+LibRaw is free software; you can redistribute it and/or modify
+it under the terms of the one of two licenses as you choose:
+
+1. GNU LESSER GENERAL PUBLIC LICENSE version 2.1
+   (See file LICENSE.LGPL provided in LibRaw distribution archive for details).
+
+2. COMMON DEVELOPMENT AND DISTRIBUTION LICENSE (CDDL) Version 1.0
+   (See file LICENSE.CDDL provided in LibRaw distribution archive for details).
+
+ */
+#pragma once
+#include <stdint.h>
+
+struct LibRaw_LjpegRowDecoderImpl;
+
+class LibRaw_LjpegRowDecoder
+{
+public:
+  /* Data buffer is not copied and should have at least 4 extra (zero) bytes
+     after the JPEG stream. Pre-1.1 DNG handling of 16-bit diffs is not
+     supported, use ljpeg_row() for such files */
+  LibRaw_LjpegRowDecoder(uint8_t *data, unsigned datasize);
+  ~LibRaw_LjpegRowDecoder();
+
+  /* false: stream is not plain lossless JPEG (lossy, subsampled, restart
+     markers, unsupported precision...), use dcraw-style ljpeg_row() instead */
+  bool valid() const { return _valid; }
+
+  unsigned jpeg_width() const { return _width; }   /* in pixels */
+  unsigned jpeg_height() const { return _height; }
+  unsigned components() const { return _cps; }
+  unsigned bits() const { return _bits; }
+  unsigned errors() const { return _errors; } /* out of range samples count */
+
+  /* jpeg_width()*components() interleaved samples, NULL after the last row;
+     the pointer is valid until the next call */
+  uint16_t *next_row();
+
+private:
+  LibRaw_LjpegRowDecoder(const LibRaw_LjpegRowDecoder &);
+  LibRaw_LjpegRowDecoder &operator=(const LibRaw_LjpegRowDecoder &);
+
+  LibRaw_LjpegRowDecoderImpl *impl;
+  bool _valid;
+  unsigned _width, _height, _cps, _bits, _errors;
+};
@@ -210,11 +210,22 @@ typedef struct x3f_huffnode_s
   uint32_t leaf;
 } x3f_huffnode_t;
 
+/* Codes are looked up this many bits at a time */
+#define HUF_LUT_BITS 12
+
+typedef struct x3f_huflut_s
+{
+  int32_t value;  /* Decoded value */
+  uint8_t length; /* Bits consumed, 0 = walk the tree instead */
+  uint8_t extra;  /* TRUE: difference bits still to read */
+} x3f_huflut_t;
+
 typedef struct x3f_hufftree_s
 {
   uint32_t free_node_index; /* Free node index in huffman tree array */
   uint32_t total_node_index;
   x3f_huffnode_t *nodes;    /* Coding tree */
+  x3f_huflut_t *lut;        /* Lookup table built from the tree */
 } x3f_hufftree_t;
 
 typedef struct x3f_true_huffman_element_s
@@ -490,6 +501,11 @@ typedef struct x3f_info_s
   {
     LibRaw_abstract_datastream *file; /* Use if more data is needed */
   } input, output;
+  /* Runs task(data, i) for i in [0, count), possibly concurrently.
+     NULL means run the tasks in order in the calling thread. */
+  void (*parallel)(void *ctx, int count, void (*task)(void *data, int i),
+                   void *data);
+  void *parallel_ctx;
 } x3f_info_t;
 
 typedef struct x3f_s
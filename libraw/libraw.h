@@ -76,6 +76,9 @@ it under the terms of the one of two licenses as you choose:
 
 #include "libraw_datastream.h"
 #include "libraw_types.h"
+#if defined(__cplusplus) && defined(LIBRAW_LIBRARY_BUILD)
+#include <atomic>
+#endif
 #include "libraw_const.h"
 #include "libraw_internal.h"
 #include "libraw_alloc.h"
@@ -137,6 +140,9 @@ extern "C"
                                            void *datap);
   DllDef void libraw_set_progress_handler(libraw_data_t *, progress_callback cb,
                                           void *datap);
+  DllDef void libraw_set_parallel_handler(libraw_data_t *,
+                                          parallel_executor_callback cb,
+                                          void *datap, int workers);
   DllDef const char *libraw_unpack_function_name(libraw_data_t *lr);
   DllDef int libraw_get_decoder_info(libraw_data_t *lr,
                                      libraw_decoder_info_t *d);
@@ -154,7 +160,12 @@ extern "C"
   libraw_dcraw_make_mem_image(libraw_data_t *lr, int *errc);
   DllDef libraw_processed_image_t *
   libraw_dcraw_make_mem_thumb(libraw_data_t *lr, int *errc);
+  DllDef libraw_processed_image_t *
+  libraw_dcraw_make_mem_preview(libraw_data_t *lr, int *errc);
   DllDef void libraw_dcraw_clear_mem(libraw_processed_image_t *);
+  DllDef int libraw_dcraw_output_rows(libraw_data_t *lr,
+                                      output_rows_callback cb, void *cb_data,
+                                      int band_height, int bgr);
   /* getters/setters used by 3DLut Creator */
   DllDef void libraw_set_demosaic(libraw_data_t *lr, int value);
   DllDef void libraw_set_output_color(libraw_data_t *lr, int value);
@@ -250,6 +261,13 @@ public:
     callbacks.progresscb_data = data;
     callbacks.progress_cb = pcb;
   }
+  void set_parallel_handler(parallel_executor_callback cb, void *data,
+                            int workers)
+  {
+    callbacks.parallelcb_data = data;
+    callbacks.parallel_cb = cb;
+    callbacks.parallel_workers = workers;
+  }
 
   static const char* cameramakeridx2maker(unsigned maker);
   int setMakeFromIndex(unsigned index);
@@ -287,12 +305,15 @@ public:
   /* memory writers */
   virtual libraw_processed_image_t *dcraw_make_mem_image(int *errcode = NULL);
   virtual libraw_processed_image_t *dcraw_make_mem_thumb(int *errcode = NULL);
+  virtual libraw_processed_image_t *dcraw_make_mem_preview(int *errcode = NULL);
   static void dcraw_clear_mem(libraw_processed_image_t *);
 
   /* Additional calls for make_mem_image */
   void get_mem_image_format(int *width, int *height, int *colors,
                             int *bps) const;
   int copy_mem_image(void *scan0, int stride, int bgr);
+  int dcraw_output_rows(output_rows_callback cb, void *cb_data,
+                        int band_height = 0, int bgr = 0);
 
   /* free all internal data structures */
   void recycle();
@@ -389,6 +410,26 @@ protected:
   /* Panasonic Compression 8 parallel decoder stubs*/
   virtual void pana8_decode_loop(void*);
   int pana8_decode_strip(void*, int); // return: 0 if OK, non-zero on error
+  /* Panasonic encodings 5, 6, 7 parallel block decoder stubs */
+  virtual void panasonic_decode_loop(void *, int count);
+  void panasonic_decode_unit(void *, int unit);
+  /* Sony ARW6 parallel tile decoder stubs */
+  virtual void sony_arw6_decode_loop(void *, int count, int max_threads);
+  void sony_arw6_decode_tile(void *, int tile);
+  /* Sony ARW2 row-parallel decoder stubs */
+  virtual void sony_arw2_decode_loop(const uchar *data, int first, int count);
+  void sony_arw2_decode_row(const uchar *data, int row);
+  /* Phase One IIQ L and S row-parallel decoder stubs */
+  virtual void phase_one_c_decode_loop(void *, int count);
+  void phase_one_c_decode_unit(void *, int unit);
+  virtual void phase_one_s_decode_loop(void *, int count);
+  void phase_one_s_decode_row(void *, int unit, int worker);
+  /* Tiled lossless DNG parallel decoder stubs */
+  virtual void lossless_dng_decode_loop(void *, int count);
+  void lossless_dng_decode_tile(void *, int tile);
+  /* Deflate (floating point) DNG parallel decoder stubs */
+  virtual void deflate_dng_decode_loop(void *, int count);
+  void deflate_dng_decode_tile(void *, int slot);
 
   int FCF(int row, int col)
   {
@@ -437,6 +478,7 @@ protected:
                                 char **list);
   void write_ppm_tiff();
   void convert_to_rgb();
+  void convert_to_rgb_matrix(float out_cam[3][4]);
   void remove_zeroes();
   void crop_masked_pixels();
 #ifndef NO_LCMS
@@ -462,6 +504,9 @@ protected:
   void hat_transform(float *temp, float *base, int st, int size, int sc);
   void wavelet_denoise();
   void scale_colors();
+  int scale_colors_auto_wb();
+  void scale_colors_camera_wb();
+  void scale_colors_mul(float scale_mul[4]);
   void median_filter();
   void blend_highlights();
   void recover_highlights();
@@ -482,6 +527,10 @@ protected:
   unsigned get4();
 
   int flip_index(int row, int col);
+  void mem_image_curve();
+  int make_mem_preview(libraw_processed_image_t **out);
+  void copy_mem_rows(void *scan0, int stride, int bgr, int first_row,
+                     int nrows);
   void gamma_curve(double pwr, double ts, int mode, int imax);
   void cubic_spline(const int *x_, const int *y_, const int len);
 
@@ -512,6 +561,8 @@ protected:
   }
 
 #ifdef LIBRAW_LIBRARY_BUILD
+  friend struct DHT;
+  friend struct AAHD;
 #include "internal/libraw_internal_funcs.h"
 #endif
 };
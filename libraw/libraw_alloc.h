@@ -24,6 +24,14 @@ it under the terms of the one of two licenses as you choose:
 #include "libraw_const.h"
 
 #ifdef __cplusplus
+#if defined(LIBRAW_LIBRARY_BUILD) && defined(LIBRAW_USE_THREAD_POOL)
+#include <mutex>
+/* allocations may come from pool threads: serialize the table updates */
+#define LIBRAW_MEMS_GUARD                                                      \
+  std::lock_guard<std::mutex> mems_guard(mems_lock())
+#else
+#define LIBRAW_MEMS_GUARD
+#endif
 
 #define LIBRAW_MSIZE 512
 
@@ -85,9 +93,17 @@ public:
 private:
   void **mems;
   unsigned extra_bytes;
+#if defined(LIBRAW_LIBRARY_BUILD) && defined(LIBRAW_USE_THREAD_POOL)
+  static std::mutex &mems_lock()
+  {
+    static std::mutex lock;
+    return lock;
+  }
+#endif
   void mem_ptr(void *ptr)
   {
 	  if (!mems) return;
+	  LIBRAW_MEMS_GUARD;
 #if defined(LIBRAW_USE_OPENMP)
       bool ok = false; /* do not return from critical section */
 #endif
@@ -131,6 +147,7 @@ private:
   void forget_ptr(void *ptr)
   {
 	if (!mems) return;
+	LIBRAW_MEMS_GUARD;
 #if defined(LIBRAW_USE_OPENMP)
 #pragma omp critical
     {
@@ -118,6 +118,10 @@ public:
 #ifdef LIBRAW_WIN32_UNICODEPATHS
   virtual const wchar_t *wfname() { return NULL; };
 #endif
+  /* Pointer to size bytes at offset if stream data is already in memory
+     (buffer or mmap streams), NULL otherwise. Stream position is not
+     changed, the pointer is valid while the stream exists */
+  virtual const unsigned char *get_span(INT64, INT64) { return NULL; }
 };
 
 #ifndef LIBRAW_NO_IOSTREAMS_DATASTREAM
@@ -284,6 +288,7 @@ public:
     if (streampos >= streamsize)   return -1;
     return buf[streampos++];
   }
+  virtual const unsigned char *get_span(INT64 offset, INT64 sz);
 
 private:
   unsigned char *buf;
@@ -328,6 +333,32 @@ protected:
 #endif
 };
 
+#if !defined(LIBRAW_WIN32_CALLS) && !defined(LIBRAW_NO_MMAP_DATASTREAM)
+#define LIBRAW_MMAP_DATASTREAM
+class DllDef LibRaw_mmap_datastream : public LibRaw_buffer_datastream
+{
+public:
+  /* ctor: maps whole file read-only; object is non-valid if file
+     cannot be opened or mapped */
+  LibRaw_mmap_datastream(const char *fname);
+  /* dtor: unmap the file */
+  virtual ~LibRaw_mmap_datastream();
+  virtual const char *fname();
+
+protected:
+  inline void reconstruct_base()
+  {
+    /* same trick as in LibRaw_windows_datastream */
+    (LibRaw_buffer_datastream &)*this =
+        LibRaw_buffer_datastream(map_, (size_t)mapsize_);
+  }
+
+  std::string filename;
+  void *map_;     /* mapped file data */
+  INT64 mapsize_; /* size of the mapping in bytes */
+};
+#endif
+
 #ifdef LIBRAW_WIN32_CALLS
 class DllDef LibRaw_windows_datastream : public LibRaw_buffer_datastream
 {
@@ -230,6 +230,7 @@ struct tiff_ifd_t
 {
   int t_width, t_height, bps, comp, phint, t_flip, samples, extrasamples;
   INT64 offset, bytes;
+  int bytes_type; /* TileByteCounts tag type */
   int t_tile_width, t_tile_length, sample_format, predictor;
   int rows_per_strip;
   INT64 *strip_offsets;
@@ -76,6 +76,12 @@ typedef unsigned __int64 uint64_t;
 #include <omp.h>
 #endif
 
+/* Built-in worker pool for parallel loops: thread-safe builds only */
+#if defined(__cplusplus) && !defined(LIBRAW_NOTHREADS) &&                     \
+    !defined(LIBRAW_NO_THREAD_POOL)
+#define LIBRAW_USE_THREAD_POOL
+#endif
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -158,6 +164,14 @@ typedef unsigned long long UINT64;
   typedef int (*pre_identify_callback)(void *ctx);
   typedef void (*post_identify_callback)(void *ctx);
   typedef void (*process_step_callback)(void *ctx);
+  typedef int (*output_rows_callback)(void *data, const void *rows,
+                                      int first_row, int nrows, int stride);
+  typedef void (*parallel_task_callback)(void *task_data, int first, int last,
+                                         int worker);
+  typedef int (*parallel_executor_callback)(void *data,
+                                            parallel_task_callback task,
+                                            void *task_data, int count,
+                                            int workers);
 
   typedef struct
   {
@@ -175,6 +189,9 @@ typedef unsigned long long UINT64;
         pre_preinterpolate_cb, pre_interpolate_cb, interpolate_bayer_cb,
         interpolate_xtrans_cb, post_interpolate_cb, pre_converttorgb_cb,
         post_converttorgb_cb;
+    parallel_executor_callback parallel_cb;
+    void *parallelcb_data;
+    int parallel_workers;
   } libraw_callbacks_t;
 
   typedef struct
@@ -988,6 +1005,8 @@ typedef unsigned long long UINT64;
       char p4shot_order[5];
       /* Custom camera list */
       char **custom_camera_strings;
+      /* Worker threads limit, 0: no limit */
+      int max_threads;
   }libraw_raw_unpack_params_t;
 
   typedef struct
@@ -63,13 +63,15 @@ int main(int argc, char *argv[])
         "-s <num>       Select one raw image from input file\n"
         "-B <x y w h>   Crop output image\n"
         "-R <num>       Number of repetitions\n"
-        "-c             Do not use rawspeed\n",
+        "-c             Do not use rawspeed\n"
+        "-u             Measure unpack() speed only (repeated -R times)\n"
+        "-L             Use legacy (dcraw) lossless JPEG decoder\n",
         LibRaw::version(), LibRaw::cameraCount(), argv[0]);
     return 0;
   }
   char opm, opt, *cp, *sp;
   int arg, c;
-  int shrink = 0;
+  int shrink = 0, unpack_only = 0;
 
   argv[argc] = (char *)"";
   for (arg = 1; (((opm = argv[arg][0]) - 2) | 2) == '+';)
@@ -120,6 +122,12 @@ int main(int argc, char *argv[])
     case 'c':
       RawProcessor.imgdata.rawparams.use_rawspeed = 0;
       break;
+    case 'u':
+      unpack_only = 1;
+      break;
+    case 'L':
+      OUTR.options |= LIBRAW_RAWOPTIONS_LJPEG_LEGACY_DECODER;
+      break;
     default:
       fprintf(stderr, "Unknown option \"-%c\".\n", opt);
       return 1;
@@ -128,6 +136,34 @@ int main(int argc, char *argv[])
   for (; arg < argc; arg++)
   {
     printf("Processing file %s\n", argv[arg]);
+    if (unpack_only)
+    {
+      float fsize = 0.f;
+      FILE *f = fopen(argv[arg], "rb");
+      if (f)
+      {
+        fseek(f, 0, SEEK_END);
+        fsize = float(ftell(f)) / 1048576.0f;
+        fclose(f);
+      }
+      timerstart();
+      for (c = 0; c < rep; c++)
+        if ((ret = RawProcessor.open_file(argv[arg])) != LIBRAW_SUCCESS ||
+            (ret = RawProcessor.unpack()) != LIBRAW_SUCCESS)
+        {
+          fprintf(stderr, "Cannot unpack %s: %s\n", argv[arg],
+                  libraw_strerror(ret));
+          break;
+        }
+      float msec = timerend() / (float)rep;
+      if (c == rep)
+        printf("Unpack: %.1f msec, %.1f MB/sec (file), %.2f Mpix/sec, "
+               "decoder: %s\n",
+               msec, fsize * 1000.0f / msec,
+               float(S.raw_width) * float(S.raw_height) / 1000.0f / msec,
+               RawProcessor.unpack_function_name());
+      continue;
+    }
     timerstart();
     if ((ret = RawProcessor.open_file(argv[arg])) != LIBRAW_SUCCESS)
     {
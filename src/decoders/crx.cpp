@@ -53,7 +53,8 @@ libraw_inline void _BitScanReverse(DWORD *Index, unsigned long Mask)
 
 struct CrxBitstream
 {
-  uint8_t mdatBuf[CRX_BUF_SIZE];
+  const uint8_t *mdatBuf; // points to mdatStore or directly to in-memory stream data
+  uint8_t mdatStore[CRX_BUF_SIZE];
   INT64 mdatSize;
   INT64 curBufOffset;
   uint32_t curPos;
@@ -206,18 +207,19 @@ static inline void crxFillBuffer(CrxBitstream *bitStrm)
   {
     bitStrm->curPos = 0;
     bitStrm->curBufOffset += bitStrm->curBufSize;
-#ifdef LIBRAW_USE_OPENMP
-#pragma omp critical
-#endif
+    INT64 spanSize = _min(bitStrm->mdatSize, INT64(0x40000000));
+    if (const uint8_t *span = bitStrm->input->get_span(bitStrm->curBufOffset, spanSize))
+    {
+      bitStrm->mdatBuf = span;
+      bitStrm->curBufSize = uint32_t(spanSize);
+    }
+    else
     {
-#ifndef LIBRAW_USE_OPENMP
+      bitStrm->mdatBuf = bitStrm->mdatStore;
       bitStrm->input->lock();
-#endif
       bitStrm->input->seek(bitStrm->curBufOffset, SEEK_SET);
-      bitStrm->curBufSize = bitStrm->input->read(bitStrm->mdatBuf, 1, _min(bitStrm->mdatSize, CRX_BUF_SIZE));
-#ifndef LIBRAW_USE_OPENMP
+      bitStrm->curBufSize = bitStrm->input->read(bitStrm->mdatStore, 1, _min(bitStrm->mdatSize, CRX_BUF_SIZE));
       bitStrm->input->unlock();
-#endif
     }
     if (bitStrm->curBufSize < 1) // nothing read
       throw LIBRAW_EXCEPTION_IO_EOF;
@@ -245,7 +247,7 @@ libraw_inline int crxBitstreamGetZeros(CrxBitstream *bitStrm)
     {
       while (bitStrm->curPos + 4 <= bitStrm->curBufSize)
       {
-        nextData = _byteswap_ulong(*(uint32_t *)(bitStrm->mdatBuf + bitStrm->curPos));
+        nextData = _byteswap_ulong(*(const uint32_t *)(bitStrm->mdatBuf + bitStrm->curPos));
         bitStrm->curPos += 4;
         crxFillBuffer(bitStrm);
         if (nextData)
@@ -287,7 +289,7 @@ libraw_inline uint32_t crxBitstreamGetBits(CrxBitstream *bitStrm, int bits)
     // get them from stream
     if (bitStrm->curPos + 4 <= bitStrm->curBufSize)
     {
-      nextWord = _byteswap_ulong(*(uint32_t *)(bitStrm->mdatBuf + bitStrm->curPos));
+      nextWord = _byteswap_ulong(*(const uint32_t *)(bitStrm->mdatBuf + bitStrm->curPos));
       bitStrm->curPos += 4;
       crxFillBuffer(bitStrm);
       bitStrm->bitsLeft = 32 - (bits - bitsLeft);
@@ -1765,6 +1767,7 @@ int crxParamInit(CrxImage *img, CrxBandParam **param, uint64_t subbandMdatOffset
   (*param)->bitStream.curBufSize = 0;
   (*param)->bitStream.curBufOffset = subbandMdatOffset;
   (*param)->bitStream.input = img->input;
+  (*param)->bitStream.mdatBuf = (*param)->bitStream.mdatStore;
 
   crxFillBuffer(&(*param)->bitStream);
 
@@ -2452,6 +2455,7 @@ int crxReadImageHeaders(crx_data_header_t *hdr, CrxImage *img, uint8_t *mdatPtr,
       bitStrm.mdatSize = tile->mdatQPDataSize;
       bitStrm.curBufOffset = img->mdatOffset + tile->dataOffset;
       bitStrm.input = img->input;
+      bitStrm.mdatBuf = bitStrm.mdatStore;
 
       crxFillBuffer(&bitStrm);
 
@@ -2622,35 +2626,36 @@ int crxFreeImageData(CrxImage *img)
 }
 void LibRaw::crxLoadDecodeLoop(void *img, int nPlanes)
 {
-#ifdef LIBRAW_USE_OPENMP
-  int results[4] ={0,0,0,0}; // nPlanes is always <= 4
-#pragma omp parallel for
-  for (int32_t plane = 0; plane < nPlanes; ++plane)
-   try {
-    results[plane] = crxDecodePlane(img, plane);
-   } catch (...) {
-    results[plane] = 1;
-   }
+  CrxImage *image = (CrxImage *)img;
+  LibRaw_parallel_input_scope input(libraw_internal_data.internal_data.input,
+                                    libraw_internal_data.unpacker_data.data_offset,
+                                    libraw_internal_data.unpacker_data.data_size, nPlanes > 1 ? parallel_workers() : 1,
+                                    INT64(imgdata.rawparams.max_raw_memory_mb) * INT64(1024 * 1024));
+  LibRaw_abstract_datastream *saved = image->input;
+  image->input = libraw_internal_data.internal_data.input;
+  int results[4] = {0, 0, 0, 0}; // nPlanes is always <= 4
+  parallel_for_workers(MIN(nPlanes, 4), input.workers(), [&](int plane, int) {
+    try
+    {
+      results[plane] = crxDecodePlane(img, plane);
+    }
+    catch (...)
+    {
+      results[plane] = 1;
+    }
+  });
+  image->input = saved;
 
   for (int32_t plane = 0; plane < nPlanes; ++plane)
     if (results[plane])
       derror();
-#else
-  for (int32_t plane = 0; plane < nPlanes; ++plane)
-    if (crxDecodePlane(img, plane))
-      derror();
-#endif
 }
 
 void LibRaw::crxConvertPlaneLineDf(void *p, int imageRow) { crxConvertPlaneLine((CrxImage *)p, imageRow); }
 
 void LibRaw::crxLoadFinalizeLoopE3(void *p, int planeHeight)
 {
-#ifdef LIBRAW_USE_OPENMP
-#pragma omp parallel for
-#endif
-  for (int i = 0; i < planeHeight; ++i)
-    crxConvertPlaneLineDf(p, i);
+  parallel_for(planeHeight, [&](int i, int) { crxConvertPlaneLineDf(p, i); });
 }
 
 void LibRaw::crxLoadRaw()
@@ -2683,19 +2688,10 @@ void LibRaw::crxLoadRaw()
 
   int bytes = 0;
   // read image header
-#ifdef LIBRAW_USE_OPENMP
-#pragma omp critical
-#endif
-  {
-#ifndef LIBRAW_USE_OPENMP
-    libraw_internal_data.internal_data.input->lock();
-#endif
-    libraw_internal_data.internal_data.input->seek(libraw_internal_data.unpacker_data.data_offset, SEEK_SET);
-    bytes = libraw_internal_data.internal_data.input->read(hdrBuf.data(), 1, hdr.mdatHdrSize);
-#ifndef LIBRAW_USE_OPENMP
-    libraw_internal_data.internal_data.input->unlock();
-#endif
-  }
+  libraw_internal_data.internal_data.input->lock();
+  libraw_internal_data.internal_data.input->seek(libraw_internal_data.unpacker_data.data_offset, SEEK_SET);
+  bytes = libraw_internal_data.internal_data.input->read(hdrBuf.data(), 1, hdr.mdatHdrSize);
+  libraw_internal_data.internal_data.input->unlock();
 
   if (bytes != hdr.mdatHdrSize)
     throw LIBRAW_EXCEPTION_IO_EOF;
@@ -18,6 +18,7 @@
 
 #include "../../internal/dcraw_defs.h"
 #include "../../internal/libraw_cameraids.h"
+#include "../../internal/losslessjpeg_rows.h"
 
 unsigned LibRaw::getbithuff(int nbits, ushort *huff)
 {
@@ -540,33 +541,88 @@ ushort *LibRaw::ljpeg_row_unrolled(int jrow, struct jhead *jh)
   return row[2];
 }
 
+int LibRaw::ljpeg_read_data(std::vector<uchar> &buf, INT64 offset, INT64 size)
+{
+  if (offset < 0 || size < 4 || size > 0x7ffffff0LL || offset + size > ifp->size())
+    return 0;
+  if (size > INT64(imgdata.rawparams.max_raw_memory_mb) * INT64(1024 * 1024))
+    return 0;
+  // four zero bytes at end: bit pump look-ahead
+  buf.assign(size_t(size) + 4, 0);
+  fseek(ifp, offset, SEEK_SET);
+  INT64 readed = fread(buf.data(), 1, size, ifp);
+  // Restore position: ljpeg_start() fallback and derror() expect it
+  fseek(ifp, offset, SEEK_SET);
+  return readed == size;
+}
+
 void LibRaw::lossless_jpeg_load_raw()
 {
-  int jwide, jhigh, jrow, jcol, val, jidx, i, j, row = 0, col = 0;
+  int jwide, jrow, jcol, val, row = 0, col = 0;
   struct jhead jh;
   ushort *rp;
+  std::vector<uchar> jbuf;
+  LibRaw_LjpegRowDecoder *rdec = 0;
+  unsigned rerrors = 0;
 
-  if (!ljpeg_start(&jh, 0))
-    return;
+  if (!(imgdata.rawparams.options & LIBRAW_RAWOPTIONS_LJPEG_LEGACY_DECODER) &&
+      (!dng_version || dng_version >= 0x1010000) &&
+      ljpeg_read_data(jbuf, ftell(ifp), data_size))
+  {
+    rdec = new LibRaw_LjpegRowDecoder(jbuf.data(), unsigned(jbuf.size() - 4));
+    if (!rdec->valid())
+    {
+      delete rdec;
+      rdec = 0;
+    }
+  }
 
-  if (jh.wide < 1 || jh.high < 1 || jh.clrs < 1 || jh.bits < 1)
-    throw LIBRAW_EXCEPTION_IO_CORRUPT;
+  if (rdec)
+  {
+    memset(&jh, 0, sizeof(jh));
+    jh.wide = rdec->jpeg_width();
+    jh.high = rdec->jpeg_height();
+    jh.clrs = rdec->components();
+    jh.bits = rdec->bits();
+  }
+  else if (!ljpeg_start(&jh, 0))
+    return;
 
-  if(cr2_slice[0] && !cr2_slice[1])
+  if (jh.wide < 1 || jh.high < 1 || jh.clrs < 1 || jh.bits < 1 ||
+      (cr2_slice[0] && !cr2_slice[1]))
+  {
+    if (rdec)
+      delete rdec;
+    else
+      ljpeg_end(&jh);
     throw LIBRAW_EXCEPTION_IO_CORRUPT;
+  }
 
   jwide = jh.wide * jh.clrs;
-  jhigh = jh.high;
-  if (jh.clrs == 4 && jwide >= raw_width * 2)
-    jhigh *= 2;
 
-  
+  /* CR2 slices: incremental form of
+       i = jidx / (cr2_slice[1] * raw_height), clipped to cr2_slice[0]
+       row = (jidx - i * slicesize) / cr2_slice[1 + (i >= cr2_slice[0])]
+       col = ... % cr2_slice[1 + (i >= cr2_slice[0])] + i * cr2_slice[1]
+     (jidx = jrow * jwide + jcol) to avoid two divisions per pixel */
+  const INT64 slicesize = INT64(cr2_slice[1]) * INT64(raw_height);
+  INT64 srem = 0;
+  int slice = 0, slast = 0, swidth = cr2_slice[1], srow = 0, scol = 0;
+
   try
   {
     for (jrow = 0; jrow < jh.high; jrow++)
     {
       checkCancel();
-      rp = ljpeg_row(jrow, &jh);
+      if (rdec)
+      {
+        if (!(rp = rdec->next_row()))
+          throw LIBRAW_EXCEPTION_IO_CORRUPT;
+        for (; rerrors < rdec->errors(); rerrors++)
+          derror();
+      }
+      else
+        rp = ljpeg_row(jrow, &jh);
       if (load_flags & 1)
         row = jrow & 1 ? height - 1 - jrow / 2 : jrow / 2;
       for (jcol = 0; jcol < jwide; jcol++)
@@ -574,16 +630,25 @@ void LibRaw::lossless_jpeg_load_raw()
         val = curve[*rp++];
         if (cr2_slice[0])
         {
-          jidx = jrow * jwide + jcol;
-          i = jidx / (cr2_slice[1] * raw_height);
-          if ((j = i >= cr2_slice[0]))
-            i = cr2_slice[0];
-		  if(!cr2_slice[1+j])
+          if (!swidth)
             throw LIBRAW_EXCEPTION_IO_CORRUPT;
-
-          jidx -= i * (cr2_slice[1] * raw_height);
-          row = jidx / cr2_slice[1 + j];
-          col = jidx % cr2_slice[1 + j] + i * cr2_slice[1];
+          row = srow;
+          col = scol + slice * cr2_slice[1];
+          if (!slast && ++srem == slicesize)
+          {
+            srem = srow = scol = 0;
+            if (++slice >= cr2_slice[0])
+            {
+              slice = cr2_slice[0];
+              slast = 1;
+              swidth = cr2_slice[2];
+            }
+          }
+          else if (++scol >= swidth)
+          {
+            scol = 0;
+            srow++;
+          }
         }
         if (raw_width == 3984 && (col -= 2) < 0)
           col += (row--, raw_width);
@@ -598,10 +663,16 @@ void LibRaw::lossless_jpeg_load_raw()
   }
   catch (...)
   {
-    ljpeg_end(&jh);
+    if (rdec)
+      delete rdec;
+    else
+      ljpeg_end(&jh);
     throw;
   }
-  ljpeg_end(&jh);
+  if (rdec)
+    delete rdec;
+  else
+    ljpeg_end(&jh);
 }
 
 void LibRaw::canon_sraw_load_raw()
@@ -1103,56 +1174,11 @@ unsigned LibRaw::pana_data(int nb, unsigned *bytes)
 void LibRaw::panasonic_load_raw()
 {
   int row, col, i, j, sh = 0, pred[2], nonz[2];
-  unsigned bytes[16];
-  memset(bytes,0,sizeof(bytes)); // make gcc11 happy
-  ushort *raw_block_data;
 
   pana_data(0, 0);
 
-  int enc_blck_size = pana_bpp == 12 ? 10 : 9;
   if (pana_encoding == 5)
-  {
-    for (row = 0; row < raw_height; row++)
-    {
-      raw_block_data = raw_image + row * raw_width;
-      checkCancel();
-      for (col = 0; col < raw_width; col += enc_blck_size)
-      {
-        pana_data(0, bytes);
-
-        if (pana_bpp == 12)
-        {
-          raw_block_data[col] = ((bytes[1] & 0xF) << 8) + bytes[0];
-          raw_block_data[col + 1] = 16 * bytes[2] + (bytes[1] >> 4);
-          raw_block_data[col + 2] = ((bytes[4] & 0xF) << 8) + bytes[3];
-          raw_block_data[col + 3] = 16 * bytes[5] + (bytes[4] >> 4);
-          raw_block_data[col + 4] = ((bytes[7] & 0xF) << 8) + bytes[6];
-          raw_block_data[col + 5] = 16 * bytes[8] + (bytes[7] >> 4);
-          raw_block_data[col + 6] = ((bytes[10] & 0xF) << 8) + bytes[9];
-          raw_block_data[col + 7] = 16 * bytes[11] + (bytes[10] >> 4);
-          raw_block_data[col + 8] = ((bytes[13] & 0xF) << 8) + bytes[12];
-          raw_block_data[col + 9] = 16 * bytes[14] + (bytes[13] >> 4);
-        }
-        else if (pana_bpp == 14)
-        {
-          raw_block_data[col] = bytes[0] + ((bytes[1] & 0x3F) << 8);
-          raw_block_data[col + 1] =
-              (bytes[1] >> 6) + 4 * (bytes[2]) + ((bytes[3] & 0xF) << 10);
-          raw_block_data[col + 2] =
-              (bytes[3] >> 4) + 16 * (bytes[4]) + ((bytes[5] & 3) << 12);
-          raw_block_data[col + 3] = ((bytes[5] & 0xFC) >> 2) + (bytes[6] << 6);
-          raw_block_data[col + 4] = bytes[7] + ((bytes[8] & 0x3F) << 8);
-          raw_block_data[col + 5] =
-              (bytes[8] >> 6) + 4 * bytes[9] + ((bytes[10] & 0xF) << 10);
-          raw_block_data[col + 6] =
-              (bytes[10] >> 4) + 16 * bytes[11] + ((bytes[12] & 3) << 12);
-          raw_block_data[col + 7] =
-              ((bytes[12] & 0xFC) >> 2) + (bytes[13] << 6);
-          raw_block_data[col + 8] = bytes[14] + ((bytes[15] & 0x3F) << 8);
-        }
-      }
-    }
-  }
+    panasonicC5_load_raw();
   else
   {
 	if (load_flags >= 0x4000)
@@ -1383,119 +1409,222 @@ void LibRaw::sony_arw_load_raw()
   }
 }
 
-void LibRaw::sony_arw2_load_raw()
+/* Decodes one row of plain (no LIBRAW_RAWSPECIAL_SONYARW2_* flags)
+   little-endian ARW2 data. Each 16-byte block holds 11-bit max and min,
+   4-bit positions of both and 7-bit deltas at fixed bit offsets, so the
+   deltas are shifted out of two 64-bit words without per-pixel branches.
+   Bytes past the end of the row read as zero, as in
+   sony_arw2_decode_row() */
+LIBRAW_SIMD_CLONES
+static void sony_arw2_plain_row(const uchar *data, int row_bytes, ushort *dst,
+                                const ushort *tone)
 {
-  uchar *data, *dp;
+  const uchar *end = data + row_bytes;
+  const uchar *dp = data;
+  for (int col = 0; col < row_bytes - 30; dp += 16)
+  {
+    UINT64 lo = 0, hi = 0;
+    for (int i = 7; i >= 0; i--)
+    {
+      lo = lo << 8 | dp[i];
+      hi = hi << 8 | dp[8 + i];
+    }
+    const unsigned val = unsigned(lo);
+    const int max = 0x7ff & val;
+    const int min = 0x7ff & val >> 11;
+    const int imax = 0x0f & val >> 22;
+    const int imin = 0x0f & val >> 26;
+    int sh;
+    for (sh = 0; sh < 4 && 0x80 << sh <= max - min; sh++)
+      ;
+    // fifteenth delta is only used if imax == imin, it starts the next block
+    ushort delta[15];
+    for (int j = 0; j < 14; j++)
+    {
+      const int bit = 30 + 7 * j;
+      const int d = int((bit < 64 ? lo >> bit | hi << (64 - bit) : hi >> (bit - 64)) & 0x7f);
+      const int v = (d << sh) + min;
+      delta[j] = ushort(v > 0x7ff ? 0x7ff : v);
+    }
+    const int v = (((dp + 16 < end ? dp[16] : 0) & 0x7f) << sh) + min;
+    delta[14] = ushort(v > 0x7ff ? 0x7ff : v);
+
+    for (int i = 0, k = 0; i < 16; i++, col += 2)
+      dst[col] = tone[(i == imax ? max : i == imin ? min : delta[k++]) << 1];
+    col -= col & 1 ? 1 : 31;
+  }
+}
+
+void LibRaw::sony_arw2_decode_row(const uchar *data, int row)
+{
+  uchar *dp, *bp;
+  uchar tail[18];
   ushort pix[16];
-  int row, col, val, max, min, imax, imin, sh, bit, i;
+  int col, val, max, min, imax, imin, sh, bit, i;
 
-  data = (uchar *)calloc(raw_width + 1,1);
-  try
+  if (!(imgdata.rawparams.specials & LIBRAW_RAWSPECIAL_SONYARW2_ALLFLAGS) &&
+      order == 0x4949)
   {
-    for (row = 0; row < height; row++)
+    sony_arw2_plain_row(data, raw_width, &RAW(row, 0), curve);
+    return;
+  }
+
+  for (dp = (uchar *)data, col = 0; col < raw_width - 30; dp += 16)
+  {
+    /* deltas may be read up to two bytes past the block: the last block
+       of the row sees zeroes there */
+    bp = dp;
+    if (dp + 18 > data + raw_width)
     {
-      checkCancel();
-      fread(data, 1, raw_width, ifp);
-      for (dp = data, col = 0; col < raw_width - 30; dp += 16)
-      {
-        max = 0x7ff & (val = sget4(dp));
-        min = 0x7ff & val >> 11;
-        imax = 0x0f & val >> 22;
-        imin = 0x0f & val >> 26;
-        for (sh = 0; sh < 4 && 0x80 << sh <= max - min; sh++)
-          ;
-        /* flag checks if outside of loop */
-        if (!(imgdata.rawparams.specials & LIBRAW_RAWSPECIAL_SONYARW2_ALLFLAGS) // no flag set
-            || (imgdata.rawparams.specials & LIBRAW_RAWSPECIAL_SONYARW2_DELTATOVALUE))
-        {
-          for (bit = 30, i = 0; i < 16; i++)
-            if (i == imax)
-              pix[i] = max;
-            else if (i == imin)
-              pix[i] = min;
-            else
-            {
-              pix[i] =
-                  ((sget2(dp + (bit >> 3)) >> (bit & 7) & 0x7f) << sh) + min;
-              if (pix[i] > 0x7ff)
-                pix[i] = 0x7ff;
-              bit += 7;
-            }
-        }
-        else if (imgdata.rawparams.specials & LIBRAW_RAWSPECIAL_SONYARW2_BASEONLY)
+      memset(tail, 0, sizeof(tail));
+      memcpy(tail, dp, data + raw_width - dp);
+      bp = tail;
+    }
+    max = 0x7ff & (val = sget4(bp));
+    min = 0x7ff & val >> 11;
+    imax = 0x0f & val >> 22;
+    imin = 0x0f & val >> 26;
+    for (sh = 0; sh < 4 && 0x80 << sh <= max - min; sh++)
+      ;
+    /* flag checks if outside of loop */
+    if (!(imgdata.rawparams.specials & LIBRAW_RAWSPECIAL_SONYARW2_ALLFLAGS) // no flag set
+        || (imgdata.rawparams.specials & LIBRAW_RAWSPECIAL_SONYARW2_DELTATOVALUE))
+    {
+      for (bit = 30, i = 0; i < 16; i++)
+        if (i == imax)
+          pix[i] = max;
+        else if (i == imin)
+          pix[i] = min;
+        else
         {
-          for (bit = 30, i = 0; i < 16; i++)
-            if (i == imax)
-              pix[i] = max;
-            else if (i == imin)
-              pix[i] = min;
-            else
-              pix[i] = 0;
+          pix[i] =
+              ((sget2(bp + (bit >> 3)) >> (bit & 7) & 0x7f) << sh) + min;
+          if (pix[i] > 0x7ff)
+            pix[i] = 0x7ff;
+          bit += 7;
         }
-        else if (imgdata.rawparams.specials & LIBRAW_RAWSPECIAL_SONYARW2_DELTAONLY)
+    }
+    else if (imgdata.rawparams.specials & LIBRAW_RAWSPECIAL_SONYARW2_BASEONLY)
+    {
+      for (bit = 30, i = 0; i < 16; i++)
+        if (i == imax)
+          pix[i] = max;
+        else if (i == imin)
+          pix[i] = min;
+        else
+          pix[i] = 0;
+    }
+    else if (imgdata.rawparams.specials & LIBRAW_RAWSPECIAL_SONYARW2_DELTAONLY)
+    {
+      for (bit = 30, i = 0; i < 16; i++)
+        if (i == imax)
+          pix[i] = 0;
+        else if (i == imin)
+          pix[i] = 0;
+        else
         {
-          for (bit = 30, i = 0; i < 16; i++)
-            if (i == imax)
-              pix[i] = 0;
-            else if (i == imin)
-              pix[i] = 0;
-            else
-            {
-              pix[i] =
-                  ((sget2(dp + (bit >> 3)) >> (bit & 7) & 0x7f) << sh) + min;
-              if (pix[i] > 0x7ff)
-                pix[i] = 0x7ff;
-              bit += 7;
-            }
+          pix[i] =
+              ((sget2(bp + (bit >> 3)) >> (bit & 7) & 0x7f) << sh) + min;
+          if (pix[i] > 0x7ff)
+            pix[i] = 0x7ff;
+          bit += 7;
         }
-        else if (imgdata.rawparams.specials & LIBRAW_RAWSPECIAL_SONYARW2_DELTAZEROBASE)
+    }
+    else if (imgdata.rawparams.specials & LIBRAW_RAWSPECIAL_SONYARW2_DELTAZEROBASE)
+    {
+      for (bit = 30, i = 0; i < 16; i++)
+        if (i == imax)
+          pix[i] = 0;
+        else if (i == imin)
+          pix[i] = 0;
+        else
         {
-          for (bit = 30, i = 0; i < 16; i++)
-            if (i == imax)
-              pix[i] = 0;
-            else if (i == imin)
-              pix[i] = 0;
-            else
-            {
-              pix[i] = ((sget2(dp + (bit >> 3)) >> (bit & 7) & 0x7f) << sh);
-              if (pix[i] > 0x7ff)
-                pix[i] = 0x7ff;
-              bit += 7;
-            }
+          pix[i] = ((sget2(bp + (bit >> 3)) >> (bit & 7) & 0x7f) << sh);
+          if (pix[i] > 0x7ff)
+            pix[i] = 0x7ff;
+          bit += 7;
         }
+    }
 
-        if (imgdata.rawparams.specials & LIBRAW_RAWSPECIAL_SONYARW2_DELTATOVALUE)
-        {
-          for (i = 0; i < 16; i++, col += 2)
-          {
-            unsigned slope =
-                pix[i] < 1001 ? 2
-                              : curve[pix[i] << 1] - curve[(pix[i] << 1) - 2];
-            unsigned step = 1 << sh;
-            RAW(row, col) =
-                curve[pix[i] << 1] >
-                        black + imgdata.rawparams.sony_arw2_posterization_thr
-                    ? LIM(((slope * step * 1000) /
-                           (curve[pix[i] << 1] - black)),
-                          0, 10000)
-                    : 0;
-          }
-        }
-        else
-          for (i = 0; i < 16; i++, col += 2)
-            RAW(row, col) = curve[pix[i] << 1];
-        col -= col & 1 ? 1 : 31;
+    if (imgdata.rawparams.specials & LIBRAW_RAWSPECIAL_SONYARW2_DELTATOVALUE)
+    {
+      for (i = 0; i < 16; i++, col += 2)
+      {
+        unsigned slope =
+            pix[i] < 1001 ? 2
+                          : curve[pix[i] << 1] - curve[(pix[i] << 1) - 2];
+        unsigned step = 1 << sh;
+        RAW(row, col) =
+            curve[pix[i] << 1] >
+                    black + imgdata.rawparams.sony_arw2_posterization_thr
+                ? LIM(((slope * step * 1000) /
+                       (curve[pix[i] << 1] - black)),
+                      0, 10000)
+                : 0;
       }
     }
+    else
+      for (i = 0; i < 16; i++, col += 2)
+        RAW(row, col) = curve[pix[i] << 1];
+    col -= col & 1 ? 1 : 31;
   }
-  catch (...)
+}
+
+void LibRaw::sony_arw2_decode_loop(const uchar *data, int first, int count)
+{
+  parallel_for(count, [&](int row, int) {
+    if ((row & 63) == 0)
+      checkCancel();
+    sony_arw2_decode_row(data + size_t(row) * raw_width, first + row);
+  });
+}
+
+void LibRaw::sony_arw2_load_raw()
+{
+  /* Rows are raw_width bytes each: in-memory streams are decoded in
+     place, others are read in bands of rows */
+  const INT64 strip = INT64(raw_width) * height;
+  const INT64 start = ftell(ifp);
+  if (const uchar *span = libraw_internal_data.internal_data.input->get_span(start, strip))
+  {
+    fseek(ifp, start + strip, SEEK_SET);
+    sony_arw2_decode_loop(span, 0, height);
+  }
+  else
   {
+    const int band = MAX(1, MIN(int(height), (16 << 20) / MAX(1, int(raw_width))));
+    uchar *data = (uchar *)calloc(size_t(band + 1) * raw_width, 1);
+    uchar *last = data + size_t(band) * raw_width; // previous row
+    try
+    {
+      for (int row = 0; row < height; row += band)
+      {
+        const int rows = MIN(band, int(height) - row);
+        const size_t bytes = size_t(rows) * raw_width;
+        const size_t got = fread(data, 1, bytes, ifp);
+        if (got < bytes)
+        {
+          /* short read: a row keeps what the row buffer held before, so
+             rows past the end of file repeat the last (partial) row */
+          const size_t full = got / raw_width, part = got % raw_width;
+          uchar *r = data + full * raw_width;
+          memcpy(r + part, (full ? r - raw_width : last) + part, raw_width - part);
+          for (size_t k = full + 1; k < size_t(rows); k++)
+            memcpy(data + k * raw_width, r, raw_width);
+        }
+        memcpy(last, data + (rows - 1) * size_t(raw_width), raw_width);
+        sony_arw2_decode_loop(data, row, rows);
+      }
+    }
+    catch (...)
+    {
+      free(data);
+      throw;
+    }
     free(data);
-    throw;
   }
   if (imgdata.rawparams.specials & LIBRAW_RAWSPECIAL_SONYARW2_DELTATOVALUE)
     maximum = 10000;
-  free(data);
 }
 
 void LibRaw::samsung_load_raw()
@@ -16,6 +16,7 @@
  */
 
 #include "../../internal/libraw_cxx_defs.h"
+#include "../../internal/libraw_unpack.h"
 #include <vector>
 #include <algorithm> // for std::sort
 
@@ -157,77 +158,14 @@ void LibRaw::hasselblad_full_load_raw()
     }
 }
 
-static inline void unpack7bytesto4x16(unsigned char *src, unsigned short *dest)
+/* Number of whole groups of group bytes (or pixels) within limit, as
+   counted by the serial unpacking loops: their limit - (group - 1) bound
+   wraps around, and so does not apply, when limit is smaller */
+static inline unsigned serial_groups(unsigned limit, unsigned group)
 {
-  dest[0] = (src[0] << 6) | (src[1] >> 2);
-  dest[1] = ((src[1] & 0x3) << 12) | (src[2] << 4) | (src[3] >> 4);
-  dest[2] = (src[3] & 0xf) << 10 | (src[4] << 2) | (src[5] >> 6);
-  dest[3] = ((src[5] & 0x3f) << 8) | src[6];
+  return limit < group - 1 ? UINT_MAX : limit / group;
 }
 
-static inline void unpack28bytesto16x16ns(unsigned char *src,
-                                          unsigned short *dest)
-{
-  dest[0] = (src[3] << 6) | (src[2] >> 2);
-  dest[1] = ((src[2] & 0x3) << 12) | (src[1] << 4) | (src[0] >> 4);
-  dest[2] = (src[0] & 0xf) << 10 | (src[7] << 2) | (src[6] >> 6);
-  dest[3] = ((src[6] & 0x3f) << 8) | src[5];
-  dest[4] = (src[4] << 6) | (src[11] >> 2);
-  dest[5] = ((src[11] & 0x3) << 12) | (src[10] << 4) | (src[9] >> 4);
-  dest[6] = (src[9] & 0xf) << 10 | (src[8] << 2) | (src[15] >> 6);
-  dest[7] = ((src[15] & 0x3f) << 8) | src[14];
-  dest[8] = (src[13] << 6) | (src[12] >> 2);
-  dest[9] = ((src[12] & 0x3) << 12) | (src[19] << 4) | (src[18] >> 4);
-  dest[10] = (src[18] & 0xf) << 10 | (src[17] << 2) | (src[16] >> 6);
-  dest[11] = ((src[16] & 0x3f) << 8) | src[23];
-  dest[12] = (src[22] << 6) | (src[21] >> 2);
-  dest[13] = ((src[21] & 0x3) << 12) | (src[20] << 4) | (src[27] >> 4);
-  dest[14] = (src[27] & 0xf) << 10 | (src[26] << 2) | (src[25] >> 6);
-  dest[15] = ((src[25] & 0x3f) << 8) | src[24];
-}
-
-#define swab32(x)                                                              \
-  ((unsigned int)((((unsigned int)(x) & (unsigned int)0x000000ffUL) << 24) |   \
-                  (((unsigned int)(x) & (unsigned int)0x0000ff00UL) << 8) |    \
-                  (((unsigned int)(x) & (unsigned int)0x00ff0000UL) >> 8) |    \
-                  (((unsigned int)(x) & (unsigned int)0xff000000UL) >> 24)))
-
-static inline void swab32arr(unsigned *arr, unsigned len)
-{
-  for (unsigned i = 0; i < len; i++)
-    arr[i] = swab32(arr[i]);
-}
-#undef swab32
-
-static inline void unpack7bytesto4x16_nikon(unsigned char *src,
-                                            unsigned short *dest)
-{
-  dest[3] = (src[6] << 6) | (src[5] >> 2);
-  dest[2] = ((src[5] & 0x3) << 12) | (src[4] << 4) | (src[3] >> 4);
-  dest[1] = (src[3] & 0xf) << 10 | (src[2] << 2) | (src[1] >> 6);
-  dest[0] = ((src[1] & 0x3f) << 8) | src[0];
-}
-
-static inline void unpack21bytesto12x16_nikon(unsigned char *src, unsigned short (*dest)[4])
-{
-	// bytes 0-6
-  dest[0][0] = ((src[1] & 0x3f) << 8) | src[0];
-  dest[0][1] = (src[3] & 0xf) << 10 | (src[2] << 2) | (src[1] >> 6);
-  dest[0][2] = ((src[5] & 0x3) << 12) | (src[4] << 4) | (src[3] >> 4);
-  dest[1][0] = (src[6] << 6) | (src[5] >> 2);
-  // bytes 7-13
-  dest[1][1] = ((src[8] & 0x3f) << 8) | src[7];
-  dest[1][2] = (src[10] & 0xf) << 10 | (src[9] << 2) | (src[8] >> 6);
-  dest[2][0] = ((src[12] & 0x3) << 12) | (src[11] << 4) | (src[10] >> 4);
-  dest[2][1] = (src[13] << 6) | (src[12] >> 2);
-  // bytes 14-20
-  dest[2][2] = ((src[15] & 0x3f) << 8) | src[14];
-  dest[3][0] = (src[17] & 0xf) << 10 | (src[16] << 2) | (src[15] >> 6);
-  dest[3][1] = ((src[19] & 0x3) << 12) | (src[18] << 4) | (src[17] >> 4);
-  dest[3][2] = (src[20] << 6) | (src[19] >> 2);
-}
-
-
 void LibRaw::nikon_14bit_load_raw()
 {
   int cps = (imgdata.idata.filters == 0 && imgdata.idata.colors == 3) ? 3 : 1;
@@ -241,59 +179,98 @@ void LibRaw::nikon_14bit_load_raw()
       (unsigned)(ceilf((float)(S.raw_width * cps * 7 / 4) / 16.0f)) *
       16; // 14512; // S.raw_width * 7 / 4;
   const unsigned pitch = S.raw_pitch ? S.raw_pitch /( (cps>=3)? 8 : 2) : S.raw_width;
-  unsigned char *buf = (unsigned char *)calloc(linelen,1);
+  const unsigned gsize = 7u * cps; // 4 pixels of 14-bit little endian samples
+  const unsigned max_groups =
+      MIN(serial_groups(pitch, 4), serial_groups(linelen, gsize));
+  if (max_groups > linelen)
+    return; // degenerate row sizes
+  std::vector<ushort> stage(cps == 3 ? size_t(12) * max_groups * parallel_workers() : 0);
+  auto unpack_row = [&](const uchar *src, int row, unsigned groups, int worker) {
+    const size_t pix = size_t(pitch) * row;
+    if (cps == 1)
+      libraw_unpack_le(src, linelen, &imgdata.rawdata.raw_image[pix],
+                       4 * groups, 14);
+    else
+    {
+      ushort *samples = &stage[size_t(12) * groups * worker];
+      libraw_unpack_le(src, linelen, samples, 12 * groups, 14);
+      ushort(*dest)[4] = &imgdata.image[pix];
+      for (unsigned p = 0; p < 4 * groups; p++)
+        for (int c = 0; c < 3; c++)
+          dest[p][c] = samples[3 * p + c];
+    }
+  };
+  const INT64 start = libraw_internal_data.internal_data.input->tell();
+  if (pitch >= 4 && linelen >= gsize &&
+      start + INT64(linelen) * S.raw_height <=
+          libraw_internal_data.internal_data.input->size())
+  {
+    uncompressed_bands(start, linelen, S.raw_height, [&](const uchar *data, int first, int rows) {
+      parallel_for(rows, [&](int r, int worker) {
+        unpack_row(data + size_t(r) * linelen, first + r, max_groups, worker);
+      });
+    });
+    return;
+  }
+  std::vector<uchar> buf(linelen);
   for (int row = 0; row < S.raw_height; row++)
   {
     unsigned bytesread =
-        libraw_internal_data.internal_data.input->read(buf, 1, linelen);
-	if (cps == 1)
-	{
-		unsigned short *dest = &imgdata.rawdata.raw_image[pitch * row];
-		// swab32arr((unsigned *)buf, bytesread / 4);
-		for (unsigned int sp = 0, dp = 0;
-			dp < pitch - 3 && sp < linelen - 6 && sp < bytesread - 6;
-			sp += 7, dp += 4)
-			unpack7bytesto4x16_nikon(buf + sp, dest + dp);
-	}
-	else if (cps == 3)
-	{
-      unsigned short (*dest)[4] = &imgdata.image[pitch * row];
-      // swab32arr((unsigned *)buf, bytesread / 4);
-      for (unsigned int sp = 0, dp = 0; 
-		  dp < pitch - 3 && sp < linelen - 20 && sp < bytesread - 20; 
-		  sp += 21, dp += 4)
-        unpack21bytesto12x16_nikon(buf + sp, dest + dp);
-	}
+        libraw_internal_data.internal_data.input->read(buf.data(), 1, linelen);
+    unpack_row(buf.data(), row, MIN(max_groups, serial_groups(bytesread, gsize)), 0);
   }
-  free(buf);
 }
 
 void LibRaw::fuji_14bit_load_raw()
 {
   const unsigned linelen = S.raw_width * 7 / 4;
   const unsigned pitch = S.raw_pitch ? S.raw_pitch / 2 : S.raw_width;
-  unsigned char *buf = (unsigned char *)calloc(linelen,1);
-
-  for (int row = 0; row < S.raw_height; row++)
-  {
-    unsigned bytesread =
-        libraw_internal_data.internal_data.input->read(buf, 1, linelen);
-    unsigned short *dest = &imgdata.rawdata.raw_image[pitch * row];
-    if (bytesread % 28)
+  const INT64 start = libraw_internal_data.internal_data.input->tell();
+  /* 14-bit samples in byte swapped 32-bit words, cut into groups of 7 bytes
+     or, if the row is a multiple of 28 bytes, of 28. Words are swapped into
+     buf7 or buf28 respectively: the serial loop swaps the 7-byte layout in
+     its read buffer, only as far as the bytes read */
+  auto unpack_row = [&](const uchar *src, unsigned bytes, int row, uchar *buf7,
+                        uchar *buf28) {
+    uchar *buf;
+    unsigned samples;
+    if (bytes % 28)
     {
-      swab32arr((unsigned *)buf, bytesread / 4);
-      for (unsigned int sp = 0, dp = 0;
-           dp < pitch - 3 && sp < linelen - 6 && sp < bytesread - 6;
-           sp += 7, dp += 4)
-        unpack7bytesto4x16(buf + sp, dest + dp);
+      libraw_swap_groups(src, buf = buf7, bytes, 4);
+      samples = 4 * MIN(MIN(serial_groups(pitch, 4), serial_groups(linelen, 7)),
+                        serial_groups(bytes, 7));
     }
     else
-      for (unsigned int sp = 0, dp = 0;
-           dp < pitch - 15 && sp < linelen - 27 && sp < bytesread - 27;
-           sp += 28, dp += 16)
-        unpack28bytesto16x16ns(buf + sp, dest + dp);
+    {
+      libraw_swap_groups(src, buf = buf28, linelen, 4);
+      samples =
+          16 * MIN(MIN(serial_groups(pitch, 16), serial_groups(linelen, 28)),
+                   serial_groups(bytes, 28));
+    }
+    libraw_unpack_be(buf, linelen,
+                     &imgdata.rawdata.raw_image[size_t(pitch) * row], samples,
+                     14);
+  };
+  if (pitch >= 16 && linelen >= 28 &&
+      start + INT64(linelen) * S.raw_height <=
+          libraw_internal_data.internal_data.input->size())
+  {
+    std::vector<uchar> stage(size_t(linelen) * parallel_workers());
+    uncompressed_bands(start, linelen, S.raw_height, [&](const uchar *data, int first, int rows) {
+      parallel_for(rows, [&](int r, int worker) {
+        uchar *buf = &stage[size_t(linelen) * worker];
+        unpack_row(data + size_t(r) * linelen, linelen, first + r, buf, buf);
+      });
+    });
+    return;
+  }
+  std::vector<uchar> buf(linelen), stage(linelen);
+  for (int row = 0; row < S.raw_height; row++)
+  {
+    unsigned bytesread =
+        libraw_internal_data.internal_data.input->read(buf.data(), 1, linelen);
+    unpack_row(buf.data(), bytesread, row, buf.data(), stage.data());
   }
-  free(buf);
 }
 void LibRaw::nikon_load_padded_packed_raw() // 12 bit per pixel, padded to 16
                                             // bytes
@@ -304,31 +281,41 @@ void LibRaw::nikon_load_padded_packed_raw() // 12 bit per pixel, padded to 16
   if (bytesperrow < 2000 || bytesperrow > 64000)
     throw LIBRAW_EXCEPTION_IO_CORRUPT;
 
-  unsigned char *buf =
-      (unsigned char *)calloc(bytesperrow,1);
+  auto unpack_row = [&](const uchar *src, int row) {
+    libraw_unpack_le(src, bytesperrow,
+                     &imgdata.rawdata.raw_image[size_t(row) * S.raw_width],
+                     S.raw_width / 2 * 2, 12);
+  };
+  const INT64 start = libraw_internal_data.internal_data.input->tell();
+  if (start + INT64(bytesperrow) * S.raw_height <=
+      libraw_internal_data.internal_data.input->size())
+  {
+    uncompressed_bands(start, bytesperrow, S.raw_height, [&](const uchar *data, int first, int rows) {
+      parallel_for(rows, [&](int r, int) {
+        checkCancel();
+        unpack_row(data + size_t(r) * bytesperrow, first + r);
+      });
+    });
+    return;
+  }
+
+  std::vector<uchar> buf(bytesperrow);
   for (int row = 0; row < S.raw_height; row++)
   {
     checkCancel();
     int readed = libraw_internal_data.internal_data.input->read(
-        buf, 1, bytesperrow);
+        buf.data(), 1, bytesperrow);
 
 	if (readed < (int)bytesperrow)
 		derror();
 
-    for (int icol = 0; icol < S.raw_width / 2; icol++)
-    {
-      imgdata.rawdata.raw_image[(row)*S.raw_width + (icol * 2)] =
-          ((buf[icol * 3 + 1] & 0xf) << 8) | buf[icol * 3];
-      imgdata.rawdata.raw_image[(row)*S.raw_width + (icol * 2 + 1)] =
-          buf[icol * 3 + 2] << 4 | ((buf[icol * 3 + 1] & 0xf0) >> 4);
-    }
+    unpack_row(buf.data(), row);
   }
-  free(buf);
 }
 
 void LibRaw::nikon_load_striped_packed_raw()
 {
-  int vbits = 0, bwide, rbits, bite, row, col, i;
+  int vbits = 0, bwide, rbits, bite, row;
 
   UINT64 bitbuf = 0;
   unsigned load_flags = 24; // libraw_internal_data.unpacker_data.load_flags;
@@ -351,6 +338,37 @@ void LibRaw::nikon_load_striped_packed_raw()
   if (load_flags & 1)
     bwide = bwide * 16 / 15;
   bite = 8 + (load_flags & 24);
+
+  /* Rows filling whole 32-bit words start each strip afresh: if all the
+     strips are there, unpack them row-parallel */
+  const int rps = ifd->rows_per_strip;
+  const int strips = rps > 0 ? MIN(ifd->strip_offsets_count,
+                                   (S.raw_height + rps - 1) / rps)
+                             : 0;
+  bool whole = tiff_bps >= 1 && tiff_bps <= 16 && rps > 0 &&
+               (S.raw_width * tiff_bps) % bite == 0;
+  for (int s = 0; whole && s < strips; s++)
+    whole = ifd->strip_offsets[s] >= 0 &&
+            ifd->strip_offsets[s] +
+                    INT64(bwide) * MIN(rps, S.raw_height - s * rps) <=
+                libraw_internal_data.internal_data.input->size();
+  if (whole)
+  {
+    std::vector<uchar> stage(size_t(bwide) * parallel_workers());
+    for (int s = 0; s < strips; s++)
+      uncompressed_bands(ifd->strip_offsets[s], bwide, MIN(rps, S.raw_height - s * rps),
+                         [&](const uchar *data, int first, int rows) {
+        parallel_for(rows, [&](int r, int worker) {
+          uchar *buf = &stage[size_t(bwide) * worker];
+          checkCancel();
+          libraw_swap_groups(data + size_t(r) * bwide, buf, bwide, bite >> 3);
+          libraw_unpack_be(buf, bwide,
+                           &imgdata.rawdata.raw_image[size_t(s * rps + first + r) * S.raw_width],
+                           S.raw_width, tiff_bps);
+        });
+      });
+    return;
+  }
   for (row = 0; row < S.raw_height; row++)
   {
     checkCancel();
@@ -362,19 +380,7 @@ void LibRaw::nikon_load_striped_packed_raw()
           ifd->strip_offsets[stripcnt], SEEK_SET);
       stripcnt++;
     }
-    for (col = 0; col < S.raw_width; col++)
-    {
-      for (vbits -= tiff_bps; vbits < 0; vbits += bite)
-      {
-        bitbuf <<= bite;
-        for (i = 0; i < bite; i += 8)
-          bitbuf |=
-              (unsigned)(libraw_internal_data.internal_data.input->get_char()
-                         << i);
-      }
-      imgdata.rawdata.raw_image[(row)*S.raw_width + (col)] =
-          ushort((bitbuf << (64 - tiff_bps - vbits) >> (64 - tiff_bps)) & 0xffff);
-    }
+    packed_bits_row(row, bite, load_flags, bitbuf, vbits);
     vbits -= rbits;
   }
 }
@@ -449,148 +455,347 @@ void pana_cs6_page_decoder::read_page12()
   lastoffset += 16;
 }
 
-void LibRaw::panasonicC6_load_raw()
+/* Panasonic encodings 5, 6 and 7 store pixels in 16-byte blocks with
+   fixed pixel positions, so pages (5) and rows (6, 7) decode on their own */
+struct panasonic_strip_t
 {
-  const int rowstep = 16;
-  const bool _12bit = libraw_internal_data.unpacker_data.pana_bpp == 12;
-  const int pixperblock =  _12bit ? 14 : 11;
-  const int blocksperrow = imgdata.sizes.raw_width / pixperblock;
-  const int rowbytes = blocksperrow * 16;
+  const uchar *data; // pages or rows of this band
+  int first;         // page or row number of data[0]
+  int unit_bytes;    // page or row size
+  int rotation;      // encoding 5: offset of page byte 0 in data
+};
+
+static void panasonicC5_decode_block(const uchar *bytes, ushort *pix, int bpp)
+{
+  if (bpp == 12)
+  {
+    pix[0] = ((bytes[1] & 0xF) << 8) + bytes[0];
+    pix[1] = 16 * bytes[2] + (bytes[1] >> 4);
+    pix[2] = ((bytes[4] & 0xF) << 8) + bytes[3];
+    pix[3] = 16 * bytes[5] + (bytes[4] >> 4);
+    pix[4] = ((bytes[7] & 0xF) << 8) + bytes[6];
+    pix[5] = 16 * bytes[8] + (bytes[7] >> 4);
+    pix[6] = ((bytes[10] & 0xF) << 8) + bytes[9];
+    pix[7] = 16 * bytes[11] + (bytes[10] >> 4);
+    pix[8] = ((bytes[13] & 0xF) << 8) + bytes[12];
+    pix[9] = 16 * bytes[14] + (bytes[13] >> 4);
+  }
+  else if (bpp == 14)
+  {
+    pix[0] = bytes[0] + ((bytes[1] & 0x3F) << 8);
+    pix[1] = (bytes[1] >> 6) + 4 * (bytes[2]) + ((bytes[3] & 0xF) << 10);
+    pix[2] = (bytes[3] >> 4) + 16 * (bytes[4]) + ((bytes[5] & 3) << 12);
+    pix[3] = ((bytes[5] & 0xFC) >> 2) + (bytes[6] << 6);
+    pix[4] = bytes[7] + ((bytes[8] & 0x3F) << 8);
+    pix[5] = (bytes[8] >> 6) + 4 * bytes[9] + ((bytes[10] & 0xF) << 10);
+    pix[6] = (bytes[10] >> 4) + 16 * bytes[11] + ((bytes[12] & 3) << 12);
+    pix[7] = ((bytes[12] & 0xFC) >> 2) + (bytes[13] << 6);
+    pix[8] = bytes[14] + ((bytes[15] & 0x3F) << 8);
+  }
+}
+
+/* One 0x4000-byte page holds 1024 blocks; blocks run through the image
+   row by row, the last block of a row is cut at raw_width */
+static void panasonicC5_decode_page(const uchar *page, int rotation,
+                                    INT64 page_no, ushort *raw, int row_pixels,
+                                    int rows, int bpp)
+{
+  const int blck = bpp == 12 ? 10 : 9;
+  const INT64 blocks_per_row = (row_pixels + blck - 1) / blck;
+  uchar bytes[16];
+  ushort pix[10] = {0};
+  if (bpp != 12 && bpp != 14)
+    return;
+  for (int i = 0; i < 1024; i++)
+  {
+    const INT64 block = page_no * 1024 + i;
+    const INT64 row = block / blocks_per_row;
+    if (row >= rows)
+      break;
+    const int col = int(block % blocks_per_row) * blck;
+    const int off = (i * 16 - rotation) & 0x3FFF;
+    const uchar *src = page + off;
+    if (off > 0x4000 - 16)
+    {
+      for (int k = 0; k < 16; k++)
+        bytes[k] = page[(off + k) & 0x3FFF];
+      src = bytes;
+    }
+    ushort *dst = raw + row * row_pixels + col;
+    if (col + blck <= row_pixels)
+      panasonicC5_decode_block(src, dst, bpp);
+    else
+    {
+      panasonicC5_decode_block(src, pix, bpp);
+      memcpy(dst, pix, (row_pixels - col) * sizeof(ushort));
+    }
+  }
+}
+
+static void panasonicC6_decode_row(const uchar *bytes, int rowbytes,
+                                   ushort *rowptr, int bpp)
+{
+  const bool _12bit = bpp == 12;
+  const int pixperblock = _12bit ? 14 : 11;
+  const int blocksperrow = rowbytes / 16;
   const unsigned pixelbase0 = _12bit ? 0x80 : 0x200;
   const unsigned pixelbase_compare = _12bit ? 0x800 : 0x2000;
   const unsigned spix_compare = _12bit ? 0x3fff : 0xffff;
   const unsigned pixel_mask = _12bit ? 0xfff : 0x3fff;
-  std::vector<unsigned char> iobuf;
-  try
+  pana_cs6_page_decoder page((unsigned char *)bytes, rowbytes);
+  int col = 0;
+  for (int rblock = 0; rblock < blocksperrow; rblock++)
   {
-      iobuf.resize(rowbytes * rowstep);
+    if (_12bit)
+      page.read_page12();
+    else
+      page.read_page();
+    unsigned oddeven[2] = {0, 0}, nonzero[2] = {0, 0};
+    unsigned pmul = 0, pixel_base = 0;
+    for (int pix = 0; pix < pixperblock; pix++)
+    {
+      if (pix % 3 == 2)
+      {
+        unsigned base = _12bit ? page.nextpixel12() : page.nextpixel();
+        if (base > 3)
+          throw LIBRAW_EXCEPTION_IO_CORRUPT; // not possible b/c of 2-bit
+                                             // field, but....
+        if (base == 3)
+          base = 4;
+        pixel_base = pixelbase0 << base;
+        pmul = 1 << base;
+      }
+      unsigned epixel = _12bit ? page.nextpixel12() : page.nextpixel();
+      if (oddeven[pix % 2])
+      {
+        epixel *= pmul;
+        if (pixel_base < pixelbase_compare && nonzero[pix % 2] > pixel_base)
+          epixel += nonzero[pix % 2] - pixel_base;
+        nonzero[pix % 2] = epixel;
+      }
+      else
+      {
+        oddeven[pix % 2] = epixel;
+        if (epixel)
+          nonzero[pix % 2] = epixel;
+        else
+          epixel = nonzero[pix % 2];
+      }
+      unsigned spix = epixel - 0xf;
+      if (spix <= spix_compare)
+        rowptr[col++] = spix & spix_compare;
+      else
+      {
+        epixel = (((signed int)(epixel + 0x7ffffff1)) >> 0x1f);
+        rowptr[col++] = epixel & pixel_mask;
+      }
+    }
   }
-  catch (...)
+}
+
+static void panasonicC7_decode_row(const uchar *bytes, ushort *rowptr,
+                                   int row_pixels, int bpp)
+{
+  const int pixperblock = bpp == 14 ? 9 : 10;
+  for (int col = 0; col < row_pixels - pixperblock + 1;
+       col += pixperblock, bytes += 16)
   {
-    throw LIBRAW_EXCEPTION_ALLOC;
+    if (bpp == 14)
+    {
+      rowptr[col] = bytes[0] + ((bytes[1] & 0x3F) << 8);
+      rowptr[col + 1] =
+          (bytes[1] >> 6) + 4 * (bytes[2]) + ((bytes[3] & 0xF) << 10);
+      rowptr[col + 2] =
+          (bytes[3] >> 4) + 16 * (bytes[4]) + ((bytes[5] & 3) << 12);
+      rowptr[col + 3] = ((bytes[5] & 0xFC) >> 2) + (bytes[6] << 6);
+      rowptr[col + 4] = bytes[7] + ((bytes[8] & 0x3F) << 8);
+      rowptr[col + 5] =
+          (bytes[8] >> 6) + 4 * bytes[9] + ((bytes[10] & 0xF) << 10);
+      rowptr[col + 6] =
+          (bytes[10] >> 4) + 16 * bytes[11] + ((bytes[12] & 3) << 12);
+      rowptr[col + 7] = ((bytes[12] & 0xFC) >> 2) + (bytes[13] << 6);
+      rowptr[col + 8] = bytes[14] + ((bytes[15] & 0x3F) << 8);
+    }
+    else if (bpp == 12) // have not seen in the wild yet
+    {
+      rowptr[col] = ((bytes[1] & 0xF) << 8) + bytes[0];
+      rowptr[col + 1] = 16 * bytes[2] + (bytes[1] >> 4);
+      rowptr[col + 2] = ((bytes[4] & 0xF) << 8) + bytes[3];
+      rowptr[col + 3] = 16 * bytes[5] + (bytes[4] >> 4);
+      rowptr[col + 4] = ((bytes[7] & 0xF) << 8) + bytes[6];
+      rowptr[col + 5] = 16 * bytes[8] + (bytes[7] >> 4);
+      rowptr[col + 6] = ((bytes[10] & 0xF) << 8) + bytes[9];
+      rowptr[col + 7] = 16 * bytes[11] + (bytes[10] >> 4);
+      rowptr[col + 8] = ((bytes[13] & 0xF) << 8) + bytes[12];
+      rowptr[col + 9] = 16 * bytes[14] + (bytes[13] >> 4);
+    }
   }
+}
+
+void LibRaw::panasonic_decode_loop(void *data, int count)
+{
+  parallel_for(count, [&](int unit, int) { panasonic_decode_unit(data, unit); });
+}
 
-  for (int row = 0; row < imgdata.sizes.raw_height - rowstep + 1;
-       row += rowstep)
+void LibRaw::panasonic_decode_unit(void *data, int unit)
+{
+  const panasonic_strip_t *strip = (const panasonic_strip_t *)data;
+  const uchar *src = strip->data + size_t(unit) * strip->unit_bytes;
+  const int bpp = libraw_internal_data.unpacker_data.pana_bpp;
+  checkCancel();
+  if (libraw_internal_data.unpacker_data.pana_encoding == 5)
   {
-    int rowstoread = MIN(rowstep, imgdata.sizes.raw_height - row);
-    if (libraw_internal_data.internal_data.input->read(
-            iobuf.data(), rowbytes, rowstoread) != rowstoread)
-      throw LIBRAW_EXCEPTION_IO_EOF;
-    pana_cs6_page_decoder page(iobuf.data(), rowbytes * rowstoread);
-    for (int crow = 0, col = 0; crow < rowstoread; crow++, col = 0)
+    panasonicC5_decode_page(src, strip->rotation, INT64(strip->first) + unit,
+                            imgdata.rawdata.raw_image, imgdata.sizes.raw_width,
+                            imgdata.sizes.raw_height, bpp);
+    return;
+  }
+  ushort *rowptr =
+      &imgdata.rawdata.raw_image[size_t(strip->first + unit) *
+                                 imgdata.sizes.raw_pitch / 2];
+  if (libraw_internal_data.unpacker_data.pana_encoding == 6)
+    panasonicC6_decode_row(src, strip->unit_bytes, rowptr, bpp);
+  else
+    panasonicC7_decode_row(src, rowptr, imgdata.sizes.raw_width, bpp);
+}
+
+/* Encoding 5 pages are read as pana_data() does: the first
+   0x4000 - load_flags bytes go to page byte load_flags and up, and page
+   bytes not covered by a short read keep the previous page */
+void LibRaw::panasonicC5_load_raw()
+{
+  const int bpp = libraw_internal_data.unpacker_data.pana_bpp;
+  const int lf = int(libraw_internal_data.unpacker_data.load_flags);
+  const int blck = bpp == 12 ? 10 : 9;
+  if (imgdata.sizes.raw_width < 1 || imgdata.sizes.raw_height < 1)
+    return;
+  if (libraw_internal_data.unpacker_data.load_flags > 0x4000)
+    throw LIBRAW_EXCEPTION_IO_BADFILE;
+  const INT64 blocks_per_row = (imgdata.sizes.raw_width + blck - 1) / blck;
+  const int pages =
+      int((INT64(imgdata.sizes.raw_height) * blocks_per_row + 1023) / 1024);
+  panasonic_strip_t strip;
+  strip.unit_bytes = 0x4000;
+
+  const INT64 start = libraw_internal_data.internal_data.input->tell();
+  if (const uchar *span = libraw_internal_data.internal_data.input->get_span(
+          start, INT64(pages) * 0x4000))
+  {
+    libraw_internal_data.internal_data.input->seek(
+        start + INT64(pages) * 0x4000, SEEK_SET);
+    strip.data = span;
+    strip.first = 0;
+    strip.rotation = lf & 0x3FFF;
+    panasonic_decode_loop(&strip, pages);
+    return;
+  }
+
+  const int band = MIN(pages, 1024); // 16 MB
+  std::vector<uchar> buf(size_t(band + 1) * 0x4000, 0);
+  uchar *last = &buf[size_t(band) * 0x4000];
+  strip.data = buf.data();
+  strip.rotation = 0;
+  for (int first = 0; first < pages; first += band)
+  {
+    const int count = MIN(band, pages - first);
+    for (int p = 0; p < count; p++)
     {
-      unsigned short *rowptr =
-          &imgdata.rawdata
-               .raw_image[(row + crow) * imgdata.sizes.raw_pitch / 2];
-      for (int rblock = 0; rblock < blocksperrow; rblock++)
-      {
-          if (_12bit)
-              page.read_page12();
-          else
-              page.read_page();
-        unsigned oddeven[2] = {0, 0}, nonzero[2] = {0, 0};
-        unsigned pmul = 0, pixel_base = 0;
-        for (int pix = 0; pix < pixperblock; pix++)
-        {
-          if (pix % 3 == 2)
-          {
-            unsigned base = _12bit ? page.nextpixel12(): page.nextpixel();
-            if (base > 3)
-              throw LIBRAW_EXCEPTION_IO_CORRUPT; // not possible b/c of 2-bit
-                                                 // field, but....
-            if (base == 3)
-              base = 4;
-            pixel_base = pixelbase0 << base;
-            pmul = 1 << base;
-          }
-          unsigned epixel = _12bit ? page.nextpixel12() : page.nextpixel();
-          if (oddeven[pix % 2])
-          {
-            epixel *= pmul;
-            if (pixel_base < pixelbase_compare && nonzero[pix % 2] > pixel_base)
-              epixel += nonzero[pix % 2] - pixel_base;
-            nonzero[pix % 2] = epixel;
-          }
-          else
-          {
-            oddeven[pix % 2] = epixel;
-            if (epixel)
-              nonzero[pix % 2] = epixel;
-            else
-              epixel = nonzero[pix % 2];
-          }
-          unsigned spix = epixel - 0xf;
-          if (spix <= spix_compare)
-            rowptr[col++] = spix & spix_compare;
-          else
-          {
-            epixel = (((signed int)(epixel + 0x7ffffff1)) >> 0x1f);
-            rowptr[col++] = epixel & pixel_mask;
-          }
-        }
-      }
+      uchar *page = &buf[size_t(p) * 0x4000];
+      const uchar *prev = p ? page - 0x4000 : last;
+      int got = lf < 0x4000 ? libraw_internal_data.internal_data.input->read(
+                                  page + lf, 1, 0x4000 - lf)
+                            : 0;
+      got = MAX(got, 0);
+      if (got < 0x4000 - lf)
+        memcpy(page + lf + got, prev + lf + got, 0x4000 - lf - got);
+      got = libraw_internal_data.internal_data.input->read(page, 1, lf);
+      got = MAX(got, 0);
+      if (got < lf)
+        memcpy(page + got, prev + got, lf - got);
     }
+    memcpy(last, &buf[size_t(count - 1) * 0x4000], 0x4000);
+    strip.first = first;
+    panasonic_decode_loop(&strip, count);
   }
 }
 
-
-void LibRaw::panasonicC7_load_raw()
+/* Encodings 6 and 7: whole groups of 16 rows, rowbytes each, as many as
+   fit in raw_height. A group read short keeps the previous group's bytes */
+void LibRaw::panasonic_load_rows(int rowbytes)
 {
   const int rowstep = 16;
-  int pixperblock = libraw_internal_data.unpacker_data.pana_bpp == 14 ? 9 : 10;
-  int rowbytes = imgdata.sizes.raw_width / pixperblock * 16;
-  unsigned char *iobuf = (unsigned char *)calloc(rowbytes * rowstep,1);
-  for (int row = 0; row < imgdata.sizes.raw_height - rowstep + 1;
-       row += rowstep)
+  const int rows = imgdata.sizes.raw_height / rowstep * rowstep;
+  if (rows < rowstep)
+    return;
+  if (rowbytes < 1)
+    throw LIBRAW_EXCEPTION_IO_EOF;
+  panasonic_strip_t strip;
+  strip.unit_bytes = rowbytes;
+  strip.rotation = 0;
+
+  const INT64 start = libraw_internal_data.internal_data.input->tell();
+  if (const uchar *span = libraw_internal_data.internal_data.input->get_span(
+          start, INT64(rows) * rowbytes))
   {
-    int rowstoread = MIN(rowstep, imgdata.sizes.raw_height - row);
-    if (libraw_internal_data.internal_data.input->read(
-            iobuf, rowbytes, rowstoread) != rowstoread)
-      throw LIBRAW_EXCEPTION_IO_EOF;
-    unsigned char *bytes = iobuf;
-    for (int crow = 0; crow < rowstoread; crow++)
+    libraw_internal_data.internal_data.input->seek(
+        start + INT64(rows) * rowbytes, SEEK_SET);
+    strip.data = span;
+    strip.first = 0;
+    panasonic_decode_loop(&strip, rows);
+    return;
+  }
+
+  const size_t groupbytes = size_t(rowbytes) * rowstep;
+  const int band = MAX(1, MIN(rows / rowstep, int((16 << 20) / groupbytes)));
+  std::vector<uchar> buf;
+  try
+  {
+    buf.resize(groupbytes * (band + 1));
+  }
+  catch (...)
+  {
+    throw LIBRAW_EXCEPTION_ALLOC;
+  }
+  uchar *last = &buf[groupbytes * band];
+  strip.data = buf.data();
+  for (int first = 0; first < rows; first += band * rowstep)
+  {
+    const int count = MIN(band, (rows - first) / rowstep);
+    int done = 0;
+    for (; done < count; done++)
     {
-      unsigned short *rowptr =
-          &imgdata.rawdata
-               .raw_image[(row + crow) * imgdata.sizes.raw_pitch / 2];
-      for (int col = 0; col < imgdata.sizes.raw_width - pixperblock + 1;
-           col += pixperblock, bytes += 16)
-      {
-        if (libraw_internal_data.unpacker_data.pana_bpp == 14)
-        {
-          rowptr[col] = bytes[0] + ((bytes[1] & 0x3F) << 8);
-          rowptr[col + 1] =
-              (bytes[1] >> 6) + 4 * (bytes[2]) + ((bytes[3] & 0xF) << 10);
-          rowptr[col + 2] =
-              (bytes[3] >> 4) + 16 * (bytes[4]) + ((bytes[5] & 3) << 12);
-          rowptr[col + 3] = ((bytes[5] & 0xFC) >> 2) + (bytes[6] << 6);
-          rowptr[col + 4] = bytes[7] + ((bytes[8] & 0x3F) << 8);
-          rowptr[col + 5] =
-              (bytes[8] >> 6) + 4 * bytes[9] + ((bytes[10] & 0xF) << 10);
-          rowptr[col + 6] =
-              (bytes[10] >> 4) + 16 * bytes[11] + ((bytes[12] & 3) << 12);
-          rowptr[col + 7] = ((bytes[12] & 0xFC) >> 2) + (bytes[13] << 6);
-          rowptr[col + 8] = bytes[14] + ((bytes[15] & 0x3F) << 8);
-        }
-        else if (libraw_internal_data.unpacker_data.pana_bpp ==
-                 12) // have not seen in the wild yet
-        {
-          rowptr[col] = ((bytes[1] & 0xF) << 8) + bytes[0];
-          rowptr[col + 1] = 16 * bytes[2] + (bytes[1] >> 4);
-          rowptr[col + 2] = ((bytes[4] & 0xF) << 8) + bytes[3];
-          rowptr[col + 3] = 16 * bytes[5] + (bytes[4] >> 4);
-          rowptr[col + 4] = ((bytes[7] & 0xF) << 8) + bytes[6];
-          rowptr[col + 5] = 16 * bytes[8] + (bytes[7] >> 4);
-          rowptr[col + 6] = ((bytes[10] & 0xF) << 8) + bytes[9];
-          rowptr[col + 7] = 16 * bytes[11] + (bytes[10] >> 4);
-          rowptr[col + 8] = ((bytes[13] & 0xF) << 8) + bytes[12];
-          rowptr[col + 9] = 16 * bytes[14] + (bytes[13] >> 4);
-        }
-      }
+      uchar *group = &buf[groupbytes * done];
+      const INT64 pos = libraw_internal_data.internal_data.input->tell();
+      const int got = libraw_internal_data.internal_data.input->read(
+          group, rowbytes, rowstep);
+      const INT64 bytes = libraw_internal_data.internal_data.input->tell() - pos;
+      if (bytes >= 0 && size_t(bytes) < groupbytes)
+        memcpy(group + bytes, (done ? group - groupbytes : last) + bytes,
+               groupbytes - size_t(bytes));
+      if (got != rowstep)
+        break;
     }
+    if (done)
+      memcpy(last, &buf[groupbytes * (done - 1)], groupbytes);
+    strip.first = first;
+    panasonic_decode_loop(&strip, done * rowstep);
+    if (done < count)
+      throw LIBRAW_EXCEPTION_IO_EOF;
   }
-  free(iobuf);
+}
+
+void LibRaw::panasonicC6_load_raw()
+{
+  const int pixperblock =
+      libraw_internal_data.unpacker_data.pana_bpp == 12 ? 14 : 11;
+  panasonic_load_rows(imgdata.sizes.raw_width / pixperblock * 16);
+}
+
+void LibRaw::panasonicC7_load_raw()
+{
+  const int pixperblock =
+      libraw_internal_data.unpacker_data.pana_bpp == 14 ? 9 : 10;
+  panasonic_load_rows(imgdata.sizes.raw_width / pixperblock * 16);
 }
 
 void LibRaw::unpacked_load_raw_fuji_f700s20()
@@ -895,6 +1100,40 @@ struct p1_row_info_t
 	bool operator < (const p1_row_info_t & rhs) const { return offset < rhs.offset; }
 };
 
+/* IIQ S rows are decoded from their own copies, so they run in parallel:
+   stripes[] holds the rows of a band sorted by offset and the one after */
+struct phase_one_s_strip_t
+{
+  const p1_row_info_t *stripes;
+  const uchar *data; // file bytes from stripes[0].offset
+  INT64 avail;       // bytes present in data
+  INT64 maxsz;
+  uchar *stage;      // maxsz + 4 bytes per worker
+};
+
+void LibRaw::phase_one_s_decode_loop(void *data, int count)
+{
+  parallel_for(count, [&](int row, int worker) { phase_one_s_decode_row(data, row, worker); });
+}
+
+void LibRaw::phase_one_s_decode_row(void *data, int unit, int worker)
+{
+  const phase_one_s_strip_t *strip = (const phase_one_s_strip_t *)data;
+  const p1_row_info_t &s = strip->stripes[unit];
+  if (s.row >= imgdata.sizes.raw_height)
+    return;
+  const INT64 readsz = strip->stripes[unit + 1].offset - s.offset;
+  const INT64 start = s.offset - strip->stripes[0].offset;
+  checkCancel();
+  uchar *datavec = strip->stage + size_t(strip->maxsz + 4) * worker;
+  const INT64 have = LIM(strip->avail - start, 0, readsz);
+  memcpy(datavec, strip->data + start, size_t(have));
+  memset(datavec + have, 0, size_t(strip->maxsz + 4 - have));
+  decode_S_type(imgdata.sizes.raw_width, (uint32_t *)datavec,
+                imgdata.rawdata.raw_image + s.row * imgdata.sizes.raw_width,
+                readsz /*, 14 */);
+}
+
 void LibRaw::phase_one_load_raw_s()
 {
 	if(!libraw_internal_data.unpacker_data.strip_offset || !imgdata.rawdata.raw_image || !libraw_internal_data.unpacker_data.data_offset)
@@ -910,21 +1149,63 @@ void LibRaw::phase_one_load_raw_s()
 	stripes[imgdata.sizes.raw_height].offset = libraw_internal_data.unpacker_data.data_offset + INT64(libraw_internal_data.unpacker_data.data_size);
 	std::sort(stripes.begin(), stripes.end());
 	INT64 maxsz = imgdata.sizes.raw_width * 3 + 2; // theor max: 17 bytes per 8 pix + row header
-	std::vector<uint8_t> datavec(maxsz+4);
-
 	for (unsigned row = 0; row < imgdata.sizes.raw_height; row++)
-	{
-		if (stripes[row].row >= imgdata.sizes.raw_height) continue; 
-		ushort *datap = imgdata.rawdata.raw_image + stripes[row].row * imgdata.sizes.raw_width;
-		libraw_internal_data.internal_data.input->seek(stripes[row].offset, SEEK_SET);
-		INT64 readsz = stripes[row + 1].offset - stripes[row].offset;
-		if (readsz > maxsz)
+		if (stripes[row].row < imgdata.sizes.raw_height && stripes[row + 1].offset - stripes[row].offset > maxsz)
 			throw LIBRAW_EXCEPTION_IO_CORRUPT;
 
-		if(libraw_internal_data.internal_data.input->read(datavec.data(), 1, readsz) != readsz)
-			derror(); // TODO: check read state
+	phase_one_s_strip_t strip;
+	strip.maxsz = maxsz;
+	std::vector<uchar> stage(size_t(maxsz + 4) * parallel_workers());
+	strip.stage = stage.data();
+	const int rows = imgdata.sizes.raw_height;
+	if (const uchar *span = libraw_internal_data.internal_data.input->get_span(
+		stripes[0].offset, stripes[rows].offset - stripes[0].offset))
+	{
+		strip.stripes = &stripes[0];
+		strip.data = span;
+		strip.avail = stripes[rows].offset - stripes[0].offset;
+		phase_one_s_decode_loop(&strip, rows);
+		return;
+	}
 
-		decode_S_type(imgdata.sizes.raw_width, (uint32_t *)datavec.data(), datap, readsz /*, 14 */);
+	// Sorted rows are contiguous: read them in bands of about 16 MB.
+	// Only the gap after the end-of-data entry is unchecked, and no row
+	// is decoded from it, so a band holding just that entry is skipped.
+	const INT64 fsize = libraw_internal_data.internal_data.input->size();
+	const INT64 max_bytes = INT64(imgdata.rawparams.max_raw_memory_mb) * INT64(1024 * 1024);
+	std::vector<uint8_t> buf;
+	for (int first = 0, last; first < rows; first = last)
+	{
+		for (last = first + 1; last < rows && stripes[last + 1].offset - stripes[first].offset <= (16 << 20); last++)
+			;
+		if (last == first + 1 && stripes[first].row >= imgdata.sizes.raw_height)
+			continue;
+		INT64 bytes = stripes[last].offset - stripes[first].offset;
+		bytes = LIM(fsize - stripes[first].offset, 0, bytes);
+		if (bytes > max_bytes)
+			throw LIBRAW_EXCEPTION_TOOBIG;
+		try
+		{
+			buf.assign(size_t(bytes) + 1, 0);
+		}
+		catch (...)
+		{
+			throw LIBRAW_EXCEPTION_ALLOC;
+		}
+		libraw_internal_data.internal_data.input->seek(stripes[first].offset, SEEK_SET);
+		INT64 got = libraw_internal_data.internal_data.input->read(buf.data(), 1, bytes);
+		got = MAX(got, 0);
+		strip.stripes = &stripes[first];
+		strip.data = buf.data();
+		strip.avail = got;
+		phase_one_s_decode_loop(&strip, last - first);
+		for (int row = first; row < last; row++)
+			if (stripes[row].row < imgdata.sizes.raw_height && stripes[row + 1].offset - stripes[first].offset > got)
+			{
+				if (stripes[row + 1].offset > fsize)
+					throw LIBRAW_EXCEPTION_IO_EOF;
+				derror();
+			}
 	}
 }
 
@@ -17,6 +17,9 @@
  */
 
 #include "../../internal/dcraw_defs.h"
+#include "../../internal/losslessjpeg_rows.h"
+#include <new>
+#include <algorithm>
 
 void LibRaw::vc5_dng_load_raw_placeholder()
 {
@@ -53,23 +56,236 @@ void LibRaw::adobe_copy_pixel(unsigned row, unsigned col, ushort **rp)
   if (tiff_samples == 2 && shot_select)
     (*rp)--;
 }
+struct lossless_dng_tiles_t
+{
+  std::vector<INT64> offsets, sizes;
+  std::vector<char> done;
+  std::vector<unsigned> errors;
+  std::vector<std::vector<uchar> > jbufs; // tiles read ahead for parallel decoding
+  unsigned tiles_across;
+};
+
+/* Tile bytes and four zero bytes (bit pump look-ahead) into jbuf; jbuf is
+   left empty if the tile is out of range or short, or if it is not in
+   memory and the stream may not be read */
+static void lossless_dng_read_tile(LibRaw_abstract_datastream *input, INT64 offset, INT64 size, INT64 max_bytes,
+                                   bool may_read, std::vector<uchar> &jbuf)
+{
+  jbuf.clear();
+  if (offset < 0 || size < 4 || size > 0x7ffffff0LL || size > max_bytes || offset + size > input->size())
+    return;
+  jbuf.assign(size_t(size) + 4, 0);
+  if (const uchar *span = input->get_span(offset, size))
+    memcpy(jbuf.data(), span, size_t(size));
+  else if (!may_read)
+    jbuf.clear();
+  else
+  {
+    input->seek(offset, SEEK_SET);
+    if (input->read(jbuf.data(), 1, size) != size)
+      jbuf.clear();
+  }
+}
+
+void LibRaw::lossless_dng_tile_table(std::vector<INT64> &toffsets, std::vector<INT64> &tbytes)
+{
+  toffsets.clear();
+  tbytes.clear();
+  if (tile_length < INT_MAX)
+  {
+    if (tile_width < 1 || tile_length < 1)
+      return;
+    INT64 ntiles = INT64((raw_width + tile_width - 1) / tile_width) *
+                   INT64((raw_height + tile_length - 1) / tile_length);
+    int iifd = find_ifd_by_offset(data_offset);
+    if (ntiles < 2 || ntiles > 1000000 || iifd < 0)
+      return;
+    // TileOffsets table is at current position, TileByteCounts offset is
+    // stored in ifd.bytes if more than 1 tile
+    INT64 save = ftell(ifp);
+    toffsets.resize(size_t(ntiles));
+    for (size_t t = 0; t < toffsets.size(); t++)
+      toffsets[t] = get4();
+    fseek(ifp, tiff_ifd[iifd].bytes, SEEK_SET);
+    tbytes.resize(size_t(ntiles));
+    for (size_t t = 0; t < tbytes.size(); t++)
+      tbytes[t] = getint(tiff_ifd[iifd].bytes_type);
+    fseek(ifp, save, SEEK_SET);
+    // a tile can't run into the next one or past the end of file
+    std::vector<INT64> sorted(toffsets);
+    std::sort(sorted.begin(), sorted.end());
+    const INT64 fsize = ifp->size();
+    for (size_t t = 0; t < tbytes.size(); t++)
+    {
+      std::vector<INT64>::const_iterator next =
+          std::upper_bound(sorted.begin(), sorted.end(), toffsets[t]);
+      INT64 limit = next != sorted.end() ? *next : fsize;
+      if (limit > fsize)
+        limit = fsize;
+      if (tbytes[t] > limit - toffsets[t])
+        tbytes[t] = MAX(limit - toffsets[t], INT64(0));
+    }
+  }
+  else if (data_size > 0)
+  {
+    toffsets.assign(1, ftell(ifp));
+    tbytes.assign(1, INT64(data_size));
+  }
+}
+
+void LibRaw::lossless_dng_decode_loop(void *data, int count)
+{
+  lossless_dng_tiles_t *tiles = (lossless_dng_tiles_t *)data;
+  LibRaw_abstract_datastream *input = libraw_internal_data.internal_data.input;
+  const INT64 max_bytes = INT64(imgdata.rawparams.max_raw_memory_mb) * INT64(1024 * 1024);
+  int workers = parallel_workers();
+  if (workers < 2)
+  {
+    for (int tile = 0; tile < count; tile++)
+      lossless_dng_decode_tile(data, tile);
+    return;
+  }
+  /* Tiles not in memory are read ahead a batch at a time, so workers never
+     share the stream */
+  const int batch = workers * 4;
+  tiles->jbufs.resize(size_t(count));
+  for (int first = 0; first < count; first += batch)
+  {
+    int cnt = MIN(batch, count - first);
+    for (int tile = first; tile < first + cnt; tile++)
+      if (!input->get_span(tiles->offsets[tile], tiles->sizes[tile]))
+        lossless_dng_read_tile(input, tiles->offsets[tile], tiles->sizes[tile], max_bytes, true, tiles->jbufs[tile]);
+    parallel_for(first, first + cnt, [&](int tile, int) { lossless_dng_decode_tile(data, tile); });
+  }
+  tiles->jbufs.clear();
+}
+
+/* Decodes one tile from a private buffer with its own decoder state.
+   Tiles the table-driven decoder can't handle are left for the
+   ljpeg_row() loop in lossless_dng_load_raw() */
+void LibRaw::lossless_dng_decode_tile(void *data, int tile)
+{
+  lossless_dng_tiles_t *tiles = (lossless_dng_tiles_t *)data;
+  checkCancel();
+  std::vector<uchar> jbuf;
+  /* with tiles read ahead, the stream belongs to the loop */
+  bool read_ahead = size_t(tile) < tiles->jbufs.size();
+  if (read_ahead)
+    jbuf.swap(tiles->jbufs[tile]);
+  if (jbuf.empty())
+    lossless_dng_read_tile(libraw_internal_data.internal_data.input, tiles->offsets[tile], tiles->sizes[tile],
+                           INT64(imgdata.rawparams.max_raw_memory_mb) * INT64(1024 * 1024), !read_ahead, jbuf);
+  if (jbuf.empty())
+    return;
+
+  LibRaw_LjpegRowDecoder rdec(jbuf.data(), unsigned(jbuf.size() - 4));
+  if (!rdec.valid())
+    return;
+
+  unsigned trow = unsigned(tile / tiles->tiles_across) * tile_length;
+  unsigned tcol = unsigned(tile % tiles->tiles_across) * tile_width;
+  unsigned jwide = rdec.jpeg_width(), clrs = rdec.components();
+  if (filters || colors == 1)
+    jwide *= clrs;
+  if (filters && (tiff_samples == 2)) // Fuji Super CCD
+    jwide /= 2;
+  unsigned rowlen = (tiff_samples == 1 && clrs > 1 && clrs * jwide == raw_width)
+                        ? jwide * clrs
+                        : jwide;
+
+  /* Rows past tile_length would be overwritten by the next tile row in
+     serial decoding; skip them, so tiles do not overlap */
+  unsigned row = 0, col = 0;
+  for (unsigned jrow = 0; jrow < rdec.jpeg_height(); jrow++)
+  {
+    ushort *rp = rdec.next_row();
+    if (!rp)
+      throw LIBRAW_EXCEPTION_IO_CORRUPT;
+    for (unsigned jcol = 0; jcol < rowlen && row < tile_length; jcol++)
+    {
+      adobe_copy_pixel(trow + row, tcol + col, &rp);
+      if (++col >= tile_width || col >= raw_width)
+        row += 1 + (col = 0);
+    }
+  }
+  tiles->errors[tile] = rdec.errors();
+  tiles->done[tile] = 1;
+}
+
 void LibRaw::lossless_dng_load_raw()
 {
-  unsigned trow = 0, tcol = 0, jwide, jrow, jcol, row, col, i, j;
+  unsigned trow = 0, tcol = 0, jwide, jrow, jcol, row, col, i, j, tile = 0;
   INT64 save;
   struct jhead jh;
   ushort *rp;
+  std::vector<uchar> jbuf;
+  lossless_dng_tiles_t tiles;
 
   int ss = shot_select;
   shot_select = libraw_internal_data.unpacker_data.dng_frames[LIM(ss,0,(LIBRAW_IFD_MAXCOUNT*2-1))] & 0xff;
 
+  if (!(imgdata.rawparams.options & LIBRAW_RAWOPTIONS_LJPEG_LEGACY_DECODER) &&
+      dng_version >= 0x1010000)
+    lossless_dng_tile_table(tiles.offsets, tiles.sizes);
+
+  if (tiles.sizes.size() > 1)
+  {
+    tiles.tiles_across = (raw_width + tile_width - 1) / tile_width;
+    tiles.done.assign(tiles.sizes.size(), 0);
+    tiles.errors.assign(tiles.sizes.size(), 0);
+    save = ftell(ifp);
+    try
+    {
+      lossless_dng_decode_loop(&tiles, int(tiles.sizes.size()));
+      for (size_t t = 0; t < tiles.errors.size(); t++)
+        for (unsigned e = 0; e < tiles.errors[t]; e++)
+          derror();
+    }
+    catch (...)
+    {
+      shot_select = ss;
+      throw;
+    }
+    fseek(ifp, save, SEEK_SET);
+  }
+
   while (trow < raw_height)
   {
     checkCancel();
     save = ftell(ifp);
+    if (tile < tiles.done.size() && tiles.done[tile])
+    {
+      tile++;
+      fseek(ifp, save + 4, SEEK_SET);
+      if ((tcol += tile_width) >= raw_width)
+        trow += tile_length + (tcol = 0);
+      continue;
+    }
     if (tile_length < INT_MAX)
       fseek(ifp, get4(), SEEK_SET);
-    if (!ljpeg_start(&jh, 0))
+
+    LibRaw_LjpegRowDecoder *rdec = 0;
+    unsigned rerrors = 0;
+    if (tiles.sizes.size() == 1 && ljpeg_read_data(jbuf, ftell(ifp), tiles.sizes[0]))
+    {
+      rdec = new LibRaw_LjpegRowDecoder(jbuf.data(), unsigned(jbuf.size() - 4));
+      if (!rdec->valid())
+      {
+        delete rdec;
+        rdec = 0;
+      }
+    }
+    tile++;
+    if (rdec)
+    {
+      memset(&jh, 0, sizeof(jh));
+      jh.algo = 0xc3;
+      jh.wide = rdec->jpeg_width();
+      jh.high = rdec->jpeg_height();
+      jh.clrs = rdec->components();
+      jh.bits = rdec->bits();
+    }
+    else if (!ljpeg_start(&jh, 0))
       break;
     jwide = jh.wide;
     if (filters || colors == 1)
@@ -103,7 +319,15 @@ void LibRaw::lossless_dng_load_raw()
         for (row = col = jrow = 0; jrow < (unsigned)jh.high; jrow++)
         {
           checkCancel();
-          rp = ljpeg_row(jrow, &jh);
+          if (rdec)
+          {
+            if (!(rp = rdec->next_row()))
+              throw LIBRAW_EXCEPTION_IO_CORRUPT;
+            for (; rerrors < rdec->errors(); rerrors++)
+              derror();
+          }
+          else
+            rp = ljpeg_row(jrow, &jh);
           if (tiff_samples == 1 && jh.clrs > 1 && jh.clrs * jwide == raw_width)
             for (jcol = 0; jcol < jwide * jh.clrs; jcol++)
             {
@@ -123,14 +347,20 @@ void LibRaw::lossless_dng_load_raw()
     }
     catch (...)
     {
-      ljpeg_end(&jh);
+      if (rdec)
+        delete rdec;
+      else
+        ljpeg_end(&jh);
       shot_select = ss;
       throw;
     }
     fseek(ifp, save + 4, SEEK_SET);
     if ((tcol += tile_width) >= raw_width)
       trow += tile_length + (tcol = 0);
-    ljpeg_end(&jh);
+    if (rdec)
+      delete rdec;
+    else
+      ljpeg_end(&jh);
   }
   shot_select = ss;
 }
@@ -326,6 +326,82 @@ void tile_stripe_data_t::init(tiff_ifd_t *ifd, const libraw_image_sizes_t& sizes
 }
 
 #ifdef USE_ZLIB
+struct deflate_dng_decode_data_t
+{
+  const tile_stripe_data_t &tiles;
+  const tiff_ifd_t *ifd;
+  float *float_raw_image;
+  int xFactor, first;
+  INT64 tileBytes, tileRowBytes;
+  std::vector<std::vector<uchar> > cBuffers, uBuffers;
+  std::vector<float> maxes;
+  deflate_dng_decode_data_t(const tile_stripe_data_t &t, const tiff_ifd_t *i, float *f, int xf, int slots,
+                            INT64 tb, INT64 trb)
+      : tiles(t), ifd(i), float_raw_image(f), xFactor(xf), first(0), tileBytes(tb), tileRowBytes(trb),
+        cBuffers(slots, std::vector<uchar>(t.maxBytesInTile, 0)),
+        uBuffers(slots, std::vector<uchar>(tb + trb, 0)), maxes(slots, 0.f)
+  {
+  }
+};
+
+void LibRaw::deflate_dng_decode_loop(void *data, int count)
+{
+  parallel_for(count, [&](int slot, int) {
+    try
+    {
+      deflate_dng_decode_tile(data, slot);
+    }
+    catch (const LibRaw_exceptions &)
+    {
+      throw;
+    }
+    catch (const std::bad_alloc &)
+    {
+      throw;
+    }
+    catch (...)
+    {
+      throw LIBRAW_EXCEPTION_DECODE_RAW;
+    }
+  });
+}
+
+void LibRaw::deflate_dng_decode_tile(void *data, int slot)
+{
+  deflate_dng_decode_data_t *ddata = (deflate_dng_decode_data_t *)data;
+  const tile_stripe_data_t &tiles = ddata->tiles;
+  const tiff_ifd_t *ifd = ddata->ifd;
+  int t = ddata->first + slot;
+  size_t y = size_t(t / tiles.tilesH) * tiles.tileHeight;
+  size_t x = size_t(t % tiles.tilesH) * tiles.tileWidth;
+  std::vector<uchar> &cBuffer = ddata->cBuffers[slot];
+  std::vector<uchar> &uBuffer = ddata->uBuffers[slot];
+  INT64 tileRowBytes = ddata->tileRowBytes;
+
+  unsigned long dstLen = ddata->tileBytes;
+  int err = uncompress(uBuffer.data() + tileRowBytes, &dstLen, cBuffer.data(), (unsigned long)tiles.tBytes[t]);
+  if (err != Z_OK)
+    throw LIBRAW_EXCEPTION_DECODE_RAW;
+
+  int bytesps = ifd->bps >> 3;
+  size_t rowsInTile = y + tiles.tileHeight > imgdata.sizes.raw_height ? imgdata.sizes.raw_height - y : tiles.tileHeight;
+  size_t colsInTile = x + tiles.tileWidth > imgdata.sizes.raw_width ? imgdata.sizes.raw_width - x : tiles.tileWidth;
+  float max = ddata->maxes[slot];
+
+  for (size_t row = 0; row < rowsInTile; ++row) // do not process full tile if not needed
+  {
+    unsigned char *dst = uBuffer.data() + row * tiles.tileWidth * bytesps * ifd->samples;
+    unsigned char *src = dst + tileRowBytes;
+    DecodeFPDelta(src, dst, tiles.tileWidth / ddata->xFactor, ifd->samples * ddata->xFactor, bytesps);
+    float lmax = expandFloats(dst, tiles.tileWidth * ifd->samples, bytesps);
+    max = MAX(max, lmax);
+    unsigned char *dst2 =
+        (unsigned char *)&ddata->float_raw_image[((y + row) * imgdata.sizes.raw_width + x) * ifd->samples];
+    memmove(dst2, dst, colsInTile * ifd->samples * sizeof(float));
+  }
+  ddata->maxes[slot] = max;
+}
+
 void LibRaw::deflate_dng_load_raw()
 {
   int iifd = find_ifd_by_offset(libraw_internal_data.unpacker_data.data_offset);
@@ -405,49 +481,48 @@ void LibRaw::deflate_dng_load_raw()
   if (tileBytes + tileRowBytes > INT64(imgdata.rawparams.max_raw_memory_mb) * 1024LL * 1024LL)
     throw LIBRAW_EXCEPTION_TOOBIG;
 
-  std::vector<uchar> cBuffer(tiles.maxBytesInTile,0);
-  std::vector<uchar> uBuffer(tileBytes + tileRowBytes,0); // extra row for decoding
+  /* Compressed tiles are read in batches of 'slots' tiles, each batch is
+     decoded in parallel. Number of in-flight tile buffers is limited by
+     max_raw_memory_mb */
+  int slots = 1, workers = parallel_workers();
+  if (workers > 1)
+  {
+    INT64 slotBytes = tiles.maxBytesInTile + tileBytes + tileRowBytes;
+    INT64 freeBytes = INT64(imgdata.rawparams.max_raw_memory_mb) * 1024LL * 1024LL -
+                      INT64(tiles.tileCnt) * tileBytes;
+    slots = MAX(1, MIN(workers * 2, tiles.tileCnt));
+    if (freeBytes / slotBytes < slots)
+      slots = int(MAX(1, freeBytes / slotBytes));
+  }
 
-  for (size_t y = 0, t = 0; y < imgdata.sizes.raw_height; y += tiles.tileHeight)
+  try
+  {
+    deflate_dng_decode_data_t ddata(tiles, ifd, float_raw_image, xFactor, slots,
+                                    tileBytes, tileRowBytes);
+    for (int first = 0; first < tiles.tileCnt; first += slots)
     {
-      for (size_t x = 0; x < imgdata.sizes.raw_width; x += tiles.tileWidth, ++t)
+      checkCancel();
+      int cnt = MIN(slots, tiles.tileCnt - first);
+      for (int i = 0; i < cnt; i++)
       {
-		if(t >= tiles.tOffsets.size()) // should not happen but check anyway
-          throw LIBRAW_EXCEPTION_IO_CORRUPT; 
-
+        int t = first + i;
         libraw_internal_data.internal_data.input->seek(tiles.tOffsets[t], SEEK_SET);
-        int bytesread = libraw_internal_data.internal_data.input->read(cBuffer.data(), 1, tiles.tBytes[t]);
-		if (bytesread < tiles.tBytes[t])
-			derror();
-        unsigned long dstLen = tileBytes;
-        int err =
-            uncompress(uBuffer.data() + tileRowBytes, &dstLen, cBuffer.data(), (unsigned long)tiles.tBytes[t]);
-        if (err != Z_OK)
-        {
-          throw LIBRAW_EXCEPTION_DECODE_RAW;
-          return;
-        }
-        else
-        {
-          int bytesps = ifd->bps >> 3;
-          size_t rowsInTile = y + tiles.tileHeight > imgdata.sizes.raw_height ? imgdata.sizes.raw_height - y : tiles.tileHeight;
-          size_t colsInTile = x + tiles.tileWidth > imgdata.sizes.raw_width ? imgdata.sizes.raw_width - x : tiles.tileWidth;
-
-          for (size_t row = 0; row < rowsInTile; ++row) // do not process full tile if not needed
-          {
-              unsigned char *dst = uBuffer.data() + row * tiles.tileWidth * bytesps * ifd->samples;
-              unsigned char *src = dst + tileRowBytes;
-              DecodeFPDelta(src, dst, tiles.tileWidth / xFactor, ifd->samples * xFactor, bytesps);
-              float lmax = expandFloats(dst, tiles.tileWidth * ifd->samples, bytesps);
-            max = MAX(max, lmax);
-            unsigned char *dst2 = (unsigned char *)&float_raw_image
-                [((y + row) * imgdata.sizes.raw_width + x) * ifd->samples];
-            memmove(dst2, dst, colsInTile * ifd->samples * sizeof(float));
-          }
-        }
+        int bytesread = libraw_internal_data.internal_data.input->read(ddata.cBuffers[i].data(), 1, tiles.tBytes[t]);
+        if (bytesread < tiles.tBytes[t])
+          derror();
       }
+      ddata.first = first;
+      deflate_dng_decode_loop(&ddata, cnt);
     }
-  
+    for (int i = 0; i < slots; i++)
+      max = MAX(max, ddata.maxes[i]);
+  }
+  catch (...)
+  {
+    free(float_raw_image);
+    throw;
+  }
+
   imgdata.color.fmaximum = max;
 
   // Set fields according to data format
@@ -477,6 +552,8 @@ void LibRaw::deflate_dng_load_raw()
 }
 #else
 void LibRaw::deflate_dng_load_raw() { throw LIBRAW_EXCEPTION_DECODE_RAW; }
+void LibRaw::deflate_dng_decode_loop(void *, int) { throw LIBRAW_EXCEPTION_DECODE_RAW; }
+void LibRaw::deflate_dng_decode_tile(void *, int) { throw LIBRAW_EXCEPTION_DECODE_RAW; }
 #endif
 
 int LibRaw::is_floating_point()
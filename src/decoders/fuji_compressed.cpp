@@ -73,6 +73,9 @@ struct fuji_compressed_block
   uchar *cur_buf;         // currently read block
   int fillbytes;          // Counter to add extra byte for block size N*16
   LibRaw_abstract_datastream *input;
+  uchar *bufalloc;        // read() buffer
+  const uchar *span;      // block data if stream is in memory (no read() needed)
+  INT64 span_offset;      // offset of span in a file
   fuji_grads even[3]; // tables of even gradients
   fuji_grads odd[3];  // tables of odd gradients
   ushort *linealloc;
@@ -232,31 +235,32 @@ static inline void fuji_fill_buffer(fuji_compressed_block *info)
     bool needthrow = false;
     info->cur_pos = 0;
     info->cur_buf_offset += info->cur_buf_size;
-#ifdef LIBRAW_USE_OPENMP
-#pragma omp critical
-#endif
+    if (info->span)
+    {
+      // whole block is in memory
+      info->cur_buf = (uchar *)info->span + (info->cur_buf_offset - info->span_offset);
+      info->cur_buf_size = int(info->max_read_size);
+    }
+    else
     {
-#ifndef LIBRAW_USE_OPENMP
       info->input->lock();
-#endif
       info->input->seek(info->cur_buf_offset, SEEK_SET);
       info->cur_buf_size = info->input->read(info->cur_buf, 1, _min(info->max_read_size, XTRANS_BUF_SIZE));
-#ifndef LIBRAW_USE_OPENMP
       info->input->unlock();
-#endif
-      if (info->cur_buf_size < 1) // nothing read
+    }
+    if (info->cur_buf_size < 1) // nothing read
+    {
+      info->cur_buf = info->bufalloc;
+      if (info->fillbytes > 0)
       {
-        if (info->fillbytes > 0)
-        {
-          int ls = _max(1, _min(info->fillbytes, XTRANS_BUF_SIZE));
-          memset(info->cur_buf, 0, ls);
-          info->fillbytes -= ls;
-        }
-        else
-          needthrow = true;
+        int ls = _max(1, _min(info->fillbytes, XTRANS_BUF_SIZE));
+        memset(info->cur_buf, 0, ls);
+        info->fillbytes -= ls;
       }
-      info->max_read_size -= info->cur_buf_size;
+      else
+        needthrow = true;
     }
+    info->max_read_size -= info->cur_buf_size;
     if (needthrow)
       throw LIBRAW_EXCEPTION_IO_EOF;
   }
@@ -290,7 +294,9 @@ void LibRaw::init_fuji_block(fuji_compressed_block *info, const fuji_compressed_
     info->linebuf[i] = info->linebuf[i - 1] + params->line_width + 2;
 
   // init buffer
-  info->cur_buf = (uchar *)calloc(XTRANS_BUF_SIZE, 1);
+  info->cur_buf = info->bufalloc = (uchar *)calloc(XTRANS_BUF_SIZE, 1);
+  info->span = info->max_read_size < INT_MAX ? info->input->get_span(raw_offset, info->max_read_size) : NULL;
+  info->span_offset = raw_offset;
   info->cur_bit = 0;
   info->cur_pos = 0;
   info->cur_buf_offset = raw_offset;
@@ -1086,7 +1092,7 @@ void LibRaw::fuji_decode_strip(fuji_compressed_params *params, int cur_block, IN
   if (!libraw_internal_data.unpacker_data.fuji_lossless)
     free(info_common);
   free(info.linealloc);
-  free(info.cur_buf);
+  free(info.bufalloc);
 }
 
 void LibRaw::fuji_compressed_load_raw()
@@ -1151,33 +1157,20 @@ void LibRaw::fuji_compressed_load_raw()
 void LibRaw::fuji_decode_loop(fuji_compressed_params *common_info, int count, INT64 *raw_block_offsets,
                               unsigned *block_sizes, uchar *q_bases)
 {
-  int cur_block;
   const int lineStep = (libraw_internal_data.unpacker_data.fuji_total_lines + 0xF) & ~0xF;
-#ifdef LIBRAW_USE_OPENMP
-  unsigned errcnt = 0;
-#pragma omp parallel for private(cur_block) shared(errcnt)
-#endif
-  for (cur_block = 0; cur_block < count; cur_block++)
+  INT64 start = 0, end = 0;
+  for (int cur_block = 0; cur_block < count; cur_block++)
   {
-    try
-    {
-      fuji_decode_strip(common_info, cur_block, raw_block_offsets[cur_block], block_sizes[cur_block],
-                        q_bases ? q_bases + cur_block * lineStep : 0);
-    }
-    catch (...)
-    {
-#ifdef LIBRAW_USE_OPENMP
-#pragma omp atomic
-		  errcnt++;
-#else
-		  throw;
-#endif
-	  }
+    start = cur_block ? MIN(start, raw_block_offsets[cur_block]) : raw_block_offsets[cur_block];
+    end = MAX(end, raw_block_offsets[cur_block] + INT64(block_sizes[cur_block]));
   }
-#ifdef LIBRAW_USE_OPENMP
-  if (errcnt)
-		  throw LIBRAW_EXCEPTION_IO_EOF;
-#endif
+  LibRaw_parallel_input_scope input(libraw_internal_data.internal_data.input, start, end - start,
+                                    count > 1 ? parallel_workers() : 1,
+                                    INT64(imgdata.rawparams.max_raw_memory_mb) * INT64(1024 * 1024));
+  parallel_for_workers(count, input.workers(), [&](int cur_block, int) {
+    fuji_decode_strip(common_info, cur_block, raw_block_offsets[cur_block], block_sizes[cur_block],
+                      q_bases ? q_bases + cur_block * lineStep : 0);
+  });
 }
 
 void LibRaw::parse_fuji_compressed_header()
@@ -17,38 +17,323 @@
  */
 
 #include "../../internal/dcraw_defs.h"
+#include "../../internal/libraw_unpack.h"
+
+/*
+   Uncompressed sample unpacking. Sample i of bps bits starts at bit i*bps.
+   For even widths four samples take bps/2 whole bytes and are cut out of
+   one 64-bit window with constant shifts; odd widths use a 32-bit window
+   per sample. Windows that would run past src_bytes go through a
+   zero-padded copy.
+ */
+static inline UINT64 window64_be(const uint8_t *p)
+{
+  return UINT64(p[0]) << 56 | UINT64(p[1]) << 48 | UINT64(p[2]) << 40 |
+         UINT64(p[3]) << 32 | UINT64(p[4]) << 24 | UINT64(p[5]) << 16 |
+         UINT64(p[6]) << 8 | UINT64(p[7]);
+}
+
+static inline UINT64 window64_le(const uint8_t *p)
+{
+  return UINT64(p[0]) | UINT64(p[1]) << 8 | UINT64(p[2]) << 16 |
+         UINT64(p[3]) << 24 | UINT64(p[4]) << 32 | UINT64(p[5]) << 40 |
+         UINT64(p[6]) << 48 | UINT64(p[7]) << 56;
+}
+
+static inline unsigned window32_be(const uint8_t *p)
+{
+  return unsigned(p[0]) << 24 | unsigned(p[1]) << 16 | unsigned(p[2]) << 8 |
+         unsigned(p[3]);
+}
+
+static inline unsigned window32_le(const uint8_t *p)
+{
+  return unsigned(p[0]) | unsigned(p[1]) << 8 | unsigned(p[2]) << 16 |
+         unsigned(p[3]) << 24;
+}
+
+static inline void unpack_quads(const uint8_t *src, uint16_t *dst, int quads,
+                                int bps, bool le)
+{
+  const unsigned low = (1u << bps) - 1;
+  for (int q = 0; q < quads; q++)
+  {
+    const uint8_t *p = src + size_t(q) * (bps / 2);
+    uint16_t *d = dst + size_t(q) * 4;
+    if (le)
+    {
+      const UINT64 w = window64_le(p);
+      for (int k = 0; k < 4; k++)
+        d[k] = uint16_t(w >> (bps * k) & low);
+    }
+    else
+    {
+      const UINT64 w = window64_be(p);
+      for (int k = 0; k < 4; k++)
+        d[k] = uint16_t(w >> (64 - bps * (k + 1)) & low);
+    }
+  }
+}
+
+static void unpack_samples(const uint8_t *src, unsigned src_bytes,
+                           uint16_t *dst, int first, int count, int bps,
+                           bool le)
+{
+  const unsigned low = (1u << bps) - 1;
+  for (int i = first; i < count; i++)
+  {
+    const UINT64 bit = UINT64(i) * unsigned(bps);
+    const uint8_t *p = src + (bit >> 3);
+    uint8_t pad[4];
+    if ((bit >> 3) + 4 > src_bytes)
+    {
+      for (int k = 0; k < 4; k++)
+        pad[k] = (bit >> 3) + k < src_bytes ? p[k] : 0;
+      p = pad;
+    }
+    dst[i] = le ? uint16_t(window32_le(p) >> (bit & 7) & low)
+                : uint16_t(window32_be(p) >> (32 - bps - (bit & 7)) & low);
+  }
+}
+
+/* Number of whole quads whose 64-bit window lies within src_bytes */
+static inline int unpack_quad_count(unsigned src_bytes, int count, int bps)
+{
+  if (bps & 1 || src_bytes < 8 || count < 4)
+    return 0;
+  const unsigned fit = (src_bytes - 8) / unsigned(bps / 2) + 1;
+  return fit < unsigned(count / 4) ? int(fit) : count / 4;
+}
+
+LIBRAW_SIMD_CLONES
+void libraw_unpack_be(const uint8_t *src, unsigned src_bytes, uint16_t *dst,
+                      int count, int bps)
+{
+  const int quads = unpack_quad_count(src_bytes, count, bps);
+  switch (bps) /* constant shifts for the common widths */
+  {
+  case 10:
+    unpack_quads(src, dst, quads, 10, false);
+    break;
+  case 12:
+    unpack_quads(src, dst, quads, 12, false);
+    break;
+  case 14:
+    unpack_quads(src, dst, quads, 14, false);
+    break;
+  case 16:
+    unpack_quads(src, dst, quads, 16, false);
+    break;
+  default:
+    unpack_quads(src, dst, quads, bps, false);
+  }
+  unpack_samples(src, src_bytes, dst, quads * 4, count, bps, false);
+}
+
+LIBRAW_SIMD_CLONES
+void libraw_unpack_le(const uint8_t *src, unsigned src_bytes, uint16_t *dst,
+                      int count, int bps)
+{
+  const int quads = unpack_quad_count(src_bytes, count, bps);
+  switch (bps)
+  {
+  case 12:
+    unpack_quads(src, dst, quads, 12, true);
+    break;
+  case 14:
+    unpack_quads(src, dst, quads, 14, true);
+    break;
+  default:
+    unpack_quads(src, dst, quads, bps, true);
+  }
+  unpack_samples(src, src_bytes, dst, quads * 4, count, bps, true);
+}
+
+LIBRAW_SIMD_CLONES
+void libraw_unpack16(const uint8_t *src, uint16_t *dst, int count,
+                     bool big_endian)
+{
+  if (big_endian)
+    for (int i = 0; i < count; i++)
+      dst[i] = uint16_t(src[2 * i] << 8 | src[2 * i + 1]);
+  else
+    for (int i = 0; i < count; i++)
+      dst[i] = uint16_t(src[2 * i] | src[2 * i + 1] << 8);
+}
+
+LIBRAW_SIMD_CLONES
+void libraw_unpack8(const uint8_t *src, uint16_t *dst, int count,
+                    const uint16_t *tone)
+{
+  for (int i = 0; i < count; i++)
+    dst[i] = tone[src[i]];
+}
+
+LIBRAW_SIMD_CLONES
+void libraw_swap_groups(const uint8_t *src, uint8_t *dst, unsigned bytes,
+                        int group)
+{
+  const unsigned n = group > 1 ? bytes / unsigned(group) : 0;
+  if (group == 4)
+    for (unsigned i = 0; i < n; i++)
+    {
+      const unsigned w = window32_le(src + 4 * i);
+      dst[4 * i] = uint8_t(w >> 24);
+      dst[4 * i + 1] = uint8_t(w >> 16);
+      dst[4 * i + 2] = uint8_t(w >> 8);
+      dst[4 * i + 3] = uint8_t(w);
+    }
+  else
+    for (unsigned i = 0; i < n; i++)
+      for (int k = 0; k < group / 2; k++)
+      {
+        const uint8_t a = src[group * i + k];
+        dst[group * i + k] = src[group * i + group - 1 - k];
+        dst[group * i + group - 1 - k] = a;
+      }
+  if (src != dst)
+  {
+    const unsigned done = n * unsigned(group), odd = group & 1;
+    for (unsigned i = 0; odd && i < n; i++) /* middle bytes */
+      dst[group * i + group / 2] = src[group * i + group / 2];
+    memcpy(dst + done, src + done, bytes - done);
+  }
+}
 
 void LibRaw::unpacked_load_raw()
 {
   int row, col, bits = 0;
   while (1 << ++bits < (int)maximum)
     ;
-  read_shorts(raw_image, raw_width * raw_height);
-  fseek(ifp, -2, SEEK_CUR); // avoid EOF error
-  if (maximum < 0xffff || load_flags)
+  const INT64 start = ftell(ifp), stride = INT64(raw_width) * 2;
+  const int shift = load_flags;
+  std::vector<int> errors(raw_height, 0);
+  /* shift and range check of one row, errors are reported afterwards in
+     row order */
+  auto check_row = [&](int y) {
+    ushort *dst = raw_image + size_t(y) * raw_width;
+    if (maximum < 0xffff || shift)
+      for (int c = 0; c < raw_width; c++)
+        if ((dst[c] >>= shift) >> bits &&
+            (unsigned)(y - top_margin) < height &&
+            (unsigned)(c - left_margin) < width)
+          errors[y]++;
+  };
+  if (start + stride * raw_height <= ifp->size())
+  {
+    /* Whole image present: convert rows in parallel */
+    const bool big_endian = order != 0x4949;
+    uncompressed_bands(start, stride, raw_height, [&](const uchar *data, int first, int rows) {
+      parallel_for(rows, [&](int r, int) {
+        checkCancel();
+        libraw_unpack16(data + size_t(r) * stride,
+                        raw_image + size_t(first + r) * raw_width, raw_width,
+                        big_endian);
+        check_row(first + r);
+      });
+    });
+  }
+  else
+  {
+    read_shorts(raw_image, raw_width * raw_height);
     for (row = 0; row < raw_height; row++)
     {
       checkCancel();
-      for (col = 0; col < raw_width; col++)
-        if ((RAW(row, col) >>= load_flags) >> bits &&
-            (unsigned)(row - top_margin) < height &&
-            (unsigned)(col - left_margin) < width)
-          derror();
+      check_row(row);
+    }
+  }
+  fseek(ifp, -2, SEEK_CUR); // avoid EOF error
+  for (row = 0; row < raw_height; row++)
+    for (col = 0; col < errors[row]; col++)
+      derror();
+}
+
+/* packed_load_raw() for layouts where each row starts on a whole bite and
+   nothing is missing from the file: rows then have a fixed stride and are
+   unpacked in parallel. Returns false, having read nothing, otherwise */
+bool LibRaw::packed_load_rows(int bwide, int rbits, int bite, int half)
+{
+  const int bps = tiff_bps, lf = load_flags;
+  const int extra = lf & 1 ? raw_width / 10 : 0;
+  const INT64 start = ftell(ifp), stride = INT64(bwide) + extra;
+  if (bps < 1 || bps > 16 || lf & 4 || rbits < 0 || stride < 1 ||
+      raw_height < 1 || (bwide * 8) % bite || (lf & 1 && (10 * bps) % bite) ||
+      (lf & 64 && raw_width & 1) || start + stride * raw_height > ifp->size())
+    return false;
+
+  const int wbytes = bite >> 3, gbytes = 10 * bps / 8;
+  const size_t stage_bytes = size_t(bwide) + 4;
+  std::vector<uchar> stage(stage_bytes * parallel_workers());
+  std::vector<int> errors(raw_height, 0), error_at(raw_height, 0);
+  uncompressed_bands(start, stride, raw_height, [&](const uchar *data, int first, int rows) {
+    parallel_for(rows, [&](int r, int worker) {
+      const int irow = first + r;
+      const int row = lf & 2 ? irow % half * 2 + irow / half : irow;
+      const uchar *src = data + size_t(r) * stride;
+      uchar *buf = &stage[stage_bytes * worker];
+      checkCancel();
+      if (lf & 1)
+      {
+        /* drop the byte following each 10 samples, counting nonzero ones
+           within the visible area as errors */
+        for (int g = 0; g < extra; g++)
+        {
+          const uchar *group = src + g * (gbytes + 1);
+          memcpy(buf + g * gbytes, group, gbytes);
+          if (group[gbytes] && row < height + top_margin &&
+              g * 10 + 9 < width + left_margin && !errors[irow]++)
+            error_at[irow] = g * (gbytes + 1) + gbytes + 1;
+        }
+        memcpy(buf + extra * gbytes, src + extra * (gbytes + 1),
+               bwide - extra * gbytes);
+        src = buf;
+      }
+      if (wbytes > 1)
+      {
+        libraw_swap_groups(src, buf, bwide, wbytes);
+        src = buf;
+      }
+      ushort *dst = &RAW(row, 0);
+      libraw_unpack_be(src, bwide, dst, raw_width, bps);
+      if (lf & 64)
+        for (int c = 0; c < raw_width; c += 2)
+        {
+          const ushort t = dst[c];
+          dst[c] = dst[c + 1];
+          dst[c + 1] = t;
+        }
+    });
+  });
+
+  /* report errors from where the serial loop would have */
+  for (int irow = 0, seen = 0; irow < raw_height; irow++)
+    for (int k = 0; k < errors[irow]; k++)
+    {
+      if (!seen++)
+        fseek(ifp, start + stride * irow + error_at[irow], SEEK_SET);
+      derror();
     }
+  fseek(ifp,
+        start + stride * (raw_height - 1) + extra +
+            (INT64(raw_width) * bps + bite - 1) / bite * wbytes,
+        SEEK_SET);
+  return true;
 }
 
 void LibRaw::packed_load_raw()
 {
-  int vbits = 0, bwide, rbits, bite, half, irow, row, col, val, i;
+  int vbits = 0, bwide, rbits, bite, half, irow, row;
   UINT64 bitbuf = 0;
 
   bwide = raw_width * tiff_bps / 8;
   bwide += bwide & load_flags >> 7;
   rbits = bwide * 8 - raw_width * tiff_bps;
-  if (load_flags & 1)
-    bwide = bwide * 16 / 15;
   bite = 8 + (load_flags & 24);
   half = (raw_height + 1) >> 1;
+  if (packed_load_rows(bwide, rbits, bite, half))
+    return;
+  if (load_flags & 1)
+    bwide = bwide * 16 / 15;
   for (irow = 0; irow < raw_height; irow++)
   {
     checkCancel();
@@ -66,36 +351,58 @@ void LibRaw::packed_load_raw()
     }
     if (feof(ifp))
       throw LIBRAW_EXCEPTION_IO_EOF;
-    for (col = 0; col < raw_width; col++)
+    packed_bits_row(row, bite, load_flags, bitbuf, vbits);
+    vbits -= rbits;
+  }
+}
+
+/* Serial getbits()-style reader of one row of tiff_bps bit samples, for
+   packed layouts that cannot be cut into rows at fixed offsets. The bit
+   buffer is carried over between rows */
+void LibRaw::packed_bits_row(int row, int bite, int lf, UINT64 &bitbuf,
+                             int &vbits)
+{
+  for (int col = 0; col < raw_width; col++)
+  {
+    for (vbits -= tiff_bps; vbits < 0; vbits += bite)
     {
-      for (vbits -= tiff_bps; vbits < 0; vbits += bite)
-      {
-        bitbuf <<= bite;
-        for (i = 0; i < bite; i += 8)
-          bitbuf |= (unsigned(fgetc(ifp)) << i);
-      }
-      val = int((bitbuf << (64 - tiff_bps - vbits) >> (64 - tiff_bps)) & 0x7fffffff);
-      RAW(row, col ^ (load_flags >> 6 & 1)) = val;
-      if (load_flags & 1 && (col % 10) == 9 && fgetc(ifp) &&
-          row < height + top_margin && col < width + left_margin)
-        derror();
+      bitbuf <<= bite;
+      for (int i = 0; i < bite; i += 8)
+        bitbuf |= (unsigned(fgetc(ifp)) << i);
     }
-    vbits -= rbits;
+    int val =
+        int((bitbuf << (64 - tiff_bps - vbits) >> (64 - tiff_bps)) & 0x7fffffff);
+    RAW(row, col ^ (lf >> 6 & 1)) = val;
+    if (lf & 1 && (col % 10) == 9 && fgetc(ifp) &&
+        row < height + top_margin && col < width + left_margin)
+      derror();
   }
 }
 
 void LibRaw::eight_bit_load_raw()
 {
-  unsigned row, col;
+  unsigned row;
 
+  const INT64 start = ftell(ifp);
+  if (start + INT64(raw_width) * raw_height <= ifp->size())
+  {
+    uncompressed_bands(start, raw_width, raw_height, [&](const uchar *data, int first, int rows) {
+      parallel_for(rows, [&](int r, int) {
+        checkCancel();
+        libraw_unpack8(data + size_t(r) * raw_width, &RAW(first + r, 0),
+                       raw_width, curve);
+      });
+    });
+    maximum = curve[0xff];
+    return;
+  }
   std::vector<uchar> pixel(raw_width);
   for (row = 0; row < raw_height; row++)
   {
-      checkCancel();
-      if (fread(pixel.data(), 1, raw_width, ifp) < raw_width)
-          derror();
-      for (col = 0; col < raw_width; col++)
-          RAW(row, col) = curve[pixel[col]];
+    checkCancel();
+    if (fread(pixel.data(), 1, raw_width, ifp) < raw_width)
+      derror();
+    libraw_unpack8(pixel.data(), &RAW(row, 0), raw_width, curve);
   }
   maximum = curve[0xff];
 }
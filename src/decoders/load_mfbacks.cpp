@@ -134,11 +134,14 @@ void LibRaw::phase_one_fix_pixel_grad(unsigned row, unsigned col)
   RAW(row, col) = constain32((total + (count >> 1)) / count, lower, upper);
 }
 
+/* Each row of a flat field band steps mrow[] on, which is kept per row so
+   that the rows and tiles of a band are corrected in parallel */
 void LibRaw::phase_one_flat_field(int is_float, int nc)
 {
   ushort head[8];
-  unsigned wide, high, y, x, c, rend, cend, row, col;
-  float *mrow, num, mult[4];
+  unsigned wide, high, y, x, c, rend, rows, r;
+  float *mrow, num;
+  std::vector<float> band;
 
   read_shorts(head, 8);
   if (head[2] == 0 || head[3] == 0 || head[4] == 0 || head[5] == 0)
@@ -161,36 +164,47 @@ void LibRaw::phase_one_flat_field(int is_float, int nc)
     if (y == 0)
       continue;
     rend = head[1] + y * head[5];
-    for (row = rend - head[5];
-         row < raw_height && row < rend && row < unsigned(head[1] + head[3] - head[5]);
-         row++)
+    const unsigned rfirst = rend - head[5];
+    for (rows = 0; rfirst + rows < raw_height && rfirst + rows < rend &&
+                   rfirst + rows < unsigned(head[1] + head[3] - head[5]);
+         rows++)
+      ;
+    band.resize(size_t(rows) * nc * wide);
+    for (r = 0; r < rows; r++)
     {
-      for (x = 1; x < wide; x++)
-      {
-        for (c = 0; c < (unsigned)nc; c += 2)
-        {
-          mult[c] = mrow[c * wide + x - 1];
-          mult[c + 1] = (mrow[c * wide + x] - mult[c]) / head[4];
-        }
-        cend = head[0] + x * head[4];
-        for (col = cend - head[4];
-             col < raw_width && col < cend && col < unsigned(head[0] + head[2] - head[4]);
-             col++)
-        {
-          c = nc > 2 ? FC(row - top_margin, col - left_margin) : 0;
-          if (!(c & 1))
-          {
-            c = unsigned(RAW(row, col) * mult[c]);
-            RAW(row, col) = LIM(c, 0, 65535);
-          }
-          for (c = 0; c < (unsigned)nc; c += 2)
-            mult[c] += mult[c + 1];
-        }
-      }
+      memcpy(&band[size_t(r) * nc * wide], mrow, nc * wide * sizeof *mrow);
       for (x = 0; x < wide; x++)
         for (c = 0; c < (unsigned)nc; c += 2)
           mrow[c * wide + x] += mrow[(c + 1) * wide + x];
     }
+    if (wide < 2)
+      continue;
+    parallel_for(int(rows * (wide - 1)), [&](int tile, int) {
+      const unsigned row = rfirst + tile / (wide - 1);
+      const unsigned x = tile % (wide - 1) + 1;
+      const float *m = &band[size_t(row - rfirst) * nc * wide];
+      float mult[4];
+      unsigned c;
+      for (c = 0; c < (unsigned)nc; c += 2)
+      {
+        mult[c] = m[c * wide + x - 1];
+        mult[c + 1] = (m[c * wide + x] - mult[c]) / head[4];
+      }
+      const unsigned cend = head[0] + x * head[4];
+      for (unsigned col = cend - head[4];
+           col < raw_width && col < cend && col < unsigned(head[0] + head[2] - head[4]);
+           col++)
+      {
+        c = nc > 2 ? FC(row - top_margin, col - left_margin) : 0;
+        if (!(c & 1))
+        {
+          c = unsigned(RAW(row, col) * mult[c]);
+          RAW(row, col) = LIM(c, 0, 65535);
+        }
+        for (c = 0; c < (unsigned)nc; c += 2)
+          mult[c] += mult[c + 1];
+      }
+    });
   }
   free(mrow);
 }
@@ -199,7 +213,7 @@ int LibRaw::phase_one_correct()
 {
   unsigned entries, tag, data, col, row, type;
   INT64 save;
-  int len, i, j, k, cip, sum;
+  int len, i, j, sum;
 #if 0
   int val[4], dev[4], max;
 #endif
@@ -208,7 +222,7 @@ int LibRaw::phase_one_correct()
   /* static */ const signed char dir[12][2] = {
       {-1, -1}, {-1, 1}, {1, -1},  {1, 1},  {-2, 0}, {0, -2},
       {0, 2},   {2, 0},  {-2, -2}, {-2, 2}, {2, -2}, {2, 2}};
-  float poly[8], num, cfrac, frac, mult[2], *yval[2] = {NULL, NULL};
+  float poly[8], num, *yval[2] = {NULL, NULL};
   ushort *xval[2];
   int qmult_applied = 0, qlin_applied = 0;
   std::vector<unsigned> badCols;
@@ -327,12 +341,11 @@ int LibRaw::phase_one_correct()
           curve[i] = ushort(LIM(num + i, 0, 65535));
         }
       apply: /* apply to whole image */
-        for (row = 0; row < raw_height; row++)
-        {
+        parallel_for(raw_height, [&](int row, int) {
           checkCancel();
-          for (col = (tag & 1) * ph1.split_col; col < raw_width; col++)
+          for (unsigned col = (tag & 1) * ph1.split_col; col < raw_width; col++)
             RAW(row, col) = curve[RAW(row, col)];
-        }
+        });
       }
       else if (tag == 0x0401)
       { /* All-color flat fields - luma calibration*/
@@ -396,14 +409,13 @@ int LibRaw::phase_one_correct()
             cf[18] = cx[18] = 65535;
             cubic_spline(cx, cf, 19);
 
-            for (row = (qr ? ph1.split_row : 0);
-                 row < unsigned(qr ? raw_height : ph1.split_row); row++)
-            {
+            parallel_for(qr ? ph1.split_row : 0, qr ? raw_height : ph1.split_row,
+                         [&](int row, int) {
               checkCancel();
-              for (col = (qc ? ph1.split_col : 0);
+              for (unsigned col = (qc ? ph1.split_col : 0);
                    col < unsigned(qc ? raw_width : ph1.split_col); col++)
                 RAW(row, col) = curve[RAW(row, col)];
-            }
+            });
           }
         }
         qlin_applied = 1;
@@ -430,16 +442,15 @@ int LibRaw::phase_one_correct()
         get4();
         get4();
         qmult[1][1] = 1.0f + getrealf(LIBRAW_EXIFTAG_TYPE_FLOAT);
-        for (row = 0; row < raw_height; row++)
-        {
+        parallel_for(raw_height, [&](int row, int) {
           checkCancel();
-          for (col = 0; col < raw_width; col++)
+          for (unsigned col = 0; col < raw_width; col++)
           {
-            i = int(qmult[row >= (unsigned)ph1.split_row][col >= (unsigned)ph1.split_col] *
+            int v = int(qmult[unsigned(row) >= (unsigned)ph1.split_row][col >= (unsigned)ph1.split_col] *
                 RAW(row, col));
-            RAW(row, col) = LIM(i, 0, 65535);
+            RAW(row, col) = LIM(v, 0, 65535);
           }
-        }
+        });
         qmult_applied = 1;
       }
       else if (tag == 0x0431 && !qmult_applied && ph1.split_col > 0 && ph1.split_col < raw_width 
@@ -466,14 +477,13 @@ int LibRaw::phase_one_correct()
             cx[0] = cf[0] = 0;
             cx[8] = cf[8] = 65535;
             cubic_spline(cx, cf, 9);
-            for (row = (qr ? ph1.split_row : 0);
-                 row < unsigned(qr ? raw_height : ph1.split_row); row++)
-            {
+            parallel_for(qr ? ph1.split_row : 0, qr ? raw_height : ph1.split_row,
+                         [&](int row, int) {
               checkCancel();
-              for (col = (qc ? ph1.split_col : 0);
+              for (unsigned col = (qc ? ph1.split_col : 0);
                    col < unsigned(qc ? raw_width : ph1.split_col); col++)
                 RAW(row, col) = curve[RAW(row, col)];
-            }
+            });
           }
         }
         qmult_applied = 1;
@@ -488,11 +498,13 @@ int LibRaw::phase_one_correct()
       for (i = 0; i < (int)badCols.size(); ++i)
       {
         bool nextIsolated = i == ((int)(badCols.size()-1)) || badCols[i+1]>badCols[i]+4;
-        for (row = 0; row < raw_height; ++row)
+        // fixes read other columns only: rows of a column are independent
+        parallel_for(raw_height, [&](int row, int) {
           if (prevIsolated && nextIsolated)
             phase_one_fix_pixel_grad(row,badCols[i]);
           else
             phase_one_fix_col_pixel_avg(row,badCols[i]);
+        });
         prevIsolated = nextIsolated;
       }
     }
@@ -517,10 +529,11 @@ int LibRaw::phase_one_correct()
       for (i = 0; i < 2; i++)
         for (j = 0; j < head[i + 1] * head[i + 3]; j++)
           xval[i][j] = get2();
-      for (row = 0; row < raw_height; row++)
-      {
+      parallel_for(raw_height, [&](int row, int) {
+        int i, j, k, cip;
+        float cfrac, frac, num, mult[2] = {0, 0};
         checkCancel();
-        for (col = 0; col < raw_width; col++)
+        for (unsigned col = 0; col < raw_width; col++)
         {
           cfrac = (float)col * head[3] / raw_width;
 		  cip = (int)cfrac;
@@ -546,7 +559,7 @@ int LibRaw::phase_one_correct()
           i = int(((mult[0] * (1.f - cfrac) + mult[1] * cfrac) * row + num) * 2.f);
           RAW(row, col) = LIM(i, 0, 65535);
         }
-      }
+      });
       free(yval[0]);
     }
   }
@@ -634,17 +647,144 @@ unsigned LibRaw::ph1_bithuff(int nbits, ushort *huff)
 #endif
 }
 
-void LibRaw::phase_one_load_raw_c()
+/* Phase One IIQ L rows start at data_offset + offset[row] and restart
+   the bit reader, so rows decode on their own. The only state a row takes
+   from the one above is a code length kept by a leading 1 bit in its
+   first group: such rows are left to a second pass, which decodes each
+   run of them in row order after the row that heads it */
+struct phase_one_c_row_t
+{
+  const uchar *src; // row bytes
+  INT64 pos;        // file offset of src[0]
+  INT64 to_eof;     // bytes from pos to the end of file
+  int len[2];       // code lengths left by the row
+  int carried;      // first group kept the lengths of the row above
+  int errors;       // predictions out of range
+  INT64 fetched;    // bytes fetched at the first of them
+};
+
+struct phase_one_c_strip_t
+{
+  phase_one_c_row_t *rows; // this band
+  int first;               // row number of rows[0]
+  INT64 avail;             // row bytes held in src (past to_eof: 0xff)
+  const int *runs;         // second pass: first and end row of each run
+  int carry[2];            // lengths left by the row above rows[0]
+};
+
+/* 32-bit words in file byte order; bytes past the end read as 0xff, as
+   get4() returns them */
+struct phase_one_c_bits_t
+{
+  const uchar *src;
+  INT64 avail, pos;
+  UINT64 bitbuf;
+  int vbits;
+  bool le;
+
+  unsigned get(int nbits)
+  {
+    if (nbits == 0)
+      return 0;
+    if (vbits < nbits)
+    {
+      uchar tail[4] = {0xff, 0xff, 0xff, 0xff};
+      const uchar *p = src + pos;
+      if (pos + 4 > avail)
+      {
+        for (INT64 i = 0; i < 4 && pos + i < avail; i++)
+          tail[i] = p[i];
+        p = tail;
+      }
+      pos += 4;
+      const unsigned w =
+          le ? p[0] | p[1] << 8 | p[2] << 16 | unsigned(p[3]) << 24
+             : unsigned(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3];
+      bitbuf = bitbuf << 32 | w;
+      vbits += 32;
+    }
+    const unsigned c =
+        unsigned((bitbuf << (64 - vbits) >> (64 - nbits)) & 0xffffffff);
+    vbits -= nbits;
+    return c;
+  }
+};
+
+/* Decodes one row with code lengths len_in[] from the row above, or
+   only marks it carried and stops if len_in is NULL and it needs them */
+static void phase_one_c_row(phase_one_c_row_t &r, const int *len_in,
+                            ushort *dest, int cols, int fmt, bool le,
+                            INT64 avail, const ushort *tone)
 {
   static const int length[] = {8, 7, 6, 9, 11, 10, 5, 12, 14, 13};
-  int *offset, len[2], pred[2], row, col, i, j;
-  ushort *pixel;
+  phase_one_c_bits_t bits = {r.src, MIN(avail, r.to_eof), 0, 0, 0, le};
+  int len[2] = {14, 14}, pred[2] = {0, 0}, col, i, j;
+
+  if (len_in)
+    len[0] = len_in[0], len[1] = len_in[1];
+  r.carried = r.errors = 0;
+  for (col = 0; col < cols; col++)
+  {
+    if (col >= (cols & -8))
+      len[0] = len[1] = 14;
+    else if ((col & 7) == 0)
+      for (i = 0; i < 2; i++)
+      {
+        for (j = 0; j < 5 && !bits.get(1); j++)
+          ;
+        if (j--)
+          len[i] = length[j * 2 + bits.get(1)];
+        else if (col == 0)
+        {
+          r.carried = 1;
+          if (!len_in)
+            return;
+        }
+      }
+    ushort pixel;
+    if ((i = len[col & 1]) == 14)
+      pixel = pred[col & 1] = bits.get(16);
+    else
+      pixel = pred[col & 1] += bits.get(i) + 1 - (1 << (i - 1));
+    if ((pred[col & 1] >> 16) && !r.errors++)
+      r.fetched = bits.pos;
+    if (fmt == 5 && pixel < 256)
+      pixel = tone[pixel];
+    dest[col] = fmt == 8 ? pixel : ushort(pixel << 2);
+  }
+  r.len[0] = len[0];
+  r.len[1] = len[1];
+}
+
+void LibRaw::phase_one_c_decode_loop(void *data, int count)
+{
+  parallel_for(count, [&](int unit, int) { phase_one_c_decode_unit(data, unit); });
+}
+
+/* A row in the first pass, a run of carried rows in the second */
+void LibRaw::phase_one_c_decode_unit(void *data, int unit)
+{
+  const phase_one_c_strip_t *strip = (const phase_one_c_strip_t *)data;
+  phase_one_c_row_t *r = strip->rows;
+  const int end = strip->runs ? strip->runs[unit * 2 + 1] : unit + 1;
+  for (int k = strip->runs ? strip->runs[unit * 2] : unit; k < end; k++)
+  {
+    checkCancel();
+    phase_one_c_row(r[k],
+                    strip->runs ? (k ? r[k - 1].len : strip->carry) : NULL,
+                    &RAW(strip->first + k, 0), raw_width, ph1.format,
+                    order == 0x4949, strip->avail, curve);
+  }
+}
+
+void LibRaw::phase_one_load_raw_c()
+{
+  int *offset, row, i;
   short(*c_black)[2], (*r_black)[2];
   if (ph1.format == 6)
     throw LIBRAW_EXCEPTION_IO_CORRUPT;
 
-  pixel = (ushort *)calloc(raw_width * 3 + raw_height * 4, 2);
-  offset = (int *)(pixel + raw_width);
+  offset = (int *)calloc(raw_width * 2 + raw_height * 4, 2);
   fseek(ifp, strip_offset, SEEK_SET);
   for (row = 0; row < raw_height; row++)
     offset[row] = get4();
@@ -672,48 +812,125 @@ void LibRaw::phase_one_load_raw_c()
 
   for (i = 0; i < 256; i++)
     curve[i] = ushort(float(i * i) / 3.969f + 0.5f);
+
+  /* 16 bits per pixel and 12 per 8-pixel group at most, plus read-ahead */
+  const INT64 maxbytes = INT64(raw_width) * 2 + raw_width / 4 + 16;
+  const INT64 fsize = ifp->size();
+  std::vector<phase_one_c_row_t> rows;
+  std::vector<int> runs;
+  std::vector<uchar> buf;
   try
   {
-    for (row = 0; row < raw_height; row++)
+    rows.resize(raw_height);
+    runs.reserve(raw_height + 1);
+  }
+  catch (...)
+  {
+    free(offset);
+    throw LIBRAW_EXCEPTION_ALLOC;
+  }
+  INT64 lo = fsize;
+  for (row = 0; row < raw_height; row++)
+  {
+    INT64 pos = INT64(data_offset) + offset[row];
+    rows[row].pos = pos = LIM(pos, 0, fsize); // as fseek() clamps
+    rows[row].to_eof = fsize - pos;
+    lo = MIN(lo, pos);
+  }
+  free(offset);
+
+  const uchar *span =
+      libraw_internal_data.internal_data.input->get_span(lo, fsize - lo);
+  const int band =
+      span ? raw_height
+           : int(MAX(1, MIN(INT64(raw_height), (16 << 20) / maxbytes)));
+  if (!span)
+  {
+    try
     {
-      checkCancel();
-      fseek(ifp, data_offset + offset[row], SEEK_SET);
-      ph1_bits(-1);
-      pred[0] = pred[1] = 0;
-      for (col = 0; col < raw_width; col++)
+      buf.resize(size_t(band * maxbytes));
+    }
+    catch (...)
+    {
+      throw LIBRAW_EXCEPTION_ALLOC;
+    }
+  }
+  phase_one_c_strip_t strip;
+  strip.avail = span ? fsize : maxbytes;
+  strip.carry[0] = strip.carry[1] = 14;
+  for (int first = 0; first < raw_height; first += band)
+  {
+    const int count = MIN(band, raw_height - first);
+    phase_one_c_row_t *r = &rows[first];
+    if (span)
+      for (i = 0; i < count; i++)
+        r[i].src = span + (r[i].pos - lo);
+    else
+    {
+      /* one read if the rows are packed, else one per row */
+      INT64 blo = fsize, bhi = 0;
+      for (i = 0; i < count; i++)
       {
-        if (col >= (raw_width & -8))
-          len[0] = len[1] = 14;
-        else if ((col & 7) == 0)
-          for (i = 0; i < 2; i++)
-          {
-            for (j = 0; j < 5 && !ph1_bits(1); j++)
-              ;
-            if (j--)
-              len[i] = length[j * 2 + ph1_bits(1)];
-          }
-        if ((i = len[col & 1]) == 14)
-          pixel[col] = pred[col & 1] = ph1_bits(16);
-        else
-          pixel[col] = pred[col & 1] += ph1_bits(i) + 1 - (1 << (i - 1));
-        if (pred[col & 1] >> 16)
-          derror();
-        if (ph1.format == 5 && pixel[col] < 256)
-          pixel[col] = curve[pixel[col]];
+        blo = MIN(blo, r[i].pos);
+        bhi = MAX(bhi, r[i].pos + maxbytes);
+      }
+      bhi = MIN(bhi, fsize);
+      memset(buf.data(), 0xff, buf.size());
+      if (bhi - blo <= INT64(buf.size()))
+      {
+        fseek(ifp, blo, SEEK_SET);
+        fread(buf.data(), 1, size_t(bhi - blo), ifp);
+        for (i = 0; i < count; i++)
+          r[i].src = buf.data() + (r[i].pos - blo);
       }
-      if (ph1.format == 8)
-        memmove(&RAW(row, 0), &pixel[0], raw_width * 2);
       else
-        for (col = 0; col < raw_width; col++)
-          RAW(row, col) = pixel[col] << 2;
+        for (i = 0; i < count; i++)
+        {
+          uchar *dst = buf.data() + size_t(i * maxbytes);
+          fseek(ifp, r[i].pos, SEEK_SET);
+          fread(dst, 1, size_t(MIN(maxbytes, r[i].to_eof)), ifp);
+          r[i].src = dst;
+        }
     }
+    strip.rows = r;
+    strip.first = first;
+    strip.runs = NULL;
+    phase_one_c_decode_loop(&strip, count);
+
+    runs.clear();
+    for (i = 0; i < count; i++)
+      if (r[i].carried)
+      {
+        runs.push_back(i);
+        while (i + 1 < count && r[i + 1].carried)
+          i++;
+        runs.push_back(i + 1);
+      }
+    if (!runs.empty())
+    {
+      strip.runs = runs.data();
+      phase_one_c_decode_loop(&strip, int(runs.size() / 2));
+    }
+
+    /* report out of range predictions in row order, at the file position
+       they had */
+    for (i = 0; i < count; i++)
+      if (r[i].errors)
+      {
+        if (r[i].fetched < r[i].to_eof)
+          fseek(ifp, r[i].pos + r[i].fetched, SEEK_SET);
+        else
+        { // a read past the end, so that eof() holds for every stream
+          uchar c;
+          fseek(ifp, 0, SEEK_END);
+          fread(&c, 1, 1, ifp);
+        }
+        for (int e = 0; e < r[i].errors; e++)
+          derror();
+      }
+    strip.carry[0] = r[count - 1].len[0];
+    strip.carry[1] = r[count - 1].len[1];
   }
-  catch (...)
-  {
-    free(pixel);
-    throw;
-  }
-  free(pixel);
   maximum = 0xfffc - ph1.t_black;
 }
 
@@ -25,7 +25,7 @@ it under the terms of the one of two licenses as you choose:
   uint32_t bitstorage;
   LibRaw_abstract_datastream *input;
   std::vector<uint8_t> buffer;
-  uint8_t *bufp;
+  const uint8_t *bufp; // buffer.data() or in-memory stream data
   int pos, datasz;
   bool is_buf;
   buffered_bitpump_t(LibRaw_abstract_datastream *in, int bufsz) : bitcount(0), bitstorage(0), input(in),
@@ -34,6 +34,16 @@ it under the terms of the one of two licenses as you choose:
 	  is_buf = input->is_buffered();
 	  input->buffering_off();
 	  bufp = buffer.data();
+	  INT64 start = input->tell();
+	  INT64 left = input->size() - start;
+	  if (left > 0 && left < INT_MAX)
+	  {
+		  if (const uint8_t *span = input->get_span(start, left))
+		  {
+			  bufp = span;
+			  datasz = int(left);
+		  }
+	  }
     }
   ~buffered_bitpump_t()
   {
@@ -108,7 +118,12 @@ void skip_bit(uint32_t &vbits)
   }
   void refill(int b)
   {
-	  int r = input->read(bufp, 1, buffer.size());
+	  if (bufp != buffer.data()) // in-memory data exhausted
+	  {
+		  input->seek(0, SEEK_END);
+		  bufp = buffer.data();
+	  }
+	  int r = input->read(buffer.data(), 1, buffer.size());
 	  pos = 0;
 	  datasz = r > b ? r : b; 
   }
@@ -17,6 +17,7 @@ it under the terms of the one of two licenses as you choose:
 
 #include "../../internal/libraw_cxx_defs.h"
 #include <vector>
+#include <atomic>
 
  // in 8-byte words, 800kb
 #define PANA8_BUFSIZE 102400
@@ -27,6 +28,8 @@ public:
   pana8_bufio_t(LibRaw_abstract_datastream *stream, INT64 start, uint32_t len)
       : data(PANA8_BUFSIZE), input(stream), baseoffset(start), begin(0), end(0), _size(len)
   {
+    // whole qwords are read, same as read() below
+    span = input ? input->get_span(start, INT64(size())) : NULL;
   }
   uint32_t size() { return ((_size+7)/8)*8; }
   uint64_t getQWord(uint32_t offset)
@@ -43,6 +46,7 @@ public:
 
   std::vector<uint64_t> data;
   LibRaw_abstract_datastream *input;
+  const uchar *span; // not NULL: stream data is in memory, refill w/o read()
   INT64 baseoffset;
   INT64 begin, end;
   uint32_t _size;
@@ -78,10 +82,15 @@ void pana8_bufio_t::refill(uint32_t newoffset)
 	if (newoffset >= begin && newoffset < end)
 		return; 
 	uint32_t readwords, remainwords,toread;
-#ifdef LIBRAW_USE_OPENMP
-#pragma omp critical
+    if (span)
+    {
+      uint32_t startbyte = newoffset * sizeof(int64_t);
+      remainwords = startbyte < size() ? (size() - startbyte) >> 3 : 0;
+      toread = readwords = MIN(PANA8_BUFSIZE, remainwords);
+      memcpy(data.data(), span + startbyte, readwords * sizeof(uint64_t));
+    }
+    else
     {
-#endif
       input->lock();
       input->seek(baseoffset + newoffset*sizeof(int64_t), SEEK_SET);
       remainwords = (_size - newoffset*sizeof(int64_t) + 7) >> 3;
@@ -89,9 +98,7 @@ void pana8_bufio_t::refill(uint32_t newoffset)
       uint32_t readbytes = input->read(data.data(), 1, toread*sizeof(uint64_t));
 	  readwords = (readbytes + 7) >> 3;
       input->unlock();
-#ifdef LIBRAW_USE_OPENMP
     }
-#endif
 
   if (INT64(readwords) < INT64(toread) - 1LL)
     throw LIBRAW_EXCEPTION_IO_EOF;
@@ -129,21 +136,25 @@ void LibRaw::panasonicC8_load_raw()
 
 void LibRaw::pana8_decode_loop(void *data)
 {
-#ifdef LIBRAW_USE_OPENMP
-	int errs = 0, scount = MIN(5,libraw_internal_data.unpacker_data.pana8.stripe_count);
-#pragma omp parallel for 
+  int scount = MIN(5, libraw_internal_data.unpacker_data.pana8.stripe_count);
+  INT64 start = 0, end = 0;
   for (int stream = 0; stream < scount; stream++)
   {
-		if (pana8_decode_strip(data, stream))
-			errs++;
+    INT64 offset = libraw_internal_data.unpacker_data.pana8.stripe_offsets[stream];
+    INT64 last = offset + (INT64(libraw_internal_data.unpacker_data.pana8.stripe_compressed_size[stream]) + 63) / 64 * 8;
+    start = stream ? MIN(start, offset) : offset;
+    end = MAX(end, last);
   }
-	if(errs)
-      throw LIBRAW_EXCEPTION_IO_CORRUPT;
-#else
-  for (int stream = 0; stream < libraw_internal_data.unpacker_data.pana8.stripe_count && stream < 5; stream++)
+  LibRaw_parallel_input_scope input(libraw_internal_data.internal_data.input, start, end - start,
+                                    scount > 1 ? parallel_workers() : 1,
+                                    INT64(imgdata.rawparams.max_raw_memory_mb) * INT64(1024 * 1024));
+  std::atomic<int> errs(0);
+  parallel_for_workers(scount, input.workers(), [&](int stream, int) {
     if (pana8_decode_strip(data, stream))
-      throw LIBRAW_EXCEPTION_IO_CORRUPT;
-#endif
+      errs++;
+  });
+  if (errs)
+    throw LIBRAW_EXCEPTION_IO_CORRUPT;
 }
 
 int LibRaw::pana8_decode_strip(void* data, int stream)
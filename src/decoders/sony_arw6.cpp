@@ -17,6 +17,7 @@
 #include "../../internal/dcraw_defs.h"
 
 #include <algorithm>
+#include <new>
 #include <stdint.h>
 #include <string.h>
 #include <vector>
@@ -461,14 +462,12 @@ static bool sony_arw6_parse_stream_header(const uchar *stream,
 }
 
 static std::vector<SonyArw6StreamInfo>
-sony_arw6_find_streams(const std::vector<uchar> &strip, int full_width,
+sony_arw6_find_streams(const uchar *base, uint32_t strip_size, int full_width,
                        int full_height)
 {
   std::vector<SonyArw6StreamInfo> streams;
   if (full_width <= 0 || full_height <= 0)
     return streams;
-  const uint32_t strip_size = uint32_t(strip.size());
-  const uchar *base = strip_size ? &strip[0] : 0;
   if (!base || strip_size < SONY_ARW6_STREAM_OFFSET + 0x80)
     return streams;
 
@@ -1522,6 +1521,18 @@ static SonyArw6DecodedTile sony_arw6_decode_stream_tile(const uchar *stream,
   return out;
 }
 
+struct sony_arw6_decode_data_t
+{
+  sony_arw6_decode_data_t(const uchar *_strip, size_t _strip_size,
+                          const std::vector<SonyArw6StreamInfo> &_streams)
+      : strip(_strip), strip_size(_strip_size), streams(_streams)
+  {
+  }
+  const uchar *strip;
+  size_t strip_size;
+  const std::vector<SonyArw6StreamInfo> &streams;
+};
+
 } // namespace
 
 void LibRaw::sony_arw6_load_raw()
@@ -1538,14 +1549,22 @@ void LibRaw::sony_arw6_load_raw()
                       INT64(1024 * 1024))
     throw LIBRAW_EXCEPTION_ALLOC;
 
-  std::vector<uchar> strip(size_t(data_size));
-  ifp->seek(data_offset, SEEK_SET);
-  const int readed = ifp->read(&strip[0], 1, size_t(data_size));
-  if (readed != data_size)
-    throw LIBRAW_EXCEPTION_IO_EOF;
+  /* Memory-backed streams (buffer, mmap) are decoded in place */
+  std::vector<uchar> stripbuf;
+  const uchar *strip = ifp->get_span(data_offset, data_size);
+  if (!strip)
+  {
+    stripbuf.resize(size_t(data_size));
+    ifp->seek(data_offset, SEEK_SET);
+    const int readed = ifp->read(&stripbuf[0], 1, size_t(data_size));
+    if (readed != data_size)
+      throw LIBRAW_EXCEPTION_IO_EOF;
+    strip = &stripbuf[0];
+  }
+  const INT64 strip_bytes = INT64(stripbuf.size());
 
   const std::vector<SonyArw6StreamInfo> streams =
-      sony_arw6_find_streams(strip, raw_width, raw_height);
+      sony_arw6_find_streams(strip, uint32_t(data_size), raw_width, raw_height);
   sony_arw6_require(!streams.empty());
 
   INT64 max_tile_pixels = 0;
@@ -1558,61 +1577,83 @@ void LibRaw::sony_arw6_load_raw()
   const INT64 raw_bytes = INT64(raw_width) * raw_height *
                           INT64(sizeof(raw_image[0]));
   const INT64 working_bytes =
-      raw_bytes + data_size +
+      raw_bytes + strip_bytes +
       max_tile_pixels * SONY_ARW6_WORKING_BYTES_PER_TILE_PIXEL;
   if (working_bytes > sony_arw6_memory_limit_bytes(
                           imgdata.rawparams.max_raw_memory_mb))
     throw LIBRAW_EXCEPTION_ALLOC;
 
-  for (size_t si = 0; si < streams.size(); si++)
+  /* Each tile decoder keeps its own working planes, so the number of tiles
+     in flight is limited by what is left of max_raw_memory_mb */
+  const INT64 tile_bytes =
+      std::max(INT64(1), max_tile_pixels * SONY_ARW6_WORKING_BYTES_PER_TILE_PIXEL);
+  const INT64 max_parallel =
+      (sony_arw6_memory_limit_bytes(imgdata.rawparams.max_raw_memory_mb) -
+       raw_bytes - strip_bytes) / tile_bytes;
+
+  sony_arw6_decode_data_t ddata(strip, size_t(data_size), streams);
+  sony_arw6_decode_loop(&ddata, int(streams.size()),
+                        int(MIN(max_parallel, INT64(streams.size()))));
+}
+
+void LibRaw::sony_arw6_decode_loop(void *data, int count, int max_threads)
+{
+  parallel_for_workers(count, MAX(1, max_threads),
+                       [&](int tile, int) { sony_arw6_decode_tile(data, tile); });
+}
+
+void LibRaw::sony_arw6_decode_tile(void *data, int tile)
+{
+  const sony_arw6_decode_data_t *ddata = (const sony_arw6_decode_data_t *)data;
+  const uchar *strip = ddata->strip;
+  checkCancel();
+  sony_arw6_require(tile >= 0 && size_t(tile) < ddata->streams.size());
+  const SonyArw6StreamInfo &s = ddata->streams[tile];
+  sony_arw6_require(s.offset <= ddata->strip_size &&
+                    s.length <= ddata->strip_size - s.offset);
+  sony_arw6_require(s.tile_x >= 0 && s.tile_y >= 0 &&
+                    s.tile_w == s.coded_width &&
+                    s.tile_h == s.logical_height &&
+                    s.tile_x + s.tile_w <= raw_width &&
+                    s.tile_y + s.tile_h <= raw_height);
+
+  SonyArw6DecodedTile dtile =
+      sony_arw6_decode_stream_tile(&strip[s.offset], s.length);
+
+  const int half_h = s.logical_height / 2;
+  const int half_w = s.coded_width / 2;
+  sony_arw6_require(dtile.full_green.rows >= half_h &&
+                    dtile.full_green.cols == s.coded_width);
+  sony_arw6_require(dtile.green.rows >= half_h &&
+                    dtile.green.cols == half_w);
+  sony_arw6_require(dtile.red_residual.rows >= half_h &&
+                    dtile.red_residual.cols == half_w);
+  sony_arw6_require(dtile.blue_residual.rows >= half_h &&
+                    dtile.blue_residual.cols == half_w);
+
+  /* Tiles cover disjoint rectangles of raw_image: no locking needed */
+  for (int y = 0; y < half_h; y++)
   {
     checkCancel();
-    const SonyArw6StreamInfo &s = streams[si];
-    sony_arw6_require(s.offset <= strip.size() &&
-                      s.length <= strip.size() - s.offset);
-    sony_arw6_require(s.tile_x >= 0 && s.tile_y >= 0 &&
-                      s.tile_w == s.coded_width &&
-                      s.tile_h == s.logical_height &&
-                      s.tile_x + s.tile_w <= raw_width &&
-                      s.tile_y + s.tile_h <= raw_height);
-
-    SonyArw6DecodedTile tile =
-        sony_arw6_decode_stream_tile(&strip[s.offset], s.length);
-
-    const int half_h = s.logical_height / 2;
-    const int half_w = s.coded_width / 2;
-    sony_arw6_require(tile.full_green.rows >= half_h &&
-                      tile.full_green.cols == s.coded_width);
-    sony_arw6_require(tile.green.rows >= half_h &&
-                      tile.green.cols == half_w);
-    sony_arw6_require(tile.red_residual.rows >= half_h &&
-                      tile.red_residual.cols == half_w);
-    sony_arw6_require(tile.blue_residual.rows >= half_h &&
-                      tile.blue_residual.cols == half_w);
-
-    for (int y = 0; y < half_h; y++)
+    ushort *row0 =
+        raw_image + size_t(s.tile_y + y * 2) * raw_width + s.tile_x;
+    ushort *row1 =
+        raw_image + size_t(s.tile_y + y * 2 + 1) * raw_width + s.tile_x;
+    for (int x = 0; x < half_w; x++)
     {
-      checkCancel();
-      ushort *row0 =
-          raw_image + size_t(s.tile_y + y * 2) * raw_width + s.tile_x;
-      ushort *row1 =
-          raw_image + size_t(s.tile_y + y * 2 + 1) * raw_width + s.tile_x;
-      for (int x = 0; x < half_w; x++)
-      {
-        const int32_t g0 =
-            sony_arw6_clamp_signed_code(tile.full_green.at(y, x * 2));
-        const int32_t g1 =
-            sony_arw6_clamp_signed_code(tile.full_green.at(y, x * 2 + 1));
-        const int32_t gavg = sony_arw6_floor_shift(int64_t(g0) + g1, 1);
-        row0[x * 2] = sony_arw6_sample_from_signed(
-            gavg + 2 * tile.red_residual.at(y, x));
-        row0[x * 2 + 1] =
-            sony_arw6_sample_from_signed(tile.full_green.at(y, x * 2 + 1));
-        row1[x * 2] =
-            sony_arw6_sample_from_signed(tile.full_green.at(y, x * 2));
-        row1[x * 2 + 1] = sony_arw6_sample_from_signed(
-            gavg + 2 * tile.blue_residual.at(y, x));
-      }
+      const int32_t g0 =
+          sony_arw6_clamp_signed_code(dtile.full_green.at(y, x * 2));
+      const int32_t g1 =
+          sony_arw6_clamp_signed_code(dtile.full_green.at(y, x * 2 + 1));
+      const int32_t gavg = sony_arw6_floor_shift(int64_t(g0) + g1, 1);
+      row0[x * 2] = sony_arw6_sample_from_signed(
+          gavg + 2 * dtile.red_residual.at(y, x));
+      row0[x * 2 + 1] =
+          sony_arw6_sample_from_signed(dtile.full_green.at(y, x * 2 + 1));
+      row1[x * 2] =
+          sony_arw6_sample_from_signed(dtile.full_green.at(y, x * 2));
+      row1[x * 2 + 1] = sony_arw6_sample_from_signed(
+          gavg + 2 * dtile.blue_residual.at(y, x));
     }
   }
 }
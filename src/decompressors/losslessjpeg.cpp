@@ -19,6 +19,7 @@ it under the terms of the one of two licenses as you choose:
  */
 
 #include "../../internal/losslessjpeg.h"
+#include "../../internal/losslessjpeg_rows.h"
 #include <string.h>
 
 #define ZERO(a) do { memset(a,0,sizeof(a));} while(0)
@@ -37,13 +38,13 @@ bool ByteStreamBE::skip_to_marker() // true: success, false - no marker
 }
 
 LibRaw_LjpegDecompressor::LibRaw_LjpegDecompressor(uint8_t *b, unsigned bs, bool dngbug, bool csfix): buffer(b,bs),
-	state(State::NotInited)
+	predictor(0), point_transform(0), restart_interval(0), datastart(0), state(State::NotInited)
 {
 	initialize(dngbug,csfix);
 }
 
 LibRaw_LjpegDecompressor::LibRaw_LjpegDecompressor(uint8_t *b, unsigned bs): buffer(b,bs),
-	state(State::NotInited)
+	predictor(0), point_transform(0), restart_interval(0), datastart(0), state(State::NotInited)
 {
 	initialize(false,false);
 }
@@ -107,6 +108,15 @@ void LibRaw_LjpegDecompressor::initialize(bool dngbug, bool csfix)
 			state = State::EOIReached;
 			return;
 		}
+		else if (marker == Marker::DRI)
+		{
+          if (buffer.get_u16() != 4)
+          {
+            state = State::InvalidDRI;
+            return;
+          }
+          restart_interval = buffer.get_u16();
+		}
 		else if (marker == Marker::DQT)
 		{
           state = State::DQTPresent;
@@ -397,3 +407,174 @@ void HuffTable::initval(uint32_t _bits[17], uint32_t _huffval[256], bool _dng_bu
 	}
     initialized = true;
 }
+
+struct LibRaw_LjpegRowDecoderImpl
+{
+  LibRaw_LjpegDecompressor dec;
+  BitPumpJpeg pump;
+  HuffTable *huff[4];
+  uint32_t cps, samples, bits, currow;
+  int32_t vpred[4];
+  std::vector<uint16_t> rows;
+  uint32_t errors;
+
+  LibRaw_LjpegRowDecoderImpl(uint8_t *data, unsigned datasize)
+      : dec(data, datasize, false, false), pump(dec.buffer), cps(0), samples(0), bits(0), currow(0), errors(0)
+  {
+    ZERO(huff);
+    ZERO(vpred);
+  }
+  bool init();
+  uint16_t *next_row();
+};
+
+bool LibRaw_LjpegRowDecoderImpl::init()
+{
+  if (dec.state != LibRaw_LjpegDecompressor::State::OK || dec.restart_interval)
+    return false;
+  if (dec.sof.cps < 1 || dec.sof.cps > 4 || dec.sof.components.size() != dec.sof.cps)
+    return false;
+  if (dec.sof.components[0].subsample_h != 1 || dec.sof.components[0].subsample_v != 1)
+    return false;
+  if (dec.sof.width < 1 || dec.sof.height < 1 || dec.point_transform >= dec.sof.precision)
+    return false;
+  cps = dec.sof.cps;
+  for (uint32_t c = 0; c < cps; c++)
+  {
+    huff[c] = &dec.dhts[dec.sof.components[c].dc_tbl];
+    if (!huff[c]->initialized)
+      return false;
+  }
+  bits = dec.sof.precision - dec.point_transform;
+  samples = dec.sof.width * cps;
+  /* Same (zeroed) size as jh.row in ljpeg_start(): some callers
+     (lossless_dng_load_raw) read past the current row */
+  rows.assign(size_t(samples) * 8, 0);
+  for (uint32_t c = 0; c < cps; c++)
+    vpred[c] = 1 << (bits - 1);
+  return true;
+}
+
+template <int PSV>
+static inline int32_t ljpeg_predict(int32_t left, int32_t up, int32_t upleft)
+{
+  switch (PSV)
+  {
+  case 1:
+    return left;
+  case 2:
+    return up;
+  case 3:
+    return upleft;
+  case 4:
+    return left + up - upleft;
+  case 5:
+    return left + ((up - upleft) >> 1);
+  case 6:
+    return up + ((left - upleft) >> 1);
+  case 7:
+    return (left + up) >> 1;
+  default:
+    return 0;
+  }
+}
+
+template <int PSV>
+static void ljpeg_decode_row(LibRaw_LjpegRowDecoderImpl &d, uint16_t *row, const uint16_t *prev)
+{
+  const uint32_t cps = d.cps;
+  for (uint32_t col = cps; col < d.samples; col += cps)
+    for (uint32_t c = 0; c < cps; c++)
+    {
+      int32_t diff = d.huff[c]->decode(d.pump);
+      uint32_t i = col + c;
+      uint16_t val = uint16_t(ljpeg_predict<PSV>(row[i - cps], prev[i], prev[i - cps]) + diff);
+      row[i] = val;
+      if (val >> d.bits)
+        d.errors++;
+    }
+}
+
+uint16_t *LibRaw_LjpegRowDecoderImpl::next_row()
+{
+  if (currow >= dec.sof.height)
+    return 0;
+  uint16_t *row = &rows[(currow & 1) * size_t(samples)];
+  const uint16_t *prev = &rows[((currow + 1) & 1) * size_t(samples)];
+
+  // The first column is predicted from the first column of the previous row
+  for (uint32_t c = 0; c < cps; c++)
+  {
+    int32_t diff = huff[c]->decode(pump);
+    uint16_t val = uint16_t(vpred[c] + diff);
+    vpred[c] += diff;
+    row[c] = val;
+    if (val >> bits)
+      errors++;
+  }
+
+  if (currow == 0)
+    ljpeg_decode_row<1>(*this, row, prev);
+  else
+    switch (dec.predictor)
+    {
+    case 1:
+      ljpeg_decode_row<1>(*this, row, prev);
+      break;
+    case 2:
+      ljpeg_decode_row<2>(*this, row, prev);
+      break;
+    case 3:
+      ljpeg_decode_row<3>(*this, row, prev);
+      break;
+    case 4:
+      ljpeg_decode_row<4>(*this, row, prev);
+      break;
+    case 5:
+      ljpeg_decode_row<5>(*this, row, prev);
+      break;
+    case 6:
+      ljpeg_decode_row<6>(*this, row, prev);
+      break;
+    case 7:
+      ljpeg_decode_row<7>(*this, row, prev);
+      break;
+    default:
+      ljpeg_decode_row<0>(*this, row, prev);
+      break;
+    }
+  currow++;
+  return row;
+}
+
+LibRaw_LjpegRowDecoder::LibRaw_LjpegRowDecoder(uint8_t *data, unsigned datasize)
+    : impl(0), _valid(false), _width(0), _height(0), _cps(0), _bits(0), _errors(0)
+{
+  try
+  {
+    impl = new LibRaw_LjpegRowDecoderImpl(data, datasize);
+    _valid = impl->init();
+  }
+  catch (...) // Broken headers/tables: let the caller use the old decoder
+  {
+    _valid = false;
+  }
+  if (_valid)
+  {
+    _width = impl->dec.sof.width;
+    _height = impl->dec.sof.height;
+    _cps = impl->cps;
+    _bits = impl->bits;
+  }
+}
+
+LibRaw_LjpegRowDecoder::~LibRaw_LjpegRowDecoder() { delete impl; }
+
+uint16_t *LibRaw_LjpegRowDecoder::next_row()
+{
+  if (!_valid)
+    return 0;
+  uint16_t *ret = impl->next_row();
+  _errors = impl->errors;
+  return ret;
+}
@@ -20,21 +20,16 @@
 typedef ushort ushort3[3];
 typedef int int3[3];
 
-#ifndef Pnw
-#define Pnw (-1 - nr_width)
-#define Pn (-nr_width)
-#define Pne (+1 - nr_width)
-#define Pe (+1)
-#define Pse (+1 + nr_width)
-#define Ps (+nr_width)
-#define Psw (-1 + nr_width)
-#define Pw (-1)
-#endif
-
 struct AAHD
 {
   int nr_height, nr_width;
   static const int nr_margin = 4;
+  /*
+   * the working buffers keep only the last nr_ring rows (nr rows y and
+   * y + nr_ring share the same storage), see interpolate()
+   */
+  static const int nr_ring = 64;
+  static const int nr_band = 256;
   static const int Thot = 4;
   static const int Tdead = 4;
   static const int OverFraction = 8;
@@ -78,22 +73,38 @@ struct AAHD
   }
   inline int nr_offset(int row, int col) throw()
   {
-    return (row * nr_width + col);
+    return ((row & (nr_ring - 1)) * nr_width + col);
+  }
+  /*
+   * сумма квадратов второй производной YUV в точке (y, x) по направлению
+   * (dy, dx)
+   */
+  inline int yuv_grad(int3 *p, int y, int x, int dy, int dx) throw()
+  {
+    int3 &c = p[nr_offset(y, x)];
+    int3 &a = p[nr_offset(y - dy, x - dx)];
+    int3 &b = p[nr_offset(y + dy, x + dx)];
+    return SQR(2 * c[0] - a[0] - b[0]) + SQR(2 * c[1] - a[1] - b[1]) +
+           SQR(2 * c[2] - a[2] - b[2]);
   }
-  ~AAHD();
   AAHD(LibRaw &_libraw);
-  void make_ahd_greens();
+  size_t buffer_size()
+  {
+    return size_t(nr_ring) * nr_width *
+           (sizeof(int3) * 2 + sizeof(ushort3) * 2 + 3);
+  }
+  void interpolate(char *buffer, int top, int bottom);
+  void load_row(int y);
   void make_ahd_gline(int i);
-  void make_ahd_rb();
   void make_ahd_rb_hv(int i);
   void make_ahd_rb_last(int i);
-  void evaluate_ahd();
-  void combine_image();
-  void hide_hots();
-  void refine_hv_dirs();
+  void make_yuv(int y);
+  void evaluate_homo(int i);
+  void evaluate_dirs(int i);
+  void combine_image(int i);
+  void hide_hots(int i);
   void refine_hv_dirs(int i, int js);
   void refine_ihv_dirs(int i);
-  void illustrate_dirs();
   void illustrate_dline(int i);
 };
 
@@ -130,17 +141,9 @@ AAHD::AAHD(LibRaw &_libraw) : libraw(_libraw)
 {
   nr_height = libraw.imgdata.sizes.iheight + nr_margin * 2;
   nr_width = libraw.imgdata.sizes.iwidth + nr_margin * 2;
-  rgb_ahd[0] = (ushort3 *)calloc(nr_height * nr_width,
-                                 (sizeof(ushort3) * 2 + sizeof(int3) * 2 + 3));
-  if (!rgb_ahd[0])
-    throw LIBRAW_EXCEPTION_ALLOC;
-
-  rgb_ahd[1] = rgb_ahd[0] + nr_height * nr_width;
-  yuv[0] = (int3 *)(rgb_ahd[1] + nr_height * nr_width);
-  yuv[1] = yuv[0] + nr_height * nr_width;
-  ndir = (char *)(yuv[1] + nr_height * nr_width);
-  homo[0] = ndir + nr_height * nr_width;
-  homo[1] = homo[0] + nr_height * nr_width;
+  rgb_ahd[0] = rgb_ahd[1] = 0;
+  yuv[0] = yuv[1] = 0;
+  ndir = homo[0] = homo[1] = 0;
   channel_maximum[0] = channel_maximum[1] = channel_maximum[2] = 0;
   channel_minimum[0] = libraw.imgdata.image[0][0];
   channel_minimum[1] = libraw.imgdata.image[0][1];
@@ -163,8 +166,16 @@ AAHD::AAHD(LibRaw &_libraw) : libraw(_libraw)
           0x10000 * (r < 0.0181 ? 4.5f * r : 1.0993f * pow(r, 0.45f) - .0993f);
     }
   }
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
-  {
+  int workers = libraw.parallel_workers();
+  std::vector<ushort> wmax(workers * 3), wmin(workers * 3);
+  for (int w = 0; w < workers; ++w)
+    for (int c = 0; c < 3; ++c)
+    {
+      wmax[w * 3 + c] = channel_maximum[c];
+      wmin[w * 3 + c] = channel_minimum[c];
+    }
+  libraw.parallel_for(libraw.imgdata.sizes.iheight, [&](int i, int worker) {
+    ushort *cmax = &wmax[worker * 3], *cmin = &wmin[worker * 3];
     int col_cache[48];
     for (int j = 0; j < 48; ++j)
     {
@@ -173,136 +184,178 @@ AAHD::AAHD(LibRaw &_libraw) : libraw(_libraw)
         c = 1;
       col_cache[j] = c;
     }
-    int moff = nr_offset(i + nr_margin, nr_margin);
-    for (int j = 0; j < iwidth; ++j, ++moff)
+    for (int j = 0; j < iwidth; ++j)
     {
       int c = col_cache[j % 48];
       unsigned short d = libraw.imgdata.image[i * iwidth + j][c];
       if (d != 0)
       {
-        if (channel_maximum[c] < d)
-          channel_maximum[c] = d;
-        if (channel_minimum[c] > d)
-          channel_minimum[c] = d;
-        rgb_ahd[1][moff][c] = rgb_ahd[0][moff][c] = d;
+        if (cmax[c] < d)
+          cmax[c] = d;
+        if (cmin[c] > d)
+          cmin[c] = d;
       }
     }
-  }
+  });
+  for (int w = 0; w < workers; ++w)
+    for (int c = 0; c < 3; ++c)
+    {
+      if (channel_maximum[c] < wmax[w * 3 + c])
+        channel_maximum[c] = wmax[w * 3 + c];
+      if (channel_minimum[c] > wmin[w * 3 + c])
+        channel_minimum[c] = wmin[w * 3 + c];
+    }
   channels_max =
       MAX(MAX(channel_maximum[0], channel_maximum[1]), channel_maximum[2]);
 }
 
-void AAHD::hide_hots()
+/*
+ * загрузка строки y (с учётом полей) в рабочие буферы
+ */
+void AAHD::load_row(int y)
+{
+  int iwidth = libraw.imgdata.sizes.iwidth;
+  int i = y - nr_margin;
+  int moff = nr_offset(y, 0);
+  for (int x = 0; x < nr_width; ++x)
+  {
+    for (int c = 0; c < 3; ++c)
+      rgb_ahd[0][moff + x][c] = rgb_ahd[1][moff + x][c] = 0;
+    ndir[moff + x] = homo[0][moff + x] = homo[1][moff + x] = 0;
+  }
+  if (i < 0 || i >= libraw.imgdata.sizes.iheight)
+    return;
+  int col_cache[48];
+  for (int j = 0; j < 48; ++j)
+  {
+    int c = libraw.COLOR(i, j);
+    if (c == 3)
+      c = 1;
+    col_cache[j] = c;
+  }
+  moff += nr_margin;
+  for (int j = 0; j < iwidth; ++j, ++moff)
+  {
+    int c = col_cache[j % 48];
+    unsigned short d = libraw.imgdata.image[i * iwidth + j][c];
+    if (d != 0)
+      rgb_ahd[1][moff][c] = rgb_ahd[0][moff][c] = d;
+  }
+}
+
+void AAHD::hide_hots(int i)
 {
   int iwidth = libraw.imgdata.sizes.iwidth;
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
+  int js = libraw.COLOR(i, 0) & 1;
+  int kc = libraw.COLOR(i, js);
+  /*
+   * js -- начальная х-координата, которая попадает мимо известного зелёного
+   * kc -- известный цвет в точке интерполирования
+   */
+  ushort3 *rgb = rgb_ahd[0];
+  int y = i + nr_margin;
+  for (int j = js; j < iwidth; j += 2)
   {
-    int js = libraw.COLOR(i, 0) & 1;
-    int kc = libraw.COLOR(i, js);
-    /*
-     * js -- начальная х-координата, которая попадает мимо известного зелёного
-     * kc -- известный цвет в точке интерполирования
-     */
-    int moff = nr_offset(i + nr_margin, nr_margin + js);
-    for (int j = js; j < iwidth; j += 2, moff += 2)
+    int x = j + nr_margin;
+    int c = rgb[nr_offset(y, x)][kc];
+    if ((c > rgb[nr_offset(y, x + 2)][kc] && c > rgb[nr_offset(y, x - 2)][kc] &&
+         c > rgb[nr_offset(y - 2, x)][kc] && c > rgb[nr_offset(y + 2, x)][kc] &&
+         c > rgb[nr_offset(y, x + 1)][1] && c > rgb[nr_offset(y, x - 1)][1] &&
+         c > rgb[nr_offset(y - 1, x)][1] && c > rgb[nr_offset(y + 1, x)][1]) ||
+        (c < rgb[nr_offset(y, x + 2)][kc] && c < rgb[nr_offset(y, x - 2)][kc] &&
+         c < rgb[nr_offset(y - 2, x)][kc] && c < rgb[nr_offset(y + 2, x)][kc] &&
+         c < rgb[nr_offset(y, x + 1)][1] && c < rgb[nr_offset(y, x - 1)][1] &&
+         c < rgb[nr_offset(y - 1, x)][1] && c < rgb[nr_offset(y + 1, x)][1]))
     {
-      ushort3 *rgb = &rgb_ahd[0][moff];
-      int c = rgb[0][kc];
-      if ((c > rgb[2 * Pe][kc] && c > rgb[2 * Pw][kc] && c > rgb[2 * Pn][kc] &&
-           c > rgb[2 * Ps][kc] && c > rgb[Pe][1] && c > rgb[Pw][1] &&
-           c > rgb[Pn][1] && c > rgb[Ps][1]) ||
-          (c < rgb[2 * Pe][kc] && c < rgb[2 * Pw][kc] && c < rgb[2 * Pn][kc] &&
-           c < rgb[2 * Ps][kc] && c < rgb[Pe][1] && c < rgb[Pw][1] &&
-           c < rgb[Pn][1] && c < rgb[Ps][1]))
-      {
-        int chot = c >> Thot;
-        int cdead = c << Tdead;
-        int avg = 0;
-        for (int k = -2; k < 3; k += 2)
-          for (int m = -2; m < 3; m += 2)
-            if (m == 0 && k == 0)
-              continue;
-            else
-              avg += rgb[nr_offset(k, m)][kc];
-        avg /= 8;
-        if (chot > avg || cdead < avg)
-        {
-          ndir[moff] |= HOT;
-          int dh =
-              ABS(rgb[2 * Pw][kc] - rgb[2 * Pe][kc]) +
-              ABS(rgb[Pw][1] - rgb[Pe][1]) +
-              ABS(rgb[Pw][1] - rgb[Pe][1] + rgb[2 * Pe][kc] - rgb[2 * Pw][kc]);
-          int dv =
-              ABS(rgb[2 * Pn][kc] - rgb[2 * Ps][kc]) +
-              ABS(rgb[Pn][1] - rgb[Ps][1]) +
-              ABS(rgb[Pn][1] - rgb[Ps][1] + rgb[2 * Ps][kc] - rgb[2 * Pn][kc]);
-          int d;
-          if (dv > dh)
-            d = Pw;
+      int chot = c >> Thot;
+      int cdead = c << Tdead;
+      int avg = 0;
+      for (int k = -2; k < 3; k += 2)
+        for (int m = -2; m < 3; m += 2)
+          if (m == 0 && k == 0)
+            continue;
           else
-            d = Pn;
-          rgb_ahd[1][moff][kc] = rgb[0][kc] =
-              (rgb[+2 * d][kc] + rgb[-2 * d][kc]) / 2;
-        }
+            avg += rgb[nr_offset(y + k, x + m)][kc];
+      avg /= 8;
+      if (chot > avg || cdead < avg)
+      {
+        ndir[nr_offset(y, x)] |= HOT;
+        int dh = ABS(rgb[nr_offset(y, x - 2)][kc] - rgb[nr_offset(y, x + 2)][kc]) +
+                 ABS(rgb[nr_offset(y, x - 1)][1] - rgb[nr_offset(y, x + 1)][1]) +
+                 ABS(rgb[nr_offset(y, x - 1)][1] - rgb[nr_offset(y, x + 1)][1] +
+                     rgb[nr_offset(y, x + 2)][kc] - rgb[nr_offset(y, x - 2)][kc]);
+        int dv = ABS(rgb[nr_offset(y - 2, x)][kc] - rgb[nr_offset(y + 2, x)][kc]) +
+                 ABS(rgb[nr_offset(y - 1, x)][1] - rgb[nr_offset(y + 1, x)][1]) +
+                 ABS(rgb[nr_offset(y - 1, x)][1] - rgb[nr_offset(y + 1, x)][1] +
+                     rgb[nr_offset(y + 2, x)][kc] - rgb[nr_offset(y - 2, x)][kc]);
+        int e;
+        if (dv > dh)
+          e = (rgb[nr_offset(y, x - 2)][kc] + rgb[nr_offset(y, x + 2)][kc]) / 2;
+        else
+          e = (rgb[nr_offset(y - 2, x)][kc] + rgb[nr_offset(y + 2, x)][kc]) / 2;
+        rgb_ahd[1][nr_offset(y, x)][kc] = rgb[nr_offset(y, x)][kc] = e;
       }
     }
-    js ^= 1;
-    moff = nr_offset(i + nr_margin, nr_margin + js);
-    for (int j = js; j < iwidth; j += 2, moff += 2)
+  }
+  js ^= 1;
+  for (int j = js; j < iwidth; j += 2)
+  {
+    int x = j + nr_margin;
+    int c = rgb[nr_offset(y, x)][1];
+    if ((c > rgb[nr_offset(y, x + 2)][1] && c > rgb[nr_offset(y, x - 2)][1] &&
+         c > rgb[nr_offset(y - 2, x)][1] && c > rgb[nr_offset(y + 2, x)][1] &&
+         c > rgb[nr_offset(y, x + 1)][kc] && c > rgb[nr_offset(y, x - 1)][kc] &&
+         c > rgb[nr_offset(y - 1, x)][kc ^ 2] &&
+         c > rgb[nr_offset(y + 1, x)][kc ^ 2]) ||
+        (c < rgb[nr_offset(y, x + 2)][1] && c < rgb[nr_offset(y, x - 2)][1] &&
+         c < rgb[nr_offset(y - 2, x)][1] && c < rgb[nr_offset(y + 2, x)][1] &&
+         c < rgb[nr_offset(y, x + 1)][kc] && c < rgb[nr_offset(y, x - 1)][kc] &&
+         c < rgb[nr_offset(y - 1, x)][kc ^ 2] &&
+         c < rgb[nr_offset(y + 1, x)][kc ^ 2]))
     {
-      ushort3 *rgb = &rgb_ahd[0][moff];
-      int c = rgb[0][1];
-      if ((c > rgb[2 * Pe][1] && c > rgb[2 * Pw][1] && c > rgb[2 * Pn][1] &&
-           c > rgb[2 * Ps][1] && c > rgb[Pe][kc] && c > rgb[Pw][kc] &&
-           c > rgb[Pn][kc ^ 2] && c > rgb[Ps][kc ^ 2]) ||
-          (c < rgb[2 * Pe][1] && c < rgb[2 * Pw][1] && c < rgb[2 * Pn][1] &&
-           c < rgb[2 * Ps][1] && c < rgb[Pe][kc] && c < rgb[Pw][kc] &&
-           c < rgb[Pn][kc ^ 2] && c < rgb[Ps][kc ^ 2]))
-      {
-        int chot = c >> Thot;
-        int cdead = c << Tdead;
-        int avg = 0;
-        for (int k = -2; k < 3; k += 2)
-          for (int m = -2; m < 3; m += 2)
-            if (k == 0 && m == 0)
-              continue;
-            else
-              avg += rgb[nr_offset(k, m)][1];
-        avg /= 8;
-        if (chot > avg || cdead < avg)
-        {
-          ndir[moff] |= HOT;
-          int dh =
-              ABS(rgb[2 * Pw][1] - rgb[2 * Pe][1]) +
-              ABS(rgb[Pw][kc] - rgb[Pe][kc]) +
-              ABS(rgb[Pw][kc] - rgb[Pe][kc] + rgb[2 * Pe][1] - rgb[2 * Pw][1]);
-          int dv = ABS(rgb[2 * Pn][1] - rgb[2 * Ps][1]) +
-                   ABS(rgb[Pn][kc ^ 2] - rgb[Ps][kc ^ 2]) +
-                   ABS(rgb[Pn][kc ^ 2] - rgb[Ps][kc ^ 2] + rgb[2 * Ps][1] -
-                       rgb[2 * Pn][1]);
-          int d;
-          if (dv > dh)
-            d = Pw;
+      int chot = c >> Thot;
+      int cdead = c << Tdead;
+      int avg = 0;
+      for (int k = -2; k < 3; k += 2)
+        for (int m = -2; m < 3; m += 2)
+          if (k == 0 && m == 0)
+            continue;
           else
-            d = Pn;
-          rgb_ahd[1][moff][1] = rgb[0][1] =
-              (rgb[+2 * d][1] + rgb[-2 * d][1]) / 2;
-        }
+            avg += rgb[nr_offset(y + k, x + m)][1];
+      avg /= 8;
+      if (chot > avg || cdead < avg)
+      {
+        ndir[nr_offset(y, x)] |= HOT;
+        int dh = ABS(rgb[nr_offset(y, x - 2)][1] - rgb[nr_offset(y, x + 2)][1]) +
+                 ABS(rgb[nr_offset(y, x - 1)][kc] - rgb[nr_offset(y, x + 1)][kc]) +
+                 ABS(rgb[nr_offset(y, x - 1)][kc] - rgb[nr_offset(y, x + 1)][kc] +
+                     rgb[nr_offset(y, x + 2)][1] - rgb[nr_offset(y, x - 2)][1]);
+        int dv =
+            ABS(rgb[nr_offset(y - 2, x)][1] - rgb[nr_offset(y + 2, x)][1]) +
+            ABS(rgb[nr_offset(y - 1, x)][kc ^ 2] -
+                rgb[nr_offset(y + 1, x)][kc ^ 2]) +
+            ABS(rgb[nr_offset(y - 1, x)][kc ^ 2] -
+                rgb[nr_offset(y + 1, x)][kc ^ 2] +
+                rgb[nr_offset(y + 2, x)][1] - rgb[nr_offset(y - 2, x)][1]);
+        int e;
+        if (dv > dh)
+          e = (rgb[nr_offset(y, x - 2)][1] + rgb[nr_offset(y, x + 2)][1]) / 2;
+        else
+          e = (rgb[nr_offset(y - 2, x)][1] + rgb[nr_offset(y + 2, x)][1]) / 2;
+        rgb_ahd[1][nr_offset(y, x)][1] = rgb[nr_offset(y, x)][1] = e;
       }
     }
   }
 }
 
-void AAHD::evaluate_ahd()
+/*
+ * YUV строки y (с учётом полей)
+ */
+void AAHD::make_yuv(int y)
 {
-  int hvdir[4] = {Pw, Pe, Pn, Ps};
-  /*
-   * YUV
-   *
-   */
   for (int d = 0; d < 2; ++d)
   {
-    for (int i = 0; i < nr_width * nr_height; ++i)
+    for (int i = nr_offset(y, 0), k = 0; k < nr_width; ++i, ++k)
     {
       ushort3 rgb;
       for (int c = 0; c < 3; ++c)
@@ -350,193 +403,176 @@ void AAHD::evaluate_ahd()
    }
    }
    * Lab */
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
+}
+
+/*
+ * счётчики гомогенности увеличиваются на расстоянии до 3 строк от строки i
+ */
+void AAHD::evaluate_homo(int i)
+{
+  static const int hvdir[4][2] = {{0, -1}, {0, 1}, {-1, 0}, {1, 0}};
+  int y = i + nr_margin;
+  for (int j = 0; j < libraw.imgdata.sizes.iwidth; j++)
   {
-    int moff = nr_offset(i + nr_margin, nr_margin);
-    for (int j = 0; j < libraw.imgdata.sizes.iwidth; j++, ++moff)
+    int x = j + nr_margin;
+    int3 *ynr;
+    float ydiff[2][4];
+    int uvdiff[2][4];
+    for (int d = 0; d < 2; ++d)
     {
-      int3 *ynr;
-      float ydiff[2][4];
-      int uvdiff[2][4];
-      for (int d = 0; d < 2; ++d)
+      ynr = &yuv[d][nr_offset(y, x)];
+      for (int k = 0; k < 4; k++)
       {
-        ynr = &yuv[d][moff];
-        for (int k = 0; k < 4; k++)
-        {
-          ydiff[d][k] = float(ABS(ynr[0][0] - ynr[hvdir[k]][0]));
-          uvdiff[d][k] = SQR(ynr[0][1] - ynr[hvdir[k]][1]) +
-                         SQR(ynr[0][2] - ynr[hvdir[k]][2]);
-        }
+        int3 &yk = yuv[d][nr_offset(y + hvdir[k][0], x + hvdir[k][1])];
+        ydiff[d][k] = float(ABS(ynr[0][0] - yk[0]));
+        uvdiff[d][k] = SQR(ynr[0][1] - yk[1]) + SQR(ynr[0][2] - yk[2]);
       }
-      float yeps =
-          MIN(MAX(ydiff[0][0], ydiff[0][1]), MAX(ydiff[1][2], ydiff[1][3]));
-      int uveps =
-          MIN(MAX(uvdiff[0][0], uvdiff[0][1]), MAX(uvdiff[1][2], uvdiff[1][3]));
-      for (int d = 0; d < 2; d++)
-      {
-        ynr = &yuv[d][moff];
-        for (int k = 0; k < 4; k++)
-          if (ydiff[d][k] <= yeps && uvdiff[d][k] <= uveps)
+    }
+    float yeps =
+        MIN(MAX(ydiff[0][0], ydiff[0][1]), MAX(ydiff[1][2], ydiff[1][3]));
+    int uveps =
+        MIN(MAX(uvdiff[0][0], uvdiff[0][1]), MAX(uvdiff[1][2], uvdiff[1][3]));
+    for (int d = 0; d < 2; d++)
+    {
+      ynr = &yuv[d][nr_offset(y, x)];
+      for (int k = 0; k < 4; k++)
+        if (ydiff[d][k] <= yeps && uvdiff[d][k] <= uveps)
+        {
+          homo[d][nr_offset(y + hvdir[k][0], x + hvdir[k][1])]++;
+          if (k / 2 == d)
           {
-            homo[d][moff + hvdir[k]]++;
-            if (k / 2 == d)
+            // если в сонаправленном направлении интеполяции следующие точки
+            // так же гомогенны, учтём их тоже
+            for (int m = 2; m < 4; ++m)
             {
-              // если в сонаправленном направлении интеполяции следующие точки
-              // так же гомогенны, учтём их тоже
-              for (int m = 2; m < 4; ++m)
+              int hy = y + m * hvdir[k][0], hx = x + m * hvdir[k][1];
+              int3 &yh = yuv[d][nr_offset(hy, hx)];
+              if (ABS(ynr[0][0] - yh[0]) < yeps &&
+                  SQR(ynr[0][1] - yh[1]) + SQR(ynr[0][2] - yh[2]) < uveps)
               {
-                int hvd = m * hvdir[k];
-                if (ABS(ynr[0][0] - ynr[hvd][0]) < yeps &&
-                    SQR(ynr[0][1] - ynr[hvd][1]) +
-                            SQR(ynr[0][2] - ynr[hvd][2]) <
-                        uveps)
-                {
-                  homo[d][moff + hvd]++;
-                }
-                else
-                  break;
+                homo[d][nr_offset(hy, hx)]++;
               }
+              else
+                break;
             }
           }
-      }
-    }
-  }
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
-  {
-    int moff = nr_offset(i + nr_margin, nr_margin);
-    for (int j = 0; j < libraw.imgdata.sizes.iwidth; j++, ++moff)
-    {
-      char hm[2];
-      for (int d = 0; d < 2; d++)
-      {
-        hm[d] = 0;
-        char *hh = &homo[d][moff];
-        for (int hx = -1; hx < 2; hx++)
-          for (int hy = -1; hy < 2; hy++)
-            hm[d] += hh[nr_offset(hy, hx)];
-      }
-      char d = 0;
-      if (hm[0] != hm[1])
-      {
-        if (hm[1] > hm[0])
-        {
-          d = VERSH;
-        }
-        else
-        {
-          d = HORSH;
         }
-      }
-      else
-      {
-        int3 *ynr = &yuv[1][moff];
-        int gv = SQR(2 * ynr[0][0] - ynr[Pn][0] - ynr[Ps][0]);
-        gv += SQR(2 * ynr[0][1] - ynr[Pn][1] - ynr[Ps][1]) +
-              SQR(2 * ynr[0][2] - ynr[Pn][2] - ynr[Ps][2]);
-        ynr = &yuv[1][moff + Pn];
-        gv += (SQR(2 * ynr[0][0] - ynr[Pn][0] - ynr[Ps][0]) +
-               SQR(2 * ynr[0][1] - ynr[Pn][1] - ynr[Ps][1]) +
-               SQR(2 * ynr[0][2] - ynr[Pn][2] - ynr[Ps][2])) /
-              2;
-        ynr = &yuv[1][moff + Ps];
-        gv += (SQR(2 * ynr[0][0] - ynr[Pn][0] - ynr[Ps][0]) +
-               SQR(2 * ynr[0][1] - ynr[Pn][1] - ynr[Ps][1]) +
-               SQR(2 * ynr[0][2] - ynr[Pn][2] - ynr[Ps][2])) /
-              2;
-        ynr = &yuv[0][moff];
-        int gh = SQR(2 * ynr[0][0] - ynr[Pw][0] - ynr[Pe][0]);
-        gh += SQR(2 * ynr[0][1] - ynr[Pw][1] - ynr[Pe][1]) +
-              SQR(2 * ynr[0][2] - ynr[Pw][2] - ynr[Pe][2]);
-        ynr = &yuv[0][moff + Pw];
-        gh += (SQR(2 * ynr[0][0] - ynr[Pw][0] - ynr[Pe][0]) +
-               SQR(2 * ynr[0][1] - ynr[Pw][1] - ynr[Pe][1]) +
-               SQR(2 * ynr[0][2] - ynr[Pw][2] - ynr[Pe][2])) /
-              2;
-        ynr = &yuv[0][moff + Pe];
-        gh += (SQR(2 * ynr[0][0] - ynr[Pw][0] - ynr[Pe][0]) +
-               SQR(2 * ynr[0][1] - ynr[Pw][1] - ynr[Pe][1]) +
-               SQR(2 * ynr[0][2] - ynr[Pw][2] - ynr[Pe][2])) /
-              2;
-        if (gv > gh)
-          d = HOR;
-        else
-          d = VER;
-      }
-      ndir[moff] |= d;
     }
   }
 }
 
-void AAHD::combine_image()
+/*
+ * направления интерполяции для строки i
+ */
+void AAHD::evaluate_dirs(int i)
 {
-  for (int i = 0, i_out = 0; i < libraw.imgdata.sizes.iheight; ++i)
+  int y = i + nr_margin;
+  for (int j = 0; j < libraw.imgdata.sizes.iwidth; j++)
   {
-    int moff = nr_offset(i + nr_margin, nr_margin);
-    for (int j = 0; j < libraw.imgdata.sizes.iwidth; j++, ++moff, ++i_out)
+    int x = j + nr_margin;
+    char hm[2];
+    for (int d = 0; d < 2; d++)
     {
-      if (ndir[moff] & HOT)
-      {
-        int c = libraw.COLOR(i, j);
-        rgb_ahd[1][moff][c] = rgb_ahd[0][moff][c] =
-            libraw.imgdata.image[i_out][c];
-      }
-      if (ndir[moff] & VER)
+      hm[d] = 0;
+      for (int hx = -1; hx < 2; hx++)
+        for (int hy = -1; hy < 2; hy++)
+          hm[d] += homo[d][nr_offset(y + hy, x + hx)];
+    }
+    char d = 0;
+    if (hm[0] != hm[1])
+    {
+      if (hm[1] > hm[0])
       {
-        libraw.imgdata.image[i_out][0] = rgb_ahd[1][moff][0];
-        libraw.imgdata.image[i_out][3] = libraw.imgdata.image[i_out][1] =
-            rgb_ahd[1][moff][1];
-        libraw.imgdata.image[i_out][2] = rgb_ahd[1][moff][2];
+        d = VERSH;
       }
       else
       {
-        libraw.imgdata.image[i_out][0] = rgb_ahd[0][moff][0];
-        libraw.imgdata.image[i_out][3] = libraw.imgdata.image[i_out][1] =
-            rgb_ahd[0][moff][1];
-        libraw.imgdata.image[i_out][2] = rgb_ahd[0][moff][2];
+        d = HORSH;
       }
     }
+    else
+    {
+      int gv = yuv_grad(yuv[1], y, x, 1, 0);
+      gv += yuv_grad(yuv[1], y - 1, x, 1, 0) / 2;
+      gv += yuv_grad(yuv[1], y + 1, x, 1, 0) / 2;
+      int gh = yuv_grad(yuv[0], y, x, 0, 1);
+      gh += yuv_grad(yuv[0], y, x - 1, 0, 1) / 2;
+      gh += yuv_grad(yuv[0], y, x + 1, 0, 1) / 2;
+      if (gv > gh)
+        d = HOR;
+      else
+        d = VER;
+    }
+    ndir[nr_offset(y, x)] |= d;
   }
 }
 
-void AAHD::refine_hv_dirs()
+/*
+ * перенос строки i в выходной массив
+ */
+void AAHD::combine_image(int i)
 {
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
-  {
-    refine_hv_dirs(i, i & 1);
-  }
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
-  {
-    refine_hv_dirs(i, (i & 1) ^ 1);
-  }
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
+  int iwidth = libraw.imgdata.sizes.iwidth;
+  int js = libraw.COLOR(i, 0) & 1;
+  int kc = libraw.COLOR(i, js);
+  /*
+   * известные цвета не переписываются: их же читает load_row() соседних
+   * полос
+   */
+  int moff = nr_offset(i + nr_margin, nr_margin);
+  for (int j = 0; j < iwidth; j++, ++moff)
   {
-    refine_ihv_dirs(i);
+    if (ndir[moff] & HOT)
+    {
+      int c = libraw.COLOR(i, j);
+      if (c == 3)
+        c = 1;
+      rgb_ahd[1][moff][c] = rgb_ahd[0][moff][c] =
+          libraw.imgdata.image[i * iwidth + j][c];
+    }
+    ushort3 &rgb = rgb_ahd[(ndir[moff] & VER) ? 1 : 0][moff];
+    ushort(&out)[4] = libraw.imgdata.image[i * iwidth + j];
+    if ((j & 1) == js)
+    {
+      out[kc ^ 2] = rgb[kc ^ 2];
+      out[1] = out[3] = rgb[1];
+    }
+    else
+    {
+      out[0] = rgb[0];
+      out[2] = rgb[2];
+      out[3] = rgb[1];
+    }
   }
 }
 
 void AAHD::refine_ihv_dirs(int i)
 {
   int iwidth = libraw.imgdata.sizes.iwidth;
-  int moff = nr_offset(i + nr_margin, nr_margin);
-  for (int j = 0; j < iwidth; j++, ++moff)
+  int y = i + nr_margin;
+  for (int j = 0; j < iwidth; j++)
   {
-    if (ndir[moff] & HVSH)
+    int x = j + nr_margin;
+    char &nd = ndir[nr_offset(y, x)];
+    if (nd & HVSH)
       continue;
-    int nv = (ndir[moff + Pn] & VER) + (ndir[moff + Ps] & VER) +
-             (ndir[moff + Pw] & VER) + (ndir[moff + Pe] & VER);
-    int nh = (ndir[moff + Pn] & HOR) + (ndir[moff + Ps] & HOR) +
-             (ndir[moff + Pw] & HOR) + (ndir[moff + Pe] & HOR);
+    int nv =
+        (ndir[nr_offset(y - 1, x)] & VER) + (ndir[nr_offset(y + 1, x)] & VER) +
+        (ndir[nr_offset(y, x - 1)] & VER) + (ndir[nr_offset(y, x + 1)] & VER);
+    int nh =
+        (ndir[nr_offset(y - 1, x)] & HOR) + (ndir[nr_offset(y + 1, x)] & HOR) +
+        (ndir[nr_offset(y, x - 1)] & HOR) + (ndir[nr_offset(y, x + 1)] & HOR);
     nv /= VER;
     nh /= HOR;
-    if ((ndir[moff] & VER) && nh > 3)
+    if ((nd & VER) && nh > 3)
     {
-      ndir[moff] &= ~VER;
-      ndir[moff] |= HOR;
+      nd &= ~VER;
+      nd |= HOR;
     }
-    if ((ndir[moff] & HOR) && nv > 3)
+    if ((nd & HOR) && nv > 3)
     {
-      ndir[moff] &= ~HOR;
-      ndir[moff] |= VER;
+      nd &= ~HOR;
+      nd |= VER;
     }
   }
 }
@@ -544,27 +580,28 @@ void AAHD::refine_ihv_dirs(int i)
 void AAHD::refine_hv_dirs(int i, int js)
 {
   int iwidth = libraw.imgdata.sizes.iwidth;
-  int moff = nr_offset(i + nr_margin, nr_margin + js);
-  for (int j = js; j < iwidth; j += 2, moff += 2)
+  int y = i + nr_margin;
+  for (int j = js; j < iwidth; j += 2)
   {
-    int nv = (ndir[moff + Pn] & VER) + (ndir[moff + Ps] & VER) +
-             (ndir[moff + Pw] & VER) + (ndir[moff + Pe] & VER);
-    int nh = (ndir[moff + Pn] & HOR) + (ndir[moff + Ps] & HOR) +
-             (ndir[moff + Pw] & HOR) + (ndir[moff + Pe] & HOR);
-    bool codir = (ndir[moff] & VER)
-                     ? ((ndir[moff + Pn] & VER) || (ndir[moff + Ps] & VER))
-                     : ((ndir[moff + Pw] & HOR) || (ndir[moff + Pe] & HOR));
+    int x = j + nr_margin;
+    char &nd = ndir[nr_offset(y, x)];
+    char dn = ndir[nr_offset(y - 1, x)], ds = ndir[nr_offset(y + 1, x)];
+    char dw = ndir[nr_offset(y, x - 1)], de = ndir[nr_offset(y, x + 1)];
+    int nv = (dn & VER) + (ds & VER) + (dw & VER) + (de & VER);
+    int nh = (dn & HOR) + (ds & HOR) + (dw & HOR) + (de & HOR);
+    bool codir = (nd & VER) ? ((dn & VER) || (ds & VER))
+                            : ((dw & HOR) || (de & HOR));
     nv /= VER;
     nh /= HOR;
-    if ((ndir[moff] & VER) && (nh > 2 && !codir))
+    if ((nd & VER) && (nh > 2 && !codir))
     {
-      ndir[moff] &= ~VER;
-      ndir[moff] |= HOR;
+      nd &= ~VER;
+      nd |= HOR;
     }
-    if ((ndir[moff] & HOR) && (nv > 2 && !codir))
+    if ((nd & HOR) && (nv > 2 && !codir))
     {
-      ndir[moff] &= ~HOR;
-      ndir[moff] |= VER;
+      nd &= ~HOR;
+      nd |= VER;
     }
   }
 }
@@ -572,14 +609,6 @@ void AAHD::refine_hv_dirs(int i, int js)
 /*
  * вычисление недостающих зелёных точек.
  */
-void AAHD::make_ahd_greens()
-{
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
-  {
-    make_ahd_gline(i);
-  }
-}
-
 void AAHD::make_ahd_gline(int i)
 {
   int iwidth = libraw.imgdata.sizes.iwidth;
@@ -589,20 +618,26 @@ void AAHD::make_ahd_gline(int i)
    * js -- начальная х-координата, которая попадает мимо известного зелёного
    * kc -- известный цвет в точке интерполирования
    */
-  int hvdir[2] = {Pe, Ps};
+  int y = i + nr_margin;
   for (int d = 0; d < 2; ++d)
   {
-    int moff = nr_offset(i + nr_margin, nr_margin + js);
-    for (int j = js; j < iwidth; j += 2, moff += 2)
+    // d == 0: по горизонтали, d == 1: по вертикали
+    int dy = d, dx = d ^ 1;
+    ushort3 *rgb = rgb_ahd[d];
+    for (int j = js; j < iwidth; j += 2)
     {
-      ushort3 *cnr;
-      cnr = &rgb_ahd[d][moff];
-      int h1 = 2 * cnr[-hvdir[d]][1] - int(cnr[-2 * hvdir[d]][kc] + cnr[0][kc]);
-      int h2 = 2 * cnr[+hvdir[d]][1] - int(cnr[+2 * hvdir[d]][kc] + cnr[0][kc]);
+      int x = j + nr_margin;
+      ushort3 &cnr = rgb[nr_offset(y, x)];
+      ushort3 &cm1 = rgb[nr_offset(y - dy, x - dx)];
+      ushort3 &cp1 = rgb[nr_offset(y + dy, x + dx)];
+      int h1 = 2 * cm1[1] -
+               int(rgb[nr_offset(y - 2 * dy, x - 2 * dx)][kc] + cnr[kc]);
+      int h2 = 2 * cp1[1] -
+               int(rgb[nr_offset(y + 2 * dy, x + 2 * dx)][kc] + cnr[kc]);
       int h0 = (h1 + h2) / 4;
-      int eg = cnr[0][kc] + h0;
-      int min = MIN(cnr[-hvdir[d]][1], cnr[+hvdir[d]][1]);
-      int max = MAX(cnr[-hvdir[d]][1], cnr[+hvdir[d]][1]);
+      int eg = cnr[kc] + h0;
+      int min = MIN(cm1[1], cp1[1]);
+      int max = MAX(cm1[1], cp1[1]);
       min -= min / OverFraction;
       max += max / OverFraction;
       if (eg < min)
@@ -613,7 +648,7 @@ void AAHD::make_ahd_gline(int i)
         eg = channel_maximum[1];
       else if (eg < channel_minimum[1])
         eg = channel_minimum[1];
-      cnr[0][1] = eg;
+      cnr[1] = eg;
     }
   }
 }
@@ -622,14 +657,6 @@ void AAHD::make_ahd_gline(int i)
  * отладочная функция
  */
 
-void AAHD::illustrate_dirs()
-{
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
-  {
-    illustrate_dline(i);
-  }
-}
-
 void AAHD::illustrate_dline(int i)
 {
   int iwidth = libraw.imgdata.sizes.iwidth;
@@ -657,25 +684,25 @@ void AAHD::make_ahd_rb_hv(int i)
   int js = libraw.COLOR(i, 0) & 1;
   int kc = libraw.COLOR(i, js);
   js ^= 1; // начальная координата зелёного
-  int hvdir[2] = {Pe, Ps};
+  int y = i + nr_margin;
   // интерполяция вертикальных вертикально и горизонтальных горизонтально
   for (int j = js; j < iwidth; j += 2)
   {
     int x = j + nr_margin;
-    int y = i + nr_margin;
-    int moff = nr_offset(y, x);
     for (int d = 0; d < 2; ++d)
     {
-      ushort3 *cnr;
-      cnr = &rgb_ahd[d][moff];
+      int dy = d, dx = d ^ 1;
+      ushort3 *rgb = rgb_ahd[d];
+      ushort3 &cm1 = rgb[nr_offset(y - dy, x - dx)];
+      ushort3 &cp1 = rgb[nr_offset(y + dy, x + dx)];
       int c = kc ^ (d << 1); // цвет соответсвенного направления, для
                              // горизонтального c = kc, для вертикального c=kc^2
-      int h1 = cnr[-hvdir[d]][c] - cnr[-hvdir[d]][1];
-      int h2 = cnr[+hvdir[d]][c] - cnr[+hvdir[d]][1];
+      int h1 = cm1[c] - cm1[1];
+      int h2 = cp1[c] - cp1[1];
       int h0 = (h1 + h2) / 2;
-      int eg = cnr[0][1] + h0;
-      //			int min = MIN(cnr[-hvdir[d]][c], cnr[+hvdir[d]][c]);
-      //			int max = MAX(cnr[-hvdir[d]][c], cnr[+hvdir[d]][c]);
+      int eg = rgb[nr_offset(y, x)][1] + h0;
+      //			int min = MIN(cm1[c], cp1[c]);
+      //			int max = MAX(cm1[c], cp1[c]);
       //			min -= min / OverFraction;
       //			max += max / OverFraction;
       //			if (eg < min)
@@ -686,23 +713,11 @@ void AAHD::make_ahd_rb_hv(int i)
         eg = channel_maximum[c];
       else if (eg < channel_minimum[c])
         eg = channel_minimum[c];
-      cnr[0][c] = eg;
+      rgb[nr_offset(y, x)][c] = eg;
     }
   }
 }
 
-void AAHD::make_ahd_rb()
-{
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
-  {
-    make_ahd_rb_hv(i);
-  }
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
-  {
-    make_ahd_rb_last(i);
-  }
-}
-
 void AAHD::make_ahd_rb_last(int i)
 {
   int iwidth = libraw.imgdata.sizes.iwidth;
@@ -712,14 +727,17 @@ void AAHD::make_ahd_rb_last(int i)
    * js -- начальная х-координата, которая попадает мимо известного зелёного
    * kc -- известный цвет в точке интерполирования
    */
-  int dirs[2][3] = {{Pnw, Pn, Pne}, {Pnw, Pw, Psw}};
-  int moff = nr_offset(i + nr_margin, nr_margin);
+  // {dy, dx}: {Pnw, Pn, Pne} и {Pnw, Pw, Psw}
+  static const int dirs[2][3][2] = {{{-1, -1}, {-1, 0}, {-1, 1}},
+                                    {{-1, -1}, {0, -1}, {1, -1}}};
+  int y = i + nr_margin;
   for (int j = 0; j < iwidth; j++)
   {
+    int x = j + nr_margin;
     for (int d = 0; d < 2; ++d)
     {
-      ushort3 *cnr;
-      cnr = &rgb_ahd[d][moff + j];
+      ushort3 *rgb = rgb_ahd[d];
+      ushort3 &cnr = rgb[nr_offset(y, x)];
       int c = kc ^ 2;
       if ((j & 1) != js)
       {
@@ -732,13 +750,11 @@ void AAHD::make_ahd_rb_last(int i)
       for (int k = 0; k < 3; ++k)
         for (int h = 0; h < 3; ++h)
         {
+          ushort3 &ck = rgb[nr_offset(y + dirs[d][k][0], x + dirs[d][k][1])];
+          ushort3 &ch = rgb[nr_offset(y - dirs[d][h][0], x - dirs[d][h][1])];
           // градиент зелёного плюс градиент {r,b}
-          int gd =
-              ABS(2 * cnr[0][1] - (cnr[+dirs[d][k]][1] + cnr[-dirs[d][h]][1])) +
-              ABS(cnr[+dirs[d][k]][c] - cnr[-dirs[d][h]][c]) / 4 +
-              ABS(cnr[+dirs[d][k]][c] - cnr[+dirs[d][k]][1] +
-                  cnr[-dirs[d][h]][1] - cnr[-dirs[d][h]][c]) /
-                  4;
+          int gd = ABS(2 * cnr[1] - (ck[1] + ch[1])) + ABS(ck[c] - ch[c]) / 4 +
+                   ABS(ck[c] - ck[1] + ch[1] - ch[c]) / 4;
           if (bgd == 0 || gd < bgd)
           {
             bgd = gd;
@@ -746,11 +762,13 @@ void AAHD::make_ahd_rb_last(int i)
             bk = k;
           }
         }
-      int h1 = cnr[+dirs[d][bk]][c] - cnr[+dirs[d][bk]][1];
-      int h2 = cnr[-dirs[d][bh]][c] - cnr[-dirs[d][bh]][1];
-      int eg = cnr[0][1] + (h1 + h2) / 2;
-      //			int min = MIN(cnr[+dirs[d][bk]][c], cnr[-dirs[d][bh]][c]);
-      //			int max = MAX(cnr[+dirs[d][bk]][c], cnr[-dirs[d][bh]][c]);
+      ushort3 &ck = rgb[nr_offset(y + dirs[d][bk][0], x + dirs[d][bk][1])];
+      ushort3 &ch = rgb[nr_offset(y - dirs[d][bh][0], x - dirs[d][bh][1])];
+      int h1 = ck[c] - ck[1];
+      int h2 = ch[c] - ch[1];
+      int eg = cnr[1] + (h1 + h2) / 2;
+      //			int min = MIN(ck[c], ch[c]);
+      //			int max = MAX(ck[c], ch[c]);
       //			min -= min / OverFraction;
       //			max += max / OverFraction;
       //			if (eg < min)
@@ -761,21 +779,109 @@ void AAHD::make_ahd_rb_last(int i)
         eg = channel_maximum[c];
       else if (eg < channel_minimum[c])
         eg = channel_minimum[c];
-      cnr[0][c] = eg;
+      cnr[c] = eg;
     }
   }
 }
 
-AAHD::~AAHD() { free(rgb_ahd[0]); }
+/*
+ * интерполяция полосы строк [top, bottom).
+ *
+ * все проходы выполняются конвейером по строкам: каждый следующий проход
+ * отстаёт от предыдущего на nr_lag строк, этого достаточно, чтобы проход
+ * видел соседние строки в том же состоянии, что и при обработке всего кадра
+ * (ни один проход не читает дальше 4 строк от текущей, счётчики гомогенности
+ * окончательны через 3 строки). поэтому достаточно хранить последние nr_ring
+ * строк. строки за пределами полосы обрабатываются настолько, насколько это
+ * нужно для последующих проходов.
+ */
+void AAHD::interpolate(char *buffer, int top, int bottom)
+{
+  enum
+  {
+    nr_lag = 4,
+    nr_stages = 12
+  };
+  /* сколько строк за пределами полосы читает каждый проход */
+  static const int radius[nr_stages] = {0, 2, 2, 1, 1, 0, 3, 4, 1, 1, 1, 0};
+  int first[nr_stages], last[nr_stages];
+  yuv[0] = (int3 *)buffer;
+  yuv[1] = yuv[0] + nr_ring * nr_width;
+  rgb_ahd[0] = (ushort3 *)(yuv[1] + nr_ring * nr_width);
+  rgb_ahd[1] = rgb_ahd[0] + nr_ring * nr_width;
+  ndir = (char *)(rgb_ahd[1] + nr_ring * nr_width);
+  homo[0] = ndir + nr_ring * nr_width;
+  homo[1] = homo[0] + nr_ring * nr_width;
+  for (int k = nr_stages - 1, halo = 0; k >= 0; --k)
+  {
+    /* загрузка и YUV захватывают поля, остальные проходы -- только кадр */
+    bool margins = k == 0 || k == 5;
+    first[k] = MAX(margins ? 0 : nr_margin, top + nr_margin - halo);
+    last[k] = MIN(margins ? nr_height : nr_height - nr_margin,
+                  bottom + nr_margin + halo);
+    halo += radius[k];
+  }
+  for (int t = first[0]; t < last[nr_stages - 1] + nr_lag * (nr_stages - 1); ++t)
+    for (int k = 0; k < nr_stages; ++k)
+    {
+      int y = t - nr_lag * k;
+      if (y < first[k] || y >= last[k])
+        continue;
+      int i = y - nr_margin;
+      switch (k)
+      {
+      case 0:
+        load_row(y);
+        break;
+      case 1:
+        hide_hots(i);
+        break;
+      case 2:
+        make_ahd_gline(i);
+        break;
+      case 3:
+        make_ahd_rb_hv(i);
+        break;
+      case 4:
+        make_ahd_rb_last(i);
+        break;
+      case 5:
+        make_yuv(y);
+        break;
+      case 6:
+        evaluate_homo(i);
+        break;
+      case 7:
+        evaluate_dirs(i);
+        break;
+      case 8:
+        refine_hv_dirs(i, i & 1);
+        break;
+      case 9:
+        refine_hv_dirs(i, (i & 1) ^ 1);
+        break;
+      case 10:
+        refine_ihv_dirs(i);
+        break;
+      case 11:
+        //	illustrate_dline(i);
+        combine_image(i);
+        break;
+      }
+    }
+}
 
 void LibRaw::aahd_interpolate()
 {
   AAHD aahd(*this);
-  aahd.hide_hots();
-  aahd.make_ahd_greens();
-  aahd.make_ahd_rb();
-  aahd.evaluate_ahd();
-  aahd.refine_hv_dirs();
-  //	aahd.illustrate_dirs();
-  aahd.combine_image();
+  int buffer_count = parallel_workers();
+  char **buffers = malloc_omp_buffers(buffer_count, aahd.buffer_size());
+  int bands = (imgdata.sizes.iheight + AAHD::nr_band - 1) / AAHD::nr_band;
+  parallel_for(bands, [&](int b, int worker) {
+    int top = b * AAHD::nr_band;
+    AAHD band(aahd);
+    band.interpolate(buffers[worker], top,
+                     MIN(top + AAHD::nr_band, imgdata.sizes.iheight));
+  });
+  free_omp_buffers(buffers, buffer_count);
 }
@@ -296,23 +296,15 @@ void LibRaw::ahd_interpolate()
     cielab(0, 0);
     border_interpolate(5);
 
-#ifdef LIBRAW_USE_OPENMP
-    int buffer_count = omp_get_max_threads();
-#else
-    int buffer_count = 1;
-#endif
+    int buffer_count = parallel_workers();
 
     size_t buffer_size = 26 * LIBRAW_AHD_TILE * LIBRAW_AHD_TILE; /* 1664 kB */
     char** buffers = malloc_omp_buffers(buffer_count, buffer_size);
 
-#ifdef LIBRAW_USE_OPENMP
-#pragma omp parallel for schedule(dynamic) default(none) shared(terminate_flag) firstprivate(buffers)
-#endif
-    for (int top = 2; top < height - 5; top += LIBRAW_AHD_TILE - 6)
-    {
-#ifdef LIBRAW_USE_OPENMP
-        if (0 == omp_get_thread_num())
-#endif
+    parallel_for((height - 7 + LIBRAW_AHD_TILE - 7) / (LIBRAW_AHD_TILE - 6),
+                 [&](int tile, int worker) {
+        int top = 2 + tile * (LIBRAW_AHD_TILE - 6);
+        if (0 == worker)
             if (callbacks.progress_cb)
             {
                 int rr = (*callbacks.progress_cb)(callbacks.progresscb_data,
@@ -322,11 +314,7 @@ void LibRaw::ahd_interpolate()
                     terminate_flag = 1;
             }
 
-#if defined(LIBRAW_USE_OPENMP)
-        char* buffer = buffers[omp_get_thread_num()];
-#else
-        char* buffer = buffers[0];
-#endif
+        char* buffer = buffers[worker];
 
         ushort(*rgb)[LIBRAW_AHD_TILE][LIBRAW_AHD_TILE][3];
         short(*lab)[LIBRAW_AHD_TILE][LIBRAW_AHD_TILE][3];
@@ -346,7 +334,7 @@ void LibRaw::ahd_interpolate()
             ahd_interpolate_build_homogeneity_map(top, left, lab, homo);
             ahd_interpolate_combine_homogeneous_pixels(top, left, rgb, homo);
         }
-    }
+    });
 
     free_omp_buffers(buffers, buffer_count);
 
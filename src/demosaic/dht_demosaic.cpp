@@ -33,6 +33,12 @@ struct DHT
 {
   int nr_height, nr_width;
   static const int nr_topmargin = 4, nr_leftmargin = 4;
+  /*
+   * nraw and ndir keep only the last nr_ring rows (nr rows y and
+   * y + nr_ring share the same storage), see interpolate()
+   */
+  static const int nr_ring = 64;
+  static const int nr_band = 256;
   float (*nraw)[3];
   ushort channel_maximum[3];
   float channel_minimum[3];
@@ -57,7 +63,7 @@ struct DHT
   char *ndir;
   inline int nr_offset(int row, int col) throw()
   {
-    return (row * nr_width + col);
+    return ((row & (nr_ring - 1)) * nr_width + col);
   }
   int get_hv_grb(int x, int y, int kc)
   {
@@ -177,26 +183,26 @@ struct DHT
     float o = base - ec;
     return base - sqrt(s * (o + s)) + s;
   }
-  ~DHT();
   DHT(LibRaw &_libraw);
-  void copy_to_image();
-  void make_greens();
-  void make_diag_dirs();
-  void make_hv_dirs();
+  size_t buffer_size()
+  {
+    return size_t(nr_ring) * nr_width * (sizeof(*nraw) + 1);
+  }
+  void interpolate(char *buffer, int top, int bottom);
+  void load_row(int y);
+  void copy_to_image(int i);
   void refine_hv_dirs(int i, int js);
   void refine_diag_dirs(int i, int js);
   void refine_ihv_dirs(int i);
   void refine_idiag_dirs(int i);
-  void illustrate_dirs();
   void illustrate_dline(int i);
   void make_hv_dline(int i);
   void make_diag_dline(int i);
   void make_gline(int i);
   void make_rbdiag(int i);
   void make_rbhv(int i);
-  void make_rb();
-  void hide_hots();
-  void restore_hots();
+  void hide_hots(int i);
+  void restore_hots(int i);
 };
 
 typedef float float3[3];
@@ -217,17 +223,25 @@ DHT::DHT(LibRaw &_libraw) : libraw(_libraw)
 {
   nr_height = libraw.imgdata.sizes.iheight + nr_topmargin * 2;
   nr_width = libraw.imgdata.sizes.iwidth + nr_leftmargin * 2;
-  nraw = (float3 *)malloc(nr_height * nr_width * sizeof(float3));
+  nraw = 0;
+  ndir = 0;
   int iwidth = libraw.imgdata.sizes.iwidth;
-  ndir = (char *)calloc(nr_height * nr_width, 1);
   channel_maximum[0] = channel_maximum[1] = channel_maximum[2] = 0;
   channel_minimum[0] = libraw.imgdata.image[0][0];
   channel_minimum[1] = libraw.imgdata.image[0][1];
   channel_minimum[2] = libraw.imgdata.image[0][2];
-  for (int i = 0; i < nr_height * nr_width; ++i)
-    nraw[i][0] = nraw[i][1] = nraw[i][2] = 0.5;
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
-  {
+  int workers = libraw.parallel_workers();
+  std::vector<ushort> wmax(workers * 3);
+  std::vector<float> wmin(workers * 3);
+  for (int w = 0; w < workers; ++w)
+    for (int l = 0; l < 3; ++l)
+    {
+      wmax[w * 3 + l] = channel_maximum[l];
+      wmin[w * 3 + l] = channel_minimum[l];
+    }
+  libraw.parallel_for(libraw.imgdata.sizes.iheight, [&](int i, int worker) {
+    ushort *cmax = &wmax[worker * 3];
+    float *cmin = &wmin[worker * 3];
     int col_cache[48];
     for (int j = 0; j < 48; ++j)
     {
@@ -242,26 +256,61 @@ DHT::DHT(LibRaw &_libraw) : libraw(_libraw)
       unsigned short c = libraw.imgdata.image[i * iwidth + j][l];
       if (c != 0)
       {
-        if (channel_maximum[l] < c)
-          channel_maximum[l] = c;
-        if (channel_minimum[l] > c)
-          channel_minimum[l] = c;
-        nraw[nr_offset(i + nr_topmargin, j + nr_leftmargin)][l] = (float)c;
+        if (cmax[l] < c)
+          cmax[l] = c;
+        if (cmin[l] > c)
+          cmin[l] = c;
       }
     }
-  }
+  });
+  for (int w = 0; w < workers; ++w)
+    for (int l = 0; l < 3; ++l)
+    {
+      if (channel_maximum[l] < wmax[w * 3 + l])
+        channel_maximum[l] = wmax[w * 3 + l];
+      if (channel_minimum[l] > wmin[w * 3 + l])
+        channel_minimum[l] = wmin[w * 3 + l];
+    }
   channel_minimum[0] += .5;
   channel_minimum[1] += .5;
   channel_minimum[2] += .5;
 }
 
-void DHT::hide_hots()
+/*
+ * загрузка строки y (с учётом полей) в nraw
+ */
+void DHT::load_row(int y)
+{
+  int iwidth = libraw.imgdata.sizes.iwidth;
+  int i = y - nr_topmargin;
+  for (int x = 0; x < nr_width; ++x)
+  {
+    nraw[nr_offset(y, x)][0] = nraw[nr_offset(y, x)][1] =
+        nraw[nr_offset(y, x)][2] = 0.5;
+    ndir[nr_offset(y, x)] = 0;
+  }
+  if (i < 0 || i >= libraw.imgdata.sizes.iheight)
+    return;
+  int col_cache[48];
+  for (int j = 0; j < 48; ++j)
+  {
+    int l = libraw.COLOR(i, j);
+    if (l == 3)
+      l = 1;
+    col_cache[j] = l;
+  }
+  for (int j = 0; j < iwidth; ++j)
+  {
+    int l = col_cache[j % 48];
+    unsigned short c = libraw.imgdata.image[i * iwidth + j][l];
+    if (c != 0)
+      nraw[nr_offset(y, j + nr_leftmargin)][l] = (float)c;
+  }
+}
+
+void DHT::hide_hots(int i)
 {
   int iwidth = libraw.imgdata.sizes.iwidth;
-#if defined(LIBRAW_USE_OPENMP)
-#pragma omp parallel for schedule(guided) firstprivate(iwidth)
-#endif
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
   {
     int js = libraw.COLOR(i, 0) & 1;
     int kc = libraw.COLOR(i, js);
@@ -394,94 +443,22 @@ void DHT::hide_hots()
   }
 }
 
-void DHT::restore_hots()
+void DHT::restore_hots(int i)
 {
   int iwidth = libraw.imgdata.sizes.iwidth;
-#if defined(LIBRAW_USE_OPENMP)
-#ifdef _MSC_VER
-#pragma omp parallel for firstprivate(iwidth)
-#else
-#pragma omp parallel for schedule(guided) firstprivate(iwidth) collapse(2)
-#endif
-#endif
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
+  for (int j = 0; j < iwidth; ++j)
   {
-    for (int j = 0; j < iwidth; ++j)
+    int x = j + nr_leftmargin;
+    int y = i + nr_topmargin;
+    if (ndir[nr_offset(y, x)] & HOT)
     {
-      int x = j + nr_leftmargin;
-      int y = i + nr_topmargin;
-      if (ndir[nr_offset(y, x)] & HOT)
-      {
-        int l = libraw.COLOR(i, j);
-        nraw[nr_offset(i + nr_topmargin, j + nr_leftmargin)][l] =
-            libraw.imgdata.image[i * iwidth + j][l];
-      }
+      int l = libraw.COLOR(i, j);
+      nraw[nr_offset(i + nr_topmargin, j + nr_leftmargin)][l] =
+          libraw.imgdata.image[i * iwidth + j][l];
     }
   }
 }
 
-void DHT::make_diag_dirs()
-{
-#if defined(LIBRAW_USE_OPENMP)
-#pragma omp parallel for schedule(guided)
-#endif
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
-  {
-    make_diag_dline(i);
-  }
-//#if defined(LIBRAW_USE_OPENMP)
-//#pragma omp parallel for schedule(guided)
-//#endif
-//	for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i) {
-//		refine_diag_dirs(i, i & 1);
-//	}
-//#if defined(LIBRAW_USE_OPENMP)
-//#pragma omp parallel for schedule(guided)
-//#endif
-//	for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i) {
-//		refine_diag_dirs(i, (i & 1) ^ 1);
-//	}
-#if defined(LIBRAW_USE_OPENMP)
-#pragma omp parallel for schedule(guided)
-#endif
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
-  {
-    refine_idiag_dirs(i);
-  }
-}
-
-void DHT::make_hv_dirs()
-{
-#if defined(LIBRAW_USE_OPENMP)
-#pragma omp parallel for schedule(guided)
-#endif
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
-  {
-    make_hv_dline(i);
-  }
-#if defined(LIBRAW_USE_OPENMP)
-#pragma omp parallel for schedule(guided)
-#endif
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
-  {
-    refine_hv_dirs(i, i & 1);
-  }
-#if defined(LIBRAW_USE_OPENMP)
-#pragma omp parallel for schedule(guided)
-#endif
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
-  {
-    refine_hv_dirs(i, (i & 1) ^ 1);
-  }
-#if defined(LIBRAW_USE_OPENMP)
-#pragma omp parallel for schedule(guided)
-#endif
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
-  {
-    refine_ihv_dirs(i);
-  }
-}
-
 void DHT::refine_hv_dirs(int i, int js)
 {
   int iwidth = libraw.imgdata.sizes.iwidth;
@@ -686,17 +663,6 @@ void DHT::refine_idiag_dirs(int i)
 /*
  * вычисление недостающих зелёных точек.
  */
-void DHT::make_greens()
-{
-#if defined(LIBRAW_USE_OPENMP)
-#pragma omp parallel for schedule(guided)
-#endif
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
-  {
-    make_gline(i);
-  }
-}
-
 void DHT::make_gline(int i)
 {
   int iwidth = libraw.imgdata.sizes.iwidth;
@@ -762,17 +728,6 @@ void DHT::make_gline(int i)
  * отладочная функция
  */
 
-void DHT::illustrate_dirs()
-{
-#if defined(LIBRAW_USE_OPENMP)
-#pragma omp parallel for schedule(guided)
-#endif
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
-  {
-    illustrate_dline(i);
-  }
-}
-
 void DHT::illustrate_dline(int i)
 {
   int iwidth = libraw.imgdata.sizes.iwidth;
@@ -952,61 +907,114 @@ void DHT::make_rbhv(int i)
   }
 }
 
-void DHT::make_rb()
-{
-#if defined(LIBRAW_USE_OPENMP)
-#pragma omp barrier
-#pragma omp parallel for schedule(guided)
-#endif
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
-  {
-    make_rbdiag(i);
-  }
-#if defined(LIBRAW_USE_OPENMP)
-#pragma omp barrier
-#pragma omp parallel for schedule(guided)
-#endif
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
-  {
-    make_rbhv(i);
-  }
-}
-
 /*
  * перенос изображения в выходной массив
  */
-void DHT::copy_to_image()
+void DHT::copy_to_image(int i)
 {
   int iwidth = libraw.imgdata.sizes.iwidth;
-#if defined(LIBRAW_USE_OPENMP)
-#ifdef _MSC_VER
-#pragma omp parallel for
-#else
-#pragma omp parallel for schedule(guided) collapse(2)
-#endif
-#endif
-  for (int i = 0; i < libraw.imgdata.sizes.iheight; ++i)
+  int js = libraw.COLOR(i, 0) & 1;
+  int kc = libraw.COLOR(i, js);
+  /*
+   * известные цвета не переписываются: их же читают load_row() и
+   * restore_hots() соседних полос
+   */
+  for (int j = 0; j < iwidth; ++j)
   {
-    for (int j = 0; j < iwidth; ++j)
+    float3 &pix = nraw[nr_offset(i + nr_topmargin, j + nr_leftmargin)];
+    ushort(&out)[4] = libraw.imgdata.image[i * iwidth + j];
+    if ((j & 1) == js)
     {
-      libraw.imgdata.image[i * iwidth + j][0] =
-          (unsigned short)(nraw[nr_offset(i + nr_topmargin, j + nr_leftmargin)]
-                               [0]);
-      libraw.imgdata.image[i * iwidth + j][2] =
-          (unsigned short)(nraw[nr_offset(i + nr_topmargin, j + nr_leftmargin)]
-                               [2]);
-      libraw.imgdata.image[i * iwidth + j][1] =
-          libraw.imgdata.image[i * iwidth + j][3] =
-              (unsigned short)(nraw[nr_offset(i + nr_topmargin,
-                                              j + nr_leftmargin)][1]);
+      out[kc ^ 2] = (unsigned short)(pix[kc ^ 2]);
+      out[1] = out[3] = (unsigned short)(pix[1]);
+    }
+    else
+    {
+      out[0] = (unsigned short)(pix[0]);
+      out[2] = (unsigned short)(pix[2]);
+      out[3] = (unsigned short)(pix[1]);
     }
   }
 }
 
-DHT::~DHT()
+/*
+ * интерполяция полосы строк [top, bottom).
+ *
+ * все проходы выполняются конвейером по строкам: каждый следующий проход
+ * отстаёт от предыдущего на nr_lag строк, этого достаточно, чтобы проход
+ * видел соседние строки в том же состоянии, что и при обработке всего кадра
+ * (ни один проход не читает дальше 3 строк от текущей). поэтому достаточно
+ * хранить последние nr_ring строк nraw/ndir. строки за пределами полосы
+ * обрабатываются настолько, насколько это нужно для последующих проходов.
+ */
+void DHT::interpolate(char *buffer, int top, int bottom)
 {
-  free(nraw);
-  free(ndir);
+  enum
+  {
+    nr_lag = 3,
+    nr_stages = 12
+  };
+  /* сколько строк за пределами полосы читает каждый проход */
+  static const int radius[nr_stages] = {0, 2, 3, 1, 1, 1, 2, 1, 1, 1, 1, 0};
+  int first[nr_stages], last[nr_stages];
+  nraw = (float3 *)buffer;
+  ndir = (char *)(nraw + nr_ring * nr_width);
+  for (int k = nr_stages - 1, halo = 0; k >= 0; --k)
+  {
+    first[k] = MAX(k ? nr_topmargin : 0, top + nr_topmargin - halo);
+    last[k] = MIN(k ? nr_height - nr_topmargin : nr_height,
+                  bottom + nr_topmargin + halo);
+    halo += radius[k];
+  }
+  for (int t = first[0]; t < last[nr_stages - 1] + nr_lag * (nr_stages - 1); ++t)
+    for (int k = 0; k < nr_stages; ++k)
+    {
+      int y = t - nr_lag * k;
+      if (y < first[k] || y >= last[k])
+        continue;
+      int i = y - nr_topmargin;
+      switch (k)
+      {
+      case 0:
+        load_row(y);
+        break;
+      case 1:
+        hide_hots(i);
+        break;
+      case 2:
+        make_hv_dline(i);
+        break;
+      case 3:
+        refine_hv_dirs(i, i & 1);
+        break;
+      case 4:
+        refine_hv_dirs(i, (i & 1) ^ 1);
+        break;
+      case 5:
+        refine_ihv_dirs(i);
+        break;
+      case 6:
+        make_gline(i);
+        break;
+      case 7:
+        make_diag_dline(i);
+        break;
+      case 8:
+        refine_idiag_dirs(i);
+        break;
+      case 9:
+        make_rbdiag(i);
+        break;
+      case 10:
+        make_rbhv(i);
+        break;
+      case 11:
+        restore_hots(i);
+        //	illustrate_dline(i);
+        copy_to_image(i);
+        break;
+      }
+    }
 }
 
 void LibRaw::dht_interpolate()
@@ -1021,13 +1029,14 @@ void LibRaw::dht_interpolate()
 		return;
 	}
   DHT dht(*this);
-  dht.hide_hots();
-  dht.make_hv_dirs();
-  //	dht.illustrate_dirs();
-  dht.make_greens();
-  dht.make_diag_dirs();
-  //	dht.illustrate_dirs();
-  dht.make_rb();
-  dht.restore_hots();
-  dht.copy_to_image();
+  int buffer_count = parallel_workers();
+  char **buffers = malloc_omp_buffers(buffer_count, dht.buffer_size());
+  int bands = (imgdata.sizes.iheight + DHT::nr_band - 1) / DHT::nr_band;
+  parallel_for(bands, [&](int b, int worker) {
+    int top = b * DHT::nr_band;
+    DHT band(dht);
+    band.interpolate(buffers[worker], top,
+                     MIN(top + DHT::nr_band, imgdata.sizes.iheight));
+  });
+  free_omp_buffers(buffers, buffer_count);
 }
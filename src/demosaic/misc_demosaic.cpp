@@ -49,13 +49,14 @@ void LibRaw::pre_interpolate()
     {
       int extra = filters ? (filters == 9 ? 6 : 2) : 0;
       img = (ushort(*)[4])calloc((height+extra), (width+extra) * sizeof *img);
-      for (row = 0; row < height; row++)
-        for (col = 0; col < width; col++)
+      parallel_for(height, [&](int row, int) {
+        for (int col = 0; col < width; col++)
         {
-          c = fcol(row, col);
+          int c = fcol(row, col);
           img[row * width + col][c] =
               image[(row >> 1) * iwidth + (col >> 1)][c];
         }
+      });
       free(image);
       image = img;
       shrink = 0;
@@ -68,9 +69,12 @@ void LibRaw::pre_interpolate()
       colors++;
     else
     {
-      for (row = FC(1, 0) >> 1; row < height; row += 2)
-        for (col = FC(row, 1) & 1; col < width; col += 2)
+      int first = FC(1, 0) >> 1;
+      parallel_for((height - first + 1) / 2, [&](int r, int) {
+        int row = first + r * 2;
+        for (int col = FC(row, 1) & 1; col < width; col += 2)
           image[row * width + col][1] = image[row * width + col][3];
+      });
       filters &= ~((filters & 0x55555555U) << 1);
     }
   }
@@ -103,28 +107,32 @@ void LibRaw::border_interpolate(int border)
     }
 }
 
-void LibRaw::lin_interpolate_loop(int *code, int size)
+// Interpolates columns 1..count-2 of one image row; code is the row of the
+// lin_interpolate() table for this row
+LIBRAW_SIMD_CLONES
+static void lin_interpolate_row(ushort *row, int count, const int *code,
+                                int size, int ncolors)
 {
-  int row;
-  for (row = 1; row < height - 1; row++)
+  for (int col = 1; col < count - 1; col++)
   {
-    int col, *ip;
-    ushort *pix;
-    for (col = 1; col < width - 1; col++)
-    {
-      int i;
-      int sum[4];
-      pix = image[row * width + col];
-      ip = code + ((((row % size) * 16) + (col % size)) * 32);
-      memset(sum, 0, sizeof sum);
-      for (i = *ip++; i--; ip += 3)
-        sum[ip[2]] += pix[ip[0]] << ip[1];
-      for (i = colors; --i; ip += 2)
-        pix[ip[0]] = sum[ip[0]] * ip[1] >> 8;
-    }
+    int i;
+    int sum[4] = {0, 0, 0, 0};
+    ushort *pix = row + col * 4;
+    const int *ip = code + (col % size) * 32;
+    for (i = *ip++; i--; ip += 3)
+      sum[ip[2]] += pix[ip[0]] << ip[1];
+    for (i = ncolors; --i; ip += 2)
+      pix[ip[0]] = sum[ip[0]] * ip[1] >> 8;
   }
 }
 
+void LibRaw::lin_interpolate_loop(int *code, int size)
+{
+  for (int row = 1; row < height - 1; row++)
+    lin_interpolate_row(image[row * width], width,
+                        code + (row % size) * 16 * 32, size, colors);
+}
+
 void LibRaw::lin_interpolate()
 {
   std::vector<int> code_buffer(16 * 16 * 32);
@@ -345,22 +353,17 @@ void LibRaw::vng_interpolate()
 void LibRaw::ppg_interpolate()
 {
   int dir[5] = {1, width, -1, -width, 1};
-  int row, col, diff[2], guess[2], c, d, i;
-  ushort(*pix)[4];
 
   border_interpolate(3);
 
   /*  Fill in the green layer with gradients and pattern recognition: */
   RUN_CALLBACK(LIBRAW_PROGRESS_INTERPOLATE, 0, 3);
-#ifdef LIBRAW_USE_OPENMP
-#pragma omp parallel for default(shared) private(guess, diff, row, col, d, c,  \
-                                                 i, pix) schedule(static)
-#endif
-  for (row = 3; row < height - 3; row++)
+  parallel_for(height - 6, [&](int r, int) {
+    int row = r + 3, col, diff[2], guess[2], c, d, i;
     for (col = 3 + (FC(row, 3) & 1), c = FC(row, col); col < width - 3;
          col += 2)
     {
-      pix = image + row * width + col;
+      ushort(*pix)[4] = image + row * width + col;
       for (i = 0; i < 2; i++)
       {
         d = dir[i];
@@ -377,17 +380,15 @@ void LibRaw::ppg_interpolate()
       d = dir[i = diff[0] > diff[1]];
       pix[0][1] = ULIM(guess[i] >> 2, pix[d][1], pix[-d][1]);
     }
+  });
   /*  Calculate red and blue for each green pixel:		*/
   RUN_CALLBACK(LIBRAW_PROGRESS_INTERPOLATE, 1, 3);
-#ifdef LIBRAW_USE_OPENMP
-#pragma omp parallel for default(shared) private(guess, diff, row, col, d, c,  \
-                                                 i, pix) schedule(static)
-#endif
-  for (row = 1; row < height - 1; row++)
+  parallel_for(height - 2, [&](int r, int) {
+    int row = r + 1, col, c, d, i;
     for (col = 1 + (FC(row, 2) & 1), c = FC(row, col + 1); col < width - 1;
          col += 2)
     {
-      pix = image + row * width + col;
+      ushort(*pix)[4] = image + row * width + col;
       for (i = 0; i < 2; c = 2 - c, i++)
       {
         d = dir[i];
@@ -396,17 +397,15 @@ void LibRaw::ppg_interpolate()
             1);
       }
     }
+  });
   /*  Calculate blue for red pixels and vice versa:		*/
   RUN_CALLBACK(LIBRAW_PROGRESS_INTERPOLATE, 2, 3);
-#ifdef LIBRAW_USE_OPENMP
-#pragma omp parallel for default(shared) private(guess, diff, row, col, d, c,  \
-                                                 i, pix) schedule(static)
-#endif
-  for (row = 1; row < height - 1; row++)
+  parallel_for(height - 2, [&](int r, int) {
+    int row = r + 1, col, diff[2], guess[2], c, d, i;
     for (col = 1 + (FC(row, 1) & 1), c = 2 - FC(row, col); col < width - 1;
          col += 2)
     {
-      pix = image + row * width + col;
+      ushort(*pix)[4] = image + row * width + col;
       for (i = 0; i < 2; i++)
       {
         d = dir[i] + dir[i+1];
@@ -420,4 +419,5 @@ void LibRaw::ppg_interpolate()
       else
         pix[0][c] = CLIP((guess[0] + guess[1]) >> 2);
     }
+  });
 }
@@ -165,25 +165,15 @@ void LibRaw::xtrans_interpolate(int passes)
 		  }
 	  }
 
-#if defined(LIBRAW_USE_OPENMP)
-  int buffer_count = omp_get_max_threads();
-#else
-  int buffer_count = 1;
-#endif
+  int buffer_count = parallel_workers();
 
   size_t buffer_size = LIBRAW_AHD_TILE * LIBRAW_AHD_TILE * (ndir * 11 + 6);
   char** buffers = malloc_omp_buffers(buffer_count, buffer_size);
 
-#if defined(LIBRAW_USE_OPENMP)
-# pragma omp parallel for schedule(dynamic) default(none) firstprivate(buffers, allhex, passes, sgrow, sgcol, ndir) shared(dir) 
-#endif
-    for (int top = 3; top < height - 19; top += LIBRAW_AHD_TILE - 16)
-    {
-#if defined(LIBRAW_USE_OPENMP)
-        char* buffer = buffers[omp_get_thread_num()];
-#else
-        char* buffer = buffers[0];
-#endif
+    parallel_for((height - 22 + LIBRAW_AHD_TILE - 17) / (LIBRAW_AHD_TILE - 16),
+                 [&](int tile, int worker) {
+        int top = 3 + tile * (LIBRAW_AHD_TILE - 16);
+        char* buffer = buffers[worker];
 
         ushort(*rgb)[LIBRAW_AHD_TILE][LIBRAW_AHD_TILE][3], (*rix)[3];
         short(*lab)[LIBRAW_AHD_TILE][3], (*lix)[3];
@@ -423,11 +413,7 @@ void LibRaw::xtrans_interpolate(int passes)
                     FORC3 image[(row + top) * width + col + left][c] = avg[c] / avg[3];
                 }
         }
-    }
-  
-#ifdef LIBRAW_USE_OPENMP
-#pragma omp barrier
-#endif
+    });
 
     free_omp_buffers(buffers, buffer_count);
 
@@ -223,6 +223,15 @@ extern "C"
     LibRaw *ip = (LibRaw *)lr->parent_class;
     ip->set_progress_handler(cb, data);
   }
+  void libraw_set_parallel_handler(libraw_data_t *lr,
+                                   parallel_executor_callback cb, void *data,
+                                   int workers)
+  {
+    if (!lr)
+      return;
+    LibRaw *ip = (LibRaw *)lr->parent_class;
+    ip->set_parallel_handler(cb, data, workers);
+  }
 
   int libraw_adjust_to_raw_inset_crop(libraw_data_t *lr, unsigned mask, float maxcrop)
   {
@@ -285,12 +294,33 @@ extern "C"
     LibRaw *ip = (LibRaw *)lr->parent_class;
     return ip->dcraw_make_mem_thumb(errc);
   }
+  libraw_processed_image_t *libraw_dcraw_make_mem_preview(libraw_data_t *lr,
+                                                          int *errc)
+  {
+    if (!lr)
+    {
+      if (errc)
+        *errc = EINVAL;
+      return NULL;
+    }
+    LibRaw *ip = (LibRaw *)lr->parent_class;
+    return ip->dcraw_make_mem_preview(errc);
+  }
 
   void libraw_dcraw_clear_mem(libraw_processed_image_t *p)
   {
     LibRaw::dcraw_clear_mem(p);
   }
 
+  int libraw_dcraw_output_rows(libraw_data_t *lr, output_rows_callback cb,
+                               void *cb_data, int band_height, int bgr)
+  {
+    if (!lr)
+      return EINVAL;
+    LibRaw *ip = (LibRaw *)lr->parent_class;
+    return ip->dcraw_output_rows(cb, cb_data, band_height, bgr);
+  }
+
   int libraw_raw2image(libraw_data_t *lr)
   {
     if (!lr)
@@ -27,6 +27,11 @@
 #include "libraw/libraw_types.h"
 #include "libraw/libraw_datastream.h"
 #include <sys/stat.h>
+#ifdef LIBRAW_MMAP_DATASTREAM
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 #ifdef USE_JPEG
 #include <jpeglib.h>
 #include <jerror.h>
@@ -448,6 +453,13 @@ int LibRaw_buffer_datastream::eof()
 }
 int LibRaw_buffer_datastream::valid() { return buf ? 1 : 0; }
 
+const unsigned char *LibRaw_buffer_datastream::get_span(INT64 offset, INT64 sz)
+{
+  if (!buf || offset < 0 || sz < 0 || INT64(streamsize) < sz || offset > INT64(streamsize) - sz)
+    return NULL;
+  return buf + offset;
+}
+
 
 int LibRaw_buffer_datastream::jpeg_src(void *jpegdata)
 {
@@ -606,6 +618,50 @@ const char *LibRaw_bigfile_datastream::fname()
   return filename.size() > 0 ? filename.c_str() : NULL;
 }
 
+// == LibRaw_mmap_datastream
+#ifdef LIBRAW_MMAP_DATASTREAM
+
+LibRaw_mmap_datastream::LibRaw_mmap_datastream(const char *fname)
+    : LibRaw_buffer_datastream(NULL, 0), filename(fname ? fname : ""), map_(NULL), mapsize_(0)
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+      INT64(size_t(st.st_size)) == INT64(st.st_size))
+  {
+    void *m = mmap(NULL, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m != MAP_FAILED)
+    {
+      map_ = m;
+      mapsize_ = st.st_size;
+#ifdef MADV_SEQUENTIAL
+      madvise(map_, size_t(mapsize_), MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_WILLNEED
+      madvise(map_, size_t(mapsize_), MADV_WILLNEED);
+#endif
+    }
+  }
+  close(fd); // mapping stays valid after close()
+  if (map_)
+    reconstruct_base();
+}
+
+LibRaw_mmap_datastream::~LibRaw_mmap_datastream()
+{
+  if (map_)
+    munmap(map_, size_t(mapsize_));
+}
+
+const char *LibRaw_mmap_datastream::fname()
+{
+  return filename.size() > 0 ? filename.c_str() : NULL;
+}
+
+#endif
+
 // == LibRaw_windows_datastream
 #ifdef LIBRAW_WIN32_CALLS
 
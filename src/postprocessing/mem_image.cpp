@@ -145,10 +145,62 @@ libraw_processed_image_t *LibRaw::dcraw_make_mem_thumb(int *errcode)
   }
 }
 
-// jlb
-// macros for copying pixels to either BGR or RGB formats
-#define FORBGR for (c = P1.colors - 1; c >= 0; c--)
-#define FORRGB for (c = 0; c < P1.colors; c++)
+// Copies count pixels to out, starting at image pixel soff and stepping by
+// cstep pixels. Pixel values go through curve[] and are shifted right by
+// shift (8 for 8-bit output).
+template <typename PixelT>
+static inline void copy_mem_pixels(PixelT *out, const ushort *img, INT64 soff, int cstep, int count, int colors,
+                                   int bgr, const ushort *curve, int shift)
+{
+  const ushort *pix = img + soff * 4;
+  const INT64 step = INT64(cstep) * 4;
+  int col, c;
+  // keep trivial decisions out of the pixel loop for speed
+  if (colors == 3 && !bgr)
+  {
+    for (col = 0; col < count; col++, pix += step, out += 3)
+    {
+      out[0] = PixelT(curve[pix[0]] >> shift);
+      out[1] = PixelT(curve[pix[1]] >> shift);
+      out[2] = PixelT(curve[pix[2]] >> shift);
+    }
+  }
+  else if (colors == 3)
+  {
+    for (col = 0; col < count; col++, pix += step, out += 3)
+    {
+      out[0] = PixelT(curve[pix[2]] >> shift);
+      out[1] = PixelT(curve[pix[1]] >> shift);
+      out[2] = PixelT(curve[pix[0]] >> shift);
+    }
+  }
+  else if (bgr)
+  {
+    for (col = 0; col < count; col++, pix += step)
+      for (c = colors - 1; c >= 0; c--)
+        *out++ = PixelT(curve[pix[c]] >> shift);
+  }
+  else
+  {
+    for (col = 0; col < count; col++, pix += step)
+      for (c = 0; c < colors; c++)
+        *out++ = PixelT(curve[pix[c]] >> shift);
+  }
+}
+
+LIBRAW_SIMD_CLONES
+static void copy_mem_run(uchar *out, const ushort *img, INT64 soff, int cstep, int count, int colors,
+                         int bgr, const ushort *curve)
+{
+  copy_mem_pixels(out, img, soff, cstep, count, colors, bgr, curve, 8);
+}
+
+LIBRAW_SIMD_CLONES
+static void copy_mem_run(ushort *out, const ushort *img, INT64 soff, int cstep, int count, int colors,
+                         int bgr, const ushort *curve)
+{
+  copy_mem_pixels(out, img, soff, cstep, count, colors, bgr, curve, 0);
+}
 
 void LibRaw::get_mem_image_format(int *width, int *height, int *colors,
                                   int *bps) const
@@ -183,15 +235,9 @@ void LibRaw::get_mem_image_format(int *width, int *height, int *colors,
   *bps = O.output_bps;
 }
 
-int LibRaw::copy_mem_image(void *scan0, int stride, int bgr)
-
+// Builds output curve (gamma + auto-brightness from histogram)
+void LibRaw::mem_image_curve()
 {
-  // the image memory pointed to by scan0 is assumed to be in the format
-  // returned by get_mem_image_format
-  if ((imgdata.progress_flags & LIBRAW_PROGRESS_THUMB_MASK) <
-      LIBRAW_PROGRESS_PRE_INTERPOLATE)
-    return LIBRAW_OUT_OF_ORDER_CALL;
-
   if (libraw_internal_data.output_data.histogram)
   {
     int perc, val, total, t_white = 0x2000, c;
@@ -210,6 +256,61 @@ int LibRaw::copy_mem_image(void *scan0, int stride, int bgr)
       }
     gamma_curve(O.gamm[0], O.gamm[1], 2, int((t_white << 3) / O.bright));
   }
+}
+
+// Copies output rows [first_row, first_row+nrows) to scan0 (first_row is
+// stored at scan0). Sizes should be already swapped and iwidth/iheight set to
+// image size, as done by copy_mem_image()/dcraw_output_rows()
+void LibRaw::copy_mem_rows(void *scan0, int stride, int bgr, int first_row, int nrows)
+{
+  const ushort *img = imgdata.image[0];
+  const ushort *curve = imgdata.color.curve;
+  const int colors = P1.colors;
+  const int width = S.width;
+  const int bytes = O.output_bps == 8 ? 1 : 2;
+
+  // flip_index() is linear in row and col
+  const INT64 soff = flip_index(0, 0);
+  const int cstep = flip_index(0, 1) - int(soff);
+  const INT64 rstep = INT64(flip_index(1, 0)) - soff;
+
+  // Output is written in bands of rows. For rotated images (flip & 4) the
+  // source walks down image columns, so each band is also split into
+  // tiles: source pixels for adjacent output rows are adjacent in memory and
+  // stay in cache while the tile is written.
+  const int band = 16;
+  const int tile = (S.flip & 4) ? 64 : width;
+  const int bands = (nrows + band - 1) / band;
+
+  parallel_for(bands, [&](int b, int) {
+    const int rfirst = b * band;
+    const int rlast = MIN(nrows, rfirst + band);
+    for (int cfirst = 0; cfirst < width; cfirst += tile)
+    {
+      const int count = MIN(tile, width - cfirst);
+      for (int row = rfirst; row < rlast; row++)
+      {
+        uchar *bufp = ((uchar *)scan0) + size_t(row) * size_t(stride) + size_t(cfirst) * colors * bytes;
+        const INT64 src = soff + (first_row + row) * rstep + INT64(cfirst) * cstep;
+        if (bytes == 1)
+          copy_mem_run(bufp, img, src, cstep, count, colors, bgr, curve);
+        else
+          copy_mem_run((ushort *)bufp, img, src, cstep, count, colors, bgr, curve);
+      }
+    }
+  });
+}
+
+int LibRaw::copy_mem_image(void *scan0, int stride, int bgr)
+
+{
+  // the image memory pointed to by scan0 is assumed to be in the format
+  // returned by get_mem_image_format
+  if ((imgdata.progress_flags & LIBRAW_PROGRESS_THUMB_MASK) <
+      LIBRAW_PROGRESS_PRE_INTERPOLATE)
+    return LIBRAW_OUT_OF_ORDER_CALL;
+
+  mem_image_curve();
 
   int s_iheight = S.iheight;
   int s_iwidth = S.iwidth;
@@ -221,58 +322,90 @@ int LibRaw::copy_mem_image(void *scan0, int stride, int bgr)
 
   if (S.flip & 4)
     SWAP(S.height, S.width);
-  uchar *ppm;
-  ushort *ppm2;
-  int c, row, col, soff, rstep, cstep;
 
-  soff = flip_index(0, 0);
-  cstep = flip_index(0, 1) - soff;
-  rstep = flip_index(1, 0) - flip_index(0, S.width);
+  copy_mem_rows(scan0, stride, bgr, 0, S.height);
 
-  for (row = 0; row < S.height; row++, soff += rstep)
+  S.iheight = s_iheight;
+  S.iwidth = s_iwidth;
+  S.width = s_width;
+  S.height = s_hwight;
+
+  return 0;
+}
+
+int LibRaw::dcraw_output_rows(output_rows_callback cb, void *cb_data, int band_height, int bgr)
+{
+  if ((imgdata.progress_flags & LIBRAW_PROGRESS_THUMB_MASK) <
+      LIBRAW_PROGRESS_PRE_INTERPOLATE)
+    return LIBRAW_OUT_OF_ORDER_CALL;
+  if (!cb)
+    return EINVAL;
+
+  int width, height, colors, bps;
+  get_mem_image_format(&width, &height, &colors, &bps);
+  if (band_height < 1)
+    band_height = 128;
+  band_height = MIN(band_height, height);
+  const int stride = width * (bps / 8) * colors;
+  uchar *band = (uchar *)::malloc(size_t(band_height) * size_t(stride));
+  if (!band)
+    return ENOMEM;
+
+  mem_image_curve();
+
+  int s_iheight = S.iheight;
+  int s_iwidth = S.iwidth;
+  int s_width = S.width;
+  int s_hwight = S.height;
+
+  S.iheight = S.height;
+  S.iwidth = S.width;
+
+  if (S.flip & 4)
+    SWAP(S.height, S.width);
+
+  int ret = 0;
+  for (int row = 0; row < S.height; row += band_height)
   {
-    uchar *bufp = ((uchar *)scan0) + size_t(row) * size_t(stride);
-    ppm2 = (ushort *)(ppm = bufp);
-    // keep trivial decisions in the outer loop for speed
-    if (bgr)
-    {
-      if (O.output_bps == 8)
-      {
-        for (col = 0; col < S.width; col++, soff += cstep)
-          FORBGR *ppm++ = imgdata.color.curve[imgdata.image[soff][c]] >> 8;
-      }
-      else
-      {
-        for (col = 0; col < S.width; col++, soff += cstep)
-          FORBGR *ppm2++ = imgdata.color.curve[imgdata.image[soff][c]];
-      }
-    }
-    else
+    const int nrows = MIN(band_height, S.height - row);
+    copy_mem_rows(band, stride, bgr, row, nrows);
+    if ((*cb)(cb_data, band, row, nrows, stride))
     {
-      if (O.output_bps == 8)
-      {
-        for (col = 0; col < S.width; col++, soff += cstep)
-          FORRGB *ppm++ = imgdata.color.curve[imgdata.image[soff][c]] >> 8;
-      }
-      else
-      {
-        for (col = 0; col < S.width; col++, soff += cstep)
-          FORRGB *ppm2++ = imgdata.color.curve[imgdata.image[soff][c]];
-      }
+      ret = LIBRAW_CANCELLED_BY_CALLBACK;
+      break;
     }
-
-    //            bufp += stride;           // go to the next line
   }
 
   S.iheight = s_iheight;
   S.iwidth = s_iwidth;
   S.width = s_width;
   S.height = s_hwight;
+  ::free(band);
 
-  return 0;
+  return ret;
+}
+
+libraw_processed_image_t *LibRaw::dcraw_make_mem_preview(int *errcode)
+{
+  libraw_processed_image_t *ret = NULL;
+  int save_half = O.half_size;
+  ushort save_width = imgdata.rawdata.sizes.width;
+  ushort save_height = imgdata.rawdata.sizes.height;
+  O.half_size = 1;
+  // even size, as open_datastream() sets it when half_size is set before open
+  if (imgdata.rawdata.iparams.filters >= 1000)
+  {
+    imgdata.rawdata.sizes.width &= 65534;
+    imgdata.rawdata.sizes.height &= 65534;
+  }
+  int rc = make_mem_preview(&ret);
+  O.half_size = save_half;
+  imgdata.rawdata.sizes.width = save_width;
+  imgdata.rawdata.sizes.height = save_height;
+  if (errcode)
+    *errcode = rc;
+  return ret;
 }
-#undef FORBGR
-#undef FORRGB
 
 libraw_processed_image_t *LibRaw::dcraw_make_mem_image(int *errcode)
 
@@ -30,12 +30,35 @@ void LibRaw::hat_transform(float *temp, float *base, int st, int size, int sc)
               base[st * (2 * size - 2 - (i + sc))];
 }
 
-#if !defined(LIBRAW_USE_OPENMP)
+/*
+  Vertical hat transform of a strip of WAVELET_STRIP columns: the strip is
+  gathered into contiguous rows first, so the transform runs along rows
+  instead of striding over the whole plane.
+*/
+#define WAVELET_STRIP 64
+LIBRAW_SIMD_CLONES
+static void wavelet_strip_rows(float *out, int stride, const float *strip,
+                               int count, int rows, int sc)
+{
+  for (int i = 0; i < rows; i++)
+  {
+    const float *s0 = strip + i * WAVELET_STRIP;
+    const float *sa = strip + (i < sc ? sc - i : i - sc) * WAVELET_STRIP;
+    const float *sb =
+        strip + (i + sc < rows ? i + sc : 2 * rows - 2 - (i + sc)) *
+                    WAVELET_STRIP;
+    for (int x = 0; x < count; x++)
+    {
+      float t = 2 * s0[x] + sa[x] + sb[x];
+      out[i * stride + x] = t * 0.25f;
+    }
+  }
+}
+
 void LibRaw::wavelet_denoise()
 {
-  float *fimg = 0, *temp, thold, mul[2], avg, diff;
-  int scale = 1, size, lev, hpass, lpass, row, col, nc, c, i, wlast, blk[2];
-  ushort *window[4];
+  float *fimg = 0, mul[2];
+  int scale = 1, size, lev, hpass, lpass, nc, c, blk[2];
   static const float noise[] = {0.8002f, 0.2735f, 0.1202f, 0.0585f,
                                 0.0291f, 0.0152f, 0.0080f, 0.0044f};
 
@@ -48,138 +71,43 @@ void LibRaw::wavelet_denoise()
   black <<= scale;
   FORC4 cblack[c] <<= scale;
   size = iheight * iwidth;
-  fimg = (float *)malloc((size * 3 + iheight + iwidth + 128) * sizeof *fimg);
-  temp = fimg + size * 3;
+  fimg = (float *)malloc(size_t(size) * 3 * sizeof *fimg);
+  int buffer_count = parallel_workers();
+  /* per thread: one row for the horizontal pass or one column strip */
+  char **buffers = malloc_omp_buffers(
+      buffer_count, MAX(iwidth, iheight * WAVELET_STRIP) * sizeof *fimg);
   if ((nc = colors) == 3 && filters)
     nc++;
   FORC(nc)
   { /* denoise R,G1,B,G3 individually */
-	  for (i = 0; i < size; i++)
-		  fimg[i] = 256.f * sqrtf((float)(image[i][c] << scale));
+    /* per-pixel passes go by rows, so each pool task gets a contiguous run */
+    parallel_for(iheight, [&](int row, int) {
+      for (int i = row * iwidth; i < (row + 1) * iwidth; i++)
+        fimg[i] = 256.f * sqrtf((float)(image[i][c] << scale));
+    });
     for (hpass = lev = 0; lev < 5; lev++)
     {
       lpass = size * ((lev & 1) + 1);
-      for (row = 0; row < iheight; row++)
-      {
+      parallel_for(iheight, [&](int row, int worker) {
+        float *temp = (float *)buffers[worker];
         hat_transform(temp, fimg + hpass + row * iwidth, 1, iwidth, 1 << lev);
-        for (col = 0; col < iwidth; col++)
+        for (int col = 0; col < iwidth; col++)
           fimg[lpass + row * iwidth + col] = temp[col] * 0.25f;
-      }
-      for (col = 0; col < iwidth; col++)
-      {
-        hat_transform(temp, fimg + lpass + col, iwidth, iheight, 1 << lev);
-        for (row = 0; row < iheight; row++)
-          fimg[lpass + row * iwidth + col] = temp[row] * 0.25f;
-      }
-      thold = threshold * noise[lev];
-      for (i = 0; i < size; i++)
-      {
-        fimg[hpass + i] -= fimg[lpass + i];
-        if (fimg[hpass + i] < -thold)
-          fimg[hpass + i] += thold;
-        else if (fimg[hpass + i] > thold)
-          fimg[hpass + i] -= thold;
-        else
-          fimg[hpass + i] = 0;
-        if (hpass)
-          fimg[i] += fimg[hpass + i];
-      }
-      hpass = lpass;
-    }
-    for (i = 0; i < size; i++)
-      image[i][c] = CLIP(SQR(fimg[i] + fimg[lpass + i]) / 0x10000);
-  }
-  if (filters && colors == 3)
-  { /* pull G1 and G3 closer together */
-    for (row = 0; row < 2; row++)
-    {
-      mul[row] = 0.125f * pre_mul[FC(row + 1, 0) | 1] / pre_mul[FC(row, 0) | 1];
-      blk[row] = cblack[FC(row, 0) | 1];
-    }
-    for (i = 0; i < 4; i++)
-      window[i] = (ushort *)fimg + width * i;
-    for (wlast = -1, row = 1; row < height - 1; row++)
-    {
-      while (wlast < row + 1)
-      {
-        for (wlast++, i = 0; i < 4; i++)
-          window[(i + 3) & 3] = window[i];
-        for (col = FC(wlast, 1) & 1; col < width; col += 2)
-          window[2][col] = BAYER(wlast, col);
-      }
-      thold = threshold / 512;
-      for (col = (FC(row, 0) & 1) + 1; col < width - 1; col += 2)
-      {
-        avg = (window[0][col - 1] + window[0][col + 1] + window[2][col - 1] +
-               window[2][col + 1] - blk[~row & 1] * 4) *
-                  mul[row & 1] +
-              (window[1][col] + blk[row & 1]) * 0.5f;
-        avg = avg < 0 ? 0 : sqrt(avg);
-        diff = sqrtf((float)BAYER(row, col)) - avg;
-        if (diff < -thold)
-          diff += thold;
-        else if (diff > thold)
-          diff -= thold;
-        else
-          diff = 0;
-        BAYER(row, col) = CLIP(SQR(avg + diff) + 0.5);
-      }
-    }
-  }
-  free(fimg);
-}
-#else /* LIBRAW_USE_OPENMP */
-void LibRaw::wavelet_denoise()
-{
-  float *fimg = 0, *temp, thold, mul[2], avg, diff;
-  int scale = 1, size, lev, hpass, lpass, row, col, nc, c, i, wlast, blk[2];
-  ushort *window[4];
-  static const float noise[] = {0.8002, 0.2735, 0.1202, 0.0585,
-                                0.0291, 0.0152, 0.0080, 0.0044};
-
-  if (iwidth < 65 || iheight < 65)
-    return;
-  if (int64_t(iwidth) * int64_t(iheight) >= 0x15540000LL)
-    return; // ensure pixel count less then 358M so total allocation size is less then 4GB
-
-  while (maximum << scale < 0x10000)
-    scale++;
-  maximum <<= --scale;
-  black <<= scale;
-  FORC4 cblack[c] <<= scale;
-  fimg = (float *)malloc((size * 3 + iheight + iwidth) * sizeof *fimg);
-  temp = fimg + size * 3;
-  if ((nc = colors) == 3 && filters)
-    nc++;
-#pragma omp parallel default(shared) private(                                  \
-    i, col, row, thold, lev, lpass, hpass, temp, c) firstprivate(scale, size)
-  {
-    temp = (float *)malloc((iheight + iwidth) * sizeof *fimg);
-    FORC(nc)
-    { /* denoise R,G1,B,G3 individually */
-#pragma omp for
-      for (i = 0; i < size; i++)
-        fimg[i] = 256 * sqrt((double)(image[i][c] << scale));
-      for (hpass = lev = 0; lev < 5; lev++)
-      {
-        lpass = size * ((lev & 1) + 1);
-#pragma omp for
-        for (row = 0; row < iheight; row++)
-        {
-          hat_transform(temp, fimg + hpass + row * iwidth, 1, iwidth, 1 << lev);
-          for (col = 0; col < iwidth; col++)
-            fimg[lpass + row * iwidth + col] = temp[col] * 0.25;
-        }
-#pragma omp for
-        for (col = 0; col < iwidth; col++)
-        {
-          hat_transform(temp, fimg + lpass + col, iwidth, iheight, 1 << lev);
-          for (row = 0; row < iheight; row++)
-            fimg[lpass + row * iwidth + col] = temp[row] * 0.25;
-        }
-        thold = threshold * noise[lev];
-#pragma omp for
-        for (i = 0; i < size; i++)
+      });
+      int strips = (iwidth + WAVELET_STRIP - 1) / WAVELET_STRIP;
+      parallel_for(strips, [&](int strip_no, int worker) {
+        int x0 = strip_no * WAVELET_STRIP;
+        float *strip = (float *)buffers[worker];
+        int count = MIN(WAVELET_STRIP, iwidth - x0);
+        for (int row = 0; row < iheight; row++)
+          memcpy(strip + row * WAVELET_STRIP, fimg + lpass + row * iwidth + x0,
+                 count * sizeof *strip);
+        wavelet_strip_rows(fimg + lpass + x0, iwidth, strip, count, iheight,
+                           1 << lev);
+      });
+      float thold = threshold * noise[lev];
+      parallel_for(iheight, [&](int row, int) {
+        for (int i = row * iwidth; i < (row + 1) * iwidth; i++)
         {
           fimg[hpass + i] -= fimg[lpass + i];
           if (fimg[hpass + i] < -thold)
@@ -191,45 +119,44 @@ void LibRaw::wavelet_denoise()
           if (hpass)
             fimg[i] += fimg[hpass + i];
         }
-        hpass = lpass;
-      }
-#pragma omp for
-      for (i = 0; i < size; i++)
-        image[i][c] = CLIP(SQR(fimg[i] + fimg[lpass + i]) / 0x10000);
+      });
+      hpass = lpass;
     }
-    free(temp);
-  } /* end omp parallel */
-  /* the following loops are hard to parallelize, no idea yes,
-   * problem is wlast which is carrying dependency
-   * second part should be easier, but did not yet get it right.
-   */
+    parallel_for(iheight, [&](int row, int) {
+      for (int i = row * iwidth; i < (row + 1) * iwidth; i++)
+        image[i][c] = CLIP(SQR(fimg[i] + fimg[lpass + i]) / 0x10000);
+    });
+  }
+  free_omp_buffers(buffers, buffer_count);
   if (filters && colors == 3)
   { /* pull G1 and G3 closer together */
-    for (row = 0; row < 2; row++)
+    for (int row = 0; row < 2; row++)
     {
-      mul[row] = 0.125 * pre_mul[FC(row + 1, 0) | 1] / pre_mul[FC(row, 0) | 1];
+      mul[row] = 0.125f * pre_mul[FC(row + 1, 0) | 1] / pre_mul[FC(row, 0) | 1];
       blk[row] = cblack[FC(row, 0) | 1];
     }
-    for (i = 0; i < 4; i++)
-      window[i] = (ushort *)fimg + width * i;
-    for (wlast = -1, row = 1; row < height - 1; row++)
-    {
-      while (wlast < row + 1)
-      {
-        for (wlast++, i = 0; i < 4; i++)
-          window[(i + 3) & 3] = window[i];
-        for (col = FC(wlast, 1) & 1; col < width; col += 2)
-          window[2][col] = BAYER(wlast, col);
-      }
-      thold = threshold / 512;
-      for (col = (FC(row, 0) & 1) + 1; col < width - 1; col += 2)
+    /*
+      Greens are smoothed in place using the original values of the
+      neighbouring rows, so keep a copy of all greens (it fits into fimg)
+    */
+    ushort *green = (ushort *)fimg;
+    parallel_for(height, [&](int row, int) {
+      for (int col = FC(row, 1) & 1; col < width; col += 2)
+        green[row * width + col] = BAYER(row, col);
+    });
+    float thold = threshold / 512;
+    parallel_for(1, height - 1, [&](int row, int) {
+      const ushort *window[3] = {green + (row - 1) * width, green + row * width,
+                                 green + (row + 1) * width};
+      for (int col = (FC(row, 0) & 1) + 1; col < width - 1; col += 2)
       {
+        float avg, diff;
         avg = (window[0][col - 1] + window[0][col + 1] + window[2][col - 1] +
                window[2][col + 1] - blk[~row & 1] * 4) *
                   mul[row & 1] +
-              (window[1][col] + blk[row & 1]) * 0.5;
+              (window[1][col] + blk[row & 1]) * 0.5f;
         avg = avg < 0 ? 0 : sqrt(avg);
-        diff = sqrt((double)BAYER(row, col)) - avg;
+        diff = sqrtf((float)BAYER(row, col)) - avg;
         if (diff < -thold)
           diff += thold;
         else if (diff > thold)
@@ -238,67 +165,91 @@ void LibRaw::wavelet_denoise()
           diff = 0;
         BAYER(row, col) = CLIP(SQR(avg + diff) + 0.5);
       }
-    }
+    });
   }
   free(fimg);
 }
+#undef WAVELET_STRIP
 
-#endif
-void LibRaw::median_filter()
+/*
+  Median of 3x3 neighbourhoods for a run of pixels: the optimal 9-element
+  median network is applied to all pixels of the run at once with
+  branchless min/max, so the compiler can vectorize it.
+*/
+#define MEDIAN_RUN 64
+static void median_run(ushort (*pix)[4], int stride, int count, int c)
 {
-  ushort(*pix)[4];
-  int pass, c, i, j, k, med[9];
   static const uchar opt[] = /* Optimal 9-element median search */
       {1, 2, 4, 5, 7, 8, 0, 1, 3, 4, 6, 7, 1, 2, 4, 5, 7, 8, 0,
        3, 5, 8, 4, 7, 3, 6, 1, 4, 2, 5, 4, 7, 4, 2, 6, 4, 4, 2};
+  int med[9][MEDIAN_RUN];
+  for (int k = 0, i = -stride; i <= stride; i += stride)
+    for (int j = i - 1; j <= i + 1; j++, k++)
+      for (int p = 0; p < count; p++)
+        med[k][p] = pix[p + j][3] - pix[p + j][1];
+  for (int i = 0; i < int(sizeof opt); i += 2)
+  {
+    int *lo = med[opt[i]], *hi = med[opt[i + 1]];
+    for (int p = 0; p < count; p++)
+    {
+      int a = lo[p], b = hi[p];
+      lo[p] = a < b ? a : b;
+      hi[p] = a < b ? b : a;
+    }
+  }
+  for (int p = 0; p < count; p++)
+    pix[p][c] = CLIP(med[4][p] + pix[p][1]);
+}
+
+void LibRaw::median_filter()
+{
+  int pass, c;
 
   for (pass = 1; pass <= med_passes; pass++)
   {
     RUN_CALLBACK(LIBRAW_PROGRESS_MEDIAN_FILTER, pass - 1, med_passes);
     for (c = 0; c < 3; c += 2)
     {
-      for (pix = image; pix < image + width * height; pix++)
-        pix[0][3] = pix[0][c];
-      for (pix = image + width; pix < image + width * (height - 1); pix++)
-      {
-        if ((pix - image + 1) % width < 2)
-          continue;
-        for (k = 0, i = -width; i <= width; i += width)
-          for (j = i - 1; j <= i + 1; j++)
-            med[k++] = pix[j][3] - pix[j][1];
-        for (i = 0; i < int(sizeof opt); i += 2)
-          if (med[opt[i]] > med[opt[i + 1]])
-            SWAP(med[opt[i]], med[opt[i + 1]]);
-        pix[0][c] = CLIP(med[4] + pix[0][1]);
-      }
+      parallel_for(height, [&](int row, int) {
+        for (int col = 0; col < width; col++)
+          image[row * width + col][3] = image[row * width + col][c];
+      });
+      parallel_for(1, height - 1, [&](int row, int) {
+        for (int col = 1; col < width - 1; col += MEDIAN_RUN)
+          median_run(image + row * width + col, width,
+                     MIN(MEDIAN_RUN, width - 1 - col), c);
+      });
     }
   }
 }
+#undef MEDIAN_RUN
 
 void LibRaw::blend_highlights()
 {
-  int clip = INT_MAX, row, col, c, i, j;
+  int clip = INT_MAX, c, i;
   static const float trans[2][4][4] = {
       {{1, 1, 1}, {1.7320508f, -1.7320508f, 0}, {-1, -1, 2}},
       {{1, 1, 1, 1}, {1, -1, 1, -1}, {1, 1, -1, -1}, {1, -1, -1, 1}}};
   static const float itrans[2][4][4] = {
       {{1, 0.8660254f, -0.5}, {1, -0.8660254f, -0.5}, {1, 0, 1}},
       {{1, 1, 1, 1}, {1, -1, 1, -1}, {1, 1, -1, -1}, {1, -1, -1, 1}}};
-  float cam[2][4], lab[2][4], sum[2], chratio;
 
   if ((unsigned)(colors - 3) > 1)
     return;
   RUN_CALLBACK(LIBRAW_PROGRESS_HIGHLIGHTS, 0, 2);
   FORCC if (clip > (i = int(65535.f * pre_mul[c]))) clip = i;
-  for (row = 0; row < height; row++)
-    for (col = 0; col < width; col++)
+  parallel_for(height, [&](int row, int) {
+    for (int col = 0; col < width; col++)
     {
-      FORCC if (image[row * width + col][c] > clip) break;
+      float cam[2][4], lab[2][4], sum[2], chratio;
+      ushort *pixel = image[row * width + col];
+      int c, i, j;
+      FORCC if (pixel[c] > clip) break;
       if (c == colors)
         continue;
       FORCC
       {
-        cam[0][c] = image[row * width + col][c];
+        cam[0][c] = pixel[c];
         cam[1][c] = MIN(cam[0][c], clip);
       }
       for (i = 0; i < 2; i++)
@@ -313,18 +264,18 @@ void LibRaw::blend_highlights()
         lab[0][c] *= chratio;
       FORCC for (cam[0][c] = 0, j = 0; j < colors; j++) cam[0][c] +=
           itrans[colors - 3][c][j] * lab[0][j];
-      FORCC image[row * width + col][c] = ushort(cam[0][c] / colors);
+      FORCC pixel[c] = ushort(cam[0][c] / colors);
     }
+  });
   RUN_CALLBACK(LIBRAW_PROGRESS_HIGHLIGHTS, 1, 2);
 }
 
 #define SCALE (4 >> shrink)
 void LibRaw::recover_highlights()
 {
-  float *map, sum, wgt, grow;
-  int hsat[4], count, spread, change, val, i;
-  unsigned high, wide, mrow, mcol, row, col, kc, c, d, y, x;
-  ushort *pixel;
+  float *map, grow;
+  int hsat[4], spread, change, i;
+  unsigned high, wide, kc, c;
   static const signed char dir[8][2] = {{-1, -1}, {-1, 0}, {-1, 1}, {0, 1},
                                         {1, 1},   {1, 0},  {1, -1}, {0, -1}};
 
@@ -343,15 +294,15 @@ void LibRaw::recover_highlights()
   {
     RUN_CALLBACK(LIBRAW_PROGRESS_HIGHLIGHTS, c - 1, colors - 1);
     memset(map, 0, high * wide * sizeof *map);
-    for (mrow = 0; mrow < high; mrow++)
-      for (mcol = 0; mcol < wide; mcol++)
+    parallel_for(int(high), [&](unsigned mrow, int) {
+      for (unsigned mcol = 0; mcol < wide; mcol++)
       {
-        count = 0;
-		sum = wgt = 0;
-        for (row = mrow * SCALE; row < (mrow + 1) * SCALE; row++)
-          for (col = mcol * SCALE; col < (mcol + 1) * SCALE; col++)
+        int count = 0;
+        float sum = 0, wgt = 0;
+        for (unsigned row = mrow * SCALE; row < (mrow + 1) * SCALE; row++)
+          for (unsigned col = mcol * SCALE; col < (mcol + 1) * SCALE; col++)
           {
-            pixel = image[row * width + col];
+            ushort *pixel = image[row * width + col];
             if (pixel[c] / hsat[c] == 1 && pixel[kc] > 24000)
             {
               sum += pixel[c];
@@ -362,19 +313,24 @@ void LibRaw::recover_highlights()
         if (count == SCALE * SCALE)
           map[mrow * wide + mcol] = sum / wgt;
       }
+    });
     for (spread = int(32.f / grow); spread--;)
     {
-      for (mrow = 0; mrow < high; mrow++)
-        for (mcol = 0; mcol < wide; mcol++)
+      /*
+        Cells filled on this step are stored negated and are not used as
+        sources until the step is over, so rows are independent.
+      */
+      parallel_for(int(high), [&](unsigned mrow, int) {
+        for (unsigned mcol = 0; mcol < wide; mcol++)
         {
           if (map[mrow * wide + mcol])
             continue;
-		  sum = 0;
-		  count = 0;
-          for (d = 0; d < 8; d++)
+          float sum = 0;
+          int count = 0;
+          for (unsigned d = 0; d < 8; d++)
           {
-            y = mrow + dir[d][0];
-            x = mcol + dir[d][1];
+            unsigned y = mrow + dir[d][0];
+            unsigned x = mcol + dir[d][1];
             if (y < high && x < wide && map[y * wide + x] > 0)
             {
               sum += (1 + (d & 1)) * map[y * wide + x];
@@ -384,6 +340,7 @@ void LibRaw::recover_highlights()
           if (count > 3)
             map[mrow * wide + mcol] = -(sum + grow) / (count + grow);
         }
+      });
       for (change = i = 0; i < int(high * wide); i++)
         if (map[i] < 0)
         {
@@ -396,21 +353,22 @@ void LibRaw::recover_highlights()
     for (i = 0; i < int(high * wide); i++)
       if (map[i] == 0)
         map[i] = 1;
-    for (mrow = 0; mrow < high; mrow++)
-      for (mcol = 0; mcol < wide; mcol++)
+    parallel_for(int(high), [&](unsigned mrow, int) {
+      for (unsigned mcol = 0; mcol < wide; mcol++)
       {
-        for (row = mrow * SCALE; row < (mrow + 1) * SCALE; row++)
-          for (col = mcol * SCALE; col < (mcol + 1) * SCALE; col++)
+        for (unsigned row = mrow * SCALE; row < (mrow + 1) * SCALE; row++)
+          for (unsigned col = mcol * SCALE; col < (mcol + 1) * SCALE; col++)
           {
-            pixel = image[row * width + col];
+            ushort *pixel = image[row * width + col];
             if (pixel[c] / hsat[c] > 1)
             {
-              val = int(pixel[kc] * map[mrow * wide + mcol]);
+              int val = int(pixel[kc] * map[mrow * wide + mcol]);
               if (pixel[c] < val)
                 pixel[c] = CLIP(val);
             }
           }
       }
+    });
   }
   free(map);
 }
@@ -76,115 +76,534 @@ void LibRaw::exp_bef(float shift, float smooth)
   free(lut);
 }
 
-void LibRaw::convert_to_rgb_loop(float out_cam[3][4])
+// Converts count pixels starting at img and adds them to hist (if not NULL).
+// Matrix multiply is split from histogram update so the first loop has no
+// scattered stores and can be vectorized; float math order is unchanged.
+LIBRAW_SIMD_CLONES
+static void convert_to_rgb_block(ushort (*img)[4], size_t count, int colors, int raw_color,
+                                 const float out_cam[3][4], int (*hist)[LIBRAW_HISTOGRAM_SIZE])
 {
-  int row, col, c;
-  float out[3];
-  ushort *img;
-  memset(libraw_internal_data.output_data.histogram, 0,
-         sizeof(int) * LIBRAW_HISTOGRAM_SIZE * 4);
-  if (libraw_internal_data.internal_output_params.raw_color)
+  if (raw_color)
+    ;
+  else if (colors == 3)
   {
-    for (img = imgdata.image[0], row = 0; row < S.height; row++)
+    for (size_t i = 0; i < count; i++)
     {
-      for (col = 0; col < S.width; col++, img += 4)
-      {
-        for (c = 0; c < imgdata.idata.colors; c++)
-        {
-          libraw_internal_data.output_data.histogram[c][img[c] >> 3]++;
-        }
-      }
+      float out0 = out_cam[0][0] * img[i][0] + out_cam[0][1] * img[i][1] + out_cam[0][2] * img[i][2];
+      float out1 = out_cam[1][0] * img[i][0] + out_cam[1][1] * img[i][1] + out_cam[1][2] * img[i][2];
+      float out2 = out_cam[2][0] * img[i][0] + out_cam[2][1] * img[i][1] + out_cam[2][2] * img[i][2];
+      img[i][0] = CLIP((int)out0);
+      img[i][1] = CLIP((int)out1);
+      img[i][2] = CLIP((int)out2);
     }
   }
-  else if (imgdata.idata.colors == 3)
+  else if (colors == 4)
   {
-    for (img = imgdata.image[0], row = 0; row < S.height; row++)
+    for (size_t i = 0; i < count; i++)
     {
-      for (col = 0; col < S.width; col++, img += 4)
-      {
-        out[0] = out_cam[0][0] * img[0] + out_cam[0][1] * img[1] +
-                 out_cam[0][2] * img[2];
-        out[1] = out_cam[1][0] * img[0] + out_cam[1][1] * img[1] +
-                 out_cam[1][2] * img[2];
-        out[2] = out_cam[2][0] * img[0] + out_cam[2][1] * img[1] +
-                 out_cam[2][2] * img[2];
-        img[0] = CLIP((int)out[0]);
-        img[1] = CLIP((int)out[1]);
-        img[2] = CLIP((int)out[2]);
-        libraw_internal_data.output_data.histogram[0][img[0] >> 3]++;
-        libraw_internal_data.output_data.histogram[1][img[1] >> 3]++;
-        libraw_internal_data.output_data.histogram[2][img[2] >> 3]++;
-      }
+      float out0 = out_cam[0][0] * img[i][0] + out_cam[0][1] * img[i][1] + out_cam[0][2] * img[i][2] +
+                   out_cam[0][3] * img[i][3];
+      float out1 = out_cam[1][0] * img[i][0] + out_cam[1][1] * img[i][1] + out_cam[1][2] * img[i][2] +
+                   out_cam[1][3] * img[i][3];
+      float out2 = out_cam[2][0] * img[i][0] + out_cam[2][1] * img[i][1] + out_cam[2][2] * img[i][2] +
+                   out_cam[2][3] * img[i][3];
+      img[i][0] = CLIP((int)out0);
+      img[i][1] = CLIP((int)out1);
+      img[i][2] = CLIP((int)out2);
     }
   }
-  else if (imgdata.idata.colors == 4)
+  else
+    return; // nothing converted, histogram stays empty
+
+  if (!hist)
+    return;
+  for (size_t i = 0; i < count; i++)
+    for (int c = 0; c < colors; c++)
+      hist[c][img[i][c] >> 3]++;
+}
+
+void LibRaw::convert_to_rgb_loop(float out_cam[3][4])
+{
+  int(*histogram)[LIBRAW_HISTOGRAM_SIZE] = libraw_internal_data.output_data.histogram;
+  const int colors = imgdata.idata.colors;
+  const int raw_color = libraw_internal_data.internal_output_params.raw_color;
+  const size_t pixels = size_t(S.height) * size_t(S.width);
+
+  memset(histogram, 0, sizeof(int) * LIBRAW_HISTOGRAM_SIZE * 4);
+
+  const size_t block = 0x10000; // pixels per work item
+  const int blocks = int((pixels + block - 1) / block);
+  const int workers = parallel_workers();
+  if (workers > 1 && blocks > 1)
   {
-    for (img = imgdata.image[0], row = 0; row < S.height; row++)
+    // private histograms, summed after the loop
+    std::vector<int> thist(size_t(workers - 1) * LIBRAW_HISTOGRAM_SIZE * 4);
+    parallel_for(blocks, [&](int b, int worker) {
+      int(*hist)[LIBRAW_HISTOGRAM_SIZE] =
+          worker ? (int(*)[LIBRAW_HISTOGRAM_SIZE])(thist.data() + size_t(worker - 1) * LIBRAW_HISTOGRAM_SIZE * 4) : histogram;
+      const size_t first = size_t(b) * block;
+      convert_to_rgb_block(imgdata.image + first, MIN(block, pixels - first), colors, raw_color, out_cam, hist);
+    });
+    for (int t = 0; t < workers - 1; t++)
     {
-      for (col = 0; col < S.width; col++, img += 4)
-      {
-        out[0] = out_cam[0][0] * img[0] + out_cam[0][1] * img[1] +
-                 out_cam[0][2] * img[2] + out_cam[0][3] * img[3];
-        out[1] = out_cam[1][0] * img[0] + out_cam[1][1] * img[1] +
-                 out_cam[1][2] * img[2] + out_cam[1][3] * img[3];
-        out[2] = out_cam[2][0] * img[0] + out_cam[2][1] * img[1] +
-                 out_cam[2][2] * img[2] + out_cam[2][3] * img[3];
-        img[0] = CLIP((int)out[0]);
-        img[1] = CLIP((int)out[1]);
-        img[2] = CLIP((int)out[2]);
-        libraw_internal_data.output_data.histogram[0][img[0] >> 3]++;
-        libraw_internal_data.output_data.histogram[1][img[1] >> 3]++;
-        libraw_internal_data.output_data.histogram[2][img[2] >> 3]++;
-        libraw_internal_data.output_data.histogram[3][img[3] >> 3]++;
-      }
+      const int *src = thist.data() + size_t(t) * LIBRAW_HISTOGRAM_SIZE * 4;
+      for (int i = 0; i < LIBRAW_HISTOGRAM_SIZE * 4; i++)
+        histogram[0][i] += src[i];
     }
+    return;
   }
+  convert_to_rgb_block(imgdata.image, pixels, colors, raw_color, out_cam, histogram);
+}
+
+LIBRAW_SIMD_CLONES
+static void scale_colors_run(ushort (*pix)[4], int count, const int black[4],
+                             const float scale_mul[4])
+{
+  for (int i = 0; i < count; i++)
+    for (int c = 0; c < 4; c++)
+    {
+      int val = pix[i][c];
+      if (!val) continue;
+      val -= black[c];
+      val = int(val * scale_mul[c]);
+      pix[i][c] = CLIP(val);
+    }
+}
+
+LIBRAW_SIMD_CLONES
+static void scale_colors_run(ushort (*pix)[4], int count,
+                             const float scale_mul[4])
+{
+  for (int i = 0; i < count; i++)
+    for (int c = 0; c < 4; c++)
+    {
+      int val = pix[i][c];
+      val = int(val * scale_mul[c]);
+      pix[i][c] = CLIP(val);
+    }
 }
 
 void LibRaw::scale_colors_loop(float scale_mul[4])
 {
-  unsigned size = S.iheight * S.iwidth;
+  const int iwidth = S.iwidth;
+  const int pattern = C.cblack[4] && C.cblack[5] ? int(C.cblack[5]) : 0;
+  const int black = C.cblack[0] || C.cblack[1] || C.cblack[2] || C.cblack[3];
+  const int cblack[4] = {int(C.cblack[0]), int(C.cblack[1]), int(C.cblack[2]),
+                         int(C.cblack[3])};
 
-  if (C.cblack[4] && C.cblack[5])
-  {
-    int val;
-    for (unsigned i = 0; i < size; i++)
+  parallel_for(S.iheight, [&](int row, int) {
+    ushort(*pix)[4] = imgdata.image + size_t(row) * iwidth;
+    if (pattern)
     {
-      for (unsigned c = 0; c < 4; c++)
+      /* black levels of the pattern row, indexed by col % pattern */
+      const unsigned *rowblack =
+          C.cblack + 6 + unsigned(row) % C.cblack[4] * C.cblack[5];
+      for (int col = 0, k = 0; col < iwidth; col++)
       {
-        if (!(val = imgdata.image[i][c])) continue;
-        val -= C.cblack[6 + i / S.iwidth % C.cblack[4] * C.cblack[5] +
-                        i % S.iwidth % C.cblack[5]];
-        val -= C.cblack[c];
-        val = int(val * scale_mul[c]);
-        imgdata.image[i][c] = CLIP(val);
+        int bl = rowblack[k];
+        for (int c = 0; c < 4; c++)
+        {
+          int val = pix[col][c];
+          if (!val) continue;
+          val -= bl;
+          val -= C.cblack[c];
+          val = int(val * scale_mul[c]);
+          pix[col][c] = CLIP(val);
+        }
+        if (++k == pattern)
+          k = 0;
       }
     }
+    else if (black)
+      scale_colors_run(pix, iwidth, cblack, scale_mul);
+    else // BL is zero
+      scale_colors_run(pix, iwidth, scale_mul);
+  });
+}
+
+// Output curve for count RGB pixels, source step pstep, destination step dstep
+LIBRAW_SIMD_CLONES
+static void curve_rgb_run(uchar *dst, INT64 dstep, const ushort *p, size_t pstep,
+                          int count, const ushort *curve)
+{
+  for (int col = 0; col < count; col++, dst += dstep, p += pstep)
+  {
+    dst[0] = uchar(curve[p[0]] >> 8);
+    dst[1] = uchar(curve[p[1]] >> 8);
+    dst[2] = uchar(curve[p[2]] >> 8);
   }
-  else if (C.cblack[0] || C.cblack[1] || C.cblack[2] || C.cblack[3])
+}
+
+LIBRAW_SIMD_CLONES
+static void curve_rgb_run(ushort *dst, INT64 dstep, const ushort *p, size_t pstep,
+                          int count, const ushort *curve)
+{
+  for (int col = 0; col < count; col++, dst += dstep, p += pstep)
   {
-    for (unsigned i = 0; i < size; i++)
+    dst[0] = curve[p[0]];
+    dst[1] = curve[p[1]];
+    dst[2] = curve[p[2]];
+  }
+}
+
+/*
+  Half-size preview straight from raw_image, see dcraw_make_mem_preview().
+  Each output row is built from two raw rows in a one-row buffer, the same
+  way raw2image_ex(), scale_colors(), pre_interpolate(), convert_to_rgb()
+  and copy_mem_image() process it in half_size mode, so the result is the
+  same as with half_size set before open_file(): dcraw_make_mem_preview()
+  rounds Bayer sizes to even as open_datastream() does. Setups this pass
+  does not cover go through dcraw_process().
+*/
+int LibRaw::make_mem_preview(libraw_processed_image_t **out)
+{
+  CHECK_ORDER_LOW(LIBRAW_PROGRESS_LOAD_RAW);
+  if (!imgdata.rawdata.raw_image && !imgdata.rawdata.color3_image &&
+      !imgdata.rawdata.color4_image)
+    return LIBRAW_OUT_OF_ORDER_CALL;
+
+  // per-worker row buffers, converted pixels and the output bitmap; freed on
+  // every exit path, the bitmap unless it is returned
+  int workers = 0;
+  char **buffers = 0;
+  ushort(*rgb)[3] = 0;
+  libraw_processed_image_t *ret = 0;
+  auto release = [&]() {
+    free(rgb);
+    rgb = 0;
+    if (buffers)
+      free_omp_buffers(buffers, workers);
+    buffers = 0;
+  };
+
+  try
+  {
+    raw2image_start();
+
+    const int raw_color = IO.raw_color || O.output_color < 1 || O.output_color > 8;
+    bool fused =
+        imgdata.rawdata.raw_image && P1.colors == 3 && !P1.is_foveon &&
+        (P1.filters > 1000 || P1.filters == LIBRAW_XTRANS) && !IO.fuji_width &&
+        !IO.zero_is_bad && !is_phaseone_compressed() && !is_canon_600() &&
+        !(~O.cropbox[2] && ~O.cropbox[3]) && !O.bad_pixels && !O.dark_frame &&
+        !O.no_auto_scale && !O.threshold && O.aber[0] == 1 && O.aber[2] == 1 &&
+        O.exp_correc <= 0 && O.med_passes <= 0 && O.highlight < 2 &&
+        !O.camera_profile && (O.output_bps == 8 || O.output_bps == 16) &&
+        !(O.use_fuji_rotate && (S.pixel_aspect < 0.995 || S.pixel_aspect > 1.005)) &&
+        !(O.four_color_rgb && raw_color) && !scale_colors_auto_wb() &&
+        !callbacks.pre_subtractblack_cb && !callbacks.pre_scalecolors_cb &&
+        !callbacks.pre_preinterpolate_cb && !callbacks.pre_interpolate_cb &&
+        !callbacks.post_interpolate_cb && !callbacks.pre_converttorgb_cb &&
+        !callbacks.post_converttorgb_cb;
+
+    // raw2image_ex(): black levels and data maximum
+    const int rows = MAX(0, MIN(int(S.height), int(S.raw_height) - int(S.top_margin)));
+    const int cols = MAX(0, MIN(int(S.width), int(S.raw_width) - int(S.left_margin)));
+    unsigned short cblack[4] = {0, 0, 0, 0};
+    unsigned short dmax = 0;
+    if (fused)
     {
-      for (unsigned c = 0; c < 4; c++)
+      adjust_bl();
+      for (int i = 0; i < 4; i++)
+        cblack[i] = (unsigned short)C.cblack[i];
+      const int workers = parallel_workers();
+      std::vector<unsigned short> wdmax(workers);
+      parallel_for(rows, [&](int row, int worker) {
+        const ushort *src = imgdata.rawdata.raw_image +
+                            (row + S.top_margin) * S.raw_pitch / 2 + S.left_margin;
+        unsigned short bl[6], ldmax = wdmax[worker];
+        for (int k = 0; k < 6; k++)
+          bl[k] = cblack[fcol(row, k)];
+        if (P1.filters > 1000)
+        {
+          // Bayer: black level repeats every two columns
+          unsigned short m0 = 0, m1 = 0;
+          int col = 0;
+          for (; col < cols - 1; col += 2)
+          {
+            const ushort v0 = src[col] > bl[0] ? src[col] - bl[0] : 0;
+            const ushort v1 = src[col + 1] > bl[1] ? src[col + 1] - bl[1] : 0;
+            m0 = MAX(m0, v0);
+            m1 = MAX(m1, v1);
+          }
+          if (col < cols && src[col] > bl[0])
+            m0 = MAX(m0, ushort(src[col] - bl[0]));
+          wdmax[worker] = MAX(ldmax, MAX(m0, m1));
+          return;
+        }
+        for (int col = 0, k = 0; col < cols; col++)
+        {
+          if (src[col] > bl[k] && src[col] - bl[k] > ldmax)
+            ldmax = src[col] - bl[k];
+          if (++k == 6)
+            k = 0;
+        }
+        wdmax[worker] = ldmax;
+      });
+      for (int i = 0; i < workers; i++)
+        dmax = MAX(dmax, wdmax[i]);
+      fused = dmax > 0; // dcraw_process() subtracts black again then
+    }
+    if (!fused)
+    {
+      int rc = dcraw_process();
+      if (rc != LIBRAW_SUCCESS)
+        return rc;
+      rc = 0;
+      *out = dcraw_make_mem_image(&rc);
+      return *out ? LIBRAW_SUCCESS : rc;
+    }
+    C.data_maximum = dmax;
+    C.maximum -= C.black;
+    C.cblack[0] = C.cblack[1] = C.cblack[2] = C.cblack[3] = 0;
+    C.black = 0;
+
+    libraw_decoder_info_t di;
+    get_decoder_info(&di);
+    if (!(di.decoder_flags & LIBRAW_DECODER_FIXEDMAXC))
+      adjust_maximum();
+    if (O.user_sat > 0)
+      C.maximum = O.user_sat;
+
+    // scale_colors()
+    float scale_mul[4];
+    if (O.user_mul[0])
+      memcpy(C.pre_mul, O.user_mul, sizeof C.pre_mul);
+    scale_colors_camera_wb();
+    scale_colors_mul(scale_mul);
+    const int pattern = C.cblack[4] && C.cblack[5] ? int(C.cblack[5]) : 0;
+    const int black = C.cblack[0] || C.cblack[1] || C.cblack[2] || C.cblack[3];
+    const int cblack4[4] = {int(C.cblack[0]), int(C.cblack[1]), int(C.cblack[2]),
+                            int(C.cblack[3])};
+
+    // pre_interpolate(): image is half size, greens are mixed back unless
+    // four_color_rgb is set
+    S.height = S.iheight;
+    S.width = S.iwidth;
+    const int iwidth = S.iwidth;
+    const int mix_green = P1.filters > 1000 && !O.four_color_rgb;
+    const int xtrans = P1.filters == LIBRAW_XTRANS;
+
+    auto scaled_row = [&](int row, ushort(*pix)[4]) {
+      memset(pix, 0, iwidth * sizeof *pix);
+      for (int rr = row * 2; rr < MIN(row * 2 + 2, rows); rr++)
       {
-        int val = imgdata.image[i][c];
-        if (!val) continue;
-        val -= C.cblack[c];
-        val = int(val * scale_mul[c]);
-        imgdata.image[i][c] = CLIP(val);
+        const ushort *src = imgdata.rawdata.raw_image +
+                            (rr + S.top_margin) * S.raw_pitch / 2 + S.left_margin;
+        if (P1.filters > 1000)
+        {
+          // Bayer: both pixels of a 2x2 cell row go to the same image pixel
+          const int c0 = fcol(rr, 0), c1 = fcol(rr, 1);
+          const ushort b0 = cblack[c0], b1 = cblack[c1];
+          int col = 0;
+          for (; col < cols - 1; col += 2)
+          {
+            pix[col >> 1][c0] = src[col] > b0 ? src[col] - b0 : 0;
+            pix[col >> 1][c1] = src[col + 1] > b1 ? src[col + 1] - b1 : 0;
+          }
+          if (col < cols)
+            pix[col >> 1][c0] = src[col] > b0 ? src[col] - b0 : 0;
+          continue;
+        }
+        int cc[6];
+        for (int k = 0; k < 6; k++)
+          cc[k] = fcol(rr, k);
+        for (int col = 0, k = 0; col < cols; col++)
+        {
+          const int c = cc[k];
+          pix[col >> 1][c] = src[col] > cblack[c] ? src[col] - cblack[c] : 0;
+          if (++k == 6)
+            k = 0;
+        }
+      }
+      if (pattern)
+      {
+        const unsigned *rowblack =
+            C.cblack + 6 + unsigned(row) % C.cblack[4] * C.cblack[5];
+        for (int col = 0, k = 0; col < iwidth; col++)
+        {
+          for (int c = 0; c < 4; c++)
+          {
+            int val = pix[col][c];
+            if (!val)
+              continue;
+            val -= rowblack[k];
+            val -= C.cblack[c];
+            val = int(val * scale_mul[c]);
+            pix[col][c] = CLIP(val);
+          }
+          if (++k == pattern)
+            k = 0;
+        }
+      }
+      else if (black)
+        scale_colors_run(pix, iwidth, cblack4, scale_mul);
+      else
+        scale_colors_run(pix, iwidth, scale_mul);
+    };
+
+    // X-Trans: every third pixel of every third row gets red and blue from
+    // its neighbours, the phase is found on the first rows
+    int xrow = 3, xcol = 1;
+    if (xtrans)
+    {
+      std::vector<ushort> tmpbuf(size_t(iwidth) * 4);
+      ushort(*tmp)[4] = (ushort(*)[4])tmpbuf.data();
+      for (int row = 0; row < MIN(3, S.iheight) && xrow == 3; row++)
+      {
+        scaled_row(row, tmp);
+        for (int col = 1; col < MIN(4, iwidth); col++)
+          if (!(tmp[col][0] | tmp[col][2]))
+          {
+            xrow = row;
+            xcol = col;
+            break;
+          }
       }
     }
-  }
-  else // BL is zero
-  {
-    for (unsigned i = 0; i < size; i++)
+
+    // convert_to_rgb()
+    P1.colors = mix_green ? 3 : 4;
+    gamma_curve(O.gamm[0], O.gamm[1], 0, 0);
+    IO.raw_color = raw_color;
+    float out_cam[3][4];
+    convert_to_rgb_matrix(out_cam);
+    const int colors = P1.colors;
+    if (P1.colors == 4 && O.output_color)
+      P1.colors = 3;
+
+    auto rgb_row = [&](int row, ushort(*pix)[4],
+                       int(*hist)[LIBRAW_HISTOGRAM_SIZE]) {
+      scaled_row(row, pix);
+      if (xtrans && row >= xrow && (row - xrow) % 3 == 0)
+        for (int col = xcol; col < iwidth - 1; col += 3)
+          for (int c = 0; c < 3; c += 2)
+            pix[col][c] = (pix[col - 1][c] + pix[col + 1][c]) >> 1;
+      if (mix_green)
+        for (int col = 0; col < iwidth; col++)
+          pix[col][1] = (pix[col][1] + pix[col][3]) >> 1;
+      convert_to_rgb_block(pix, iwidth, colors, raw_color, out_cam, hist);
+    };
+
+    workers = parallel_workers();
+    buffers = malloc_omp_buffers(workers, iwidth * sizeof(ushort[4]));
+    const int band = 16;
+    const int bands = (S.iheight + band - 1) / band;
+
+    // histogram for auto-brightness, as convert_to_rgb_loop() collects it;
+    // the converted pixels are kept so the output pass only applies the curve
+    if (!libraw_internal_data.output_data.histogram)
+      libraw_internal_data.output_data.histogram =
+          (int(*)[LIBRAW_HISTOGRAM_SIZE])calloc(
+              1, sizeof(*libraw_internal_data.output_data.histogram) * 4);
+    int(*histogram)[LIBRAW_HISTOGRAM_SIZE] = libraw_internal_data.output_data.histogram;
+    memset(histogram, 0, sizeof(int) * LIBRAW_HISTOGRAM_SIZE * 4);
+    if (!((O.highlight & ~2) || O.no_auto_bright))
+    {
+      rgb = (ushort(*)[3])malloc(size_t(S.iheight) * iwidth * sizeof *rgb);
+      if (!rgb)
+        throw LIBRAW_EXCEPTION_ALLOC;
+      std::vector<int> thist(size_t(workers - 1) * LIBRAW_HISTOGRAM_SIZE * 4);
+      parallel_for(bands, [&](int b, int worker) {
+        int(*hist)[LIBRAW_HISTOGRAM_SIZE] =
+            worker ? (int(*)[LIBRAW_HISTOGRAM_SIZE])(thist.data() + size_t(worker - 1) * LIBRAW_HISTOGRAM_SIZE * 4)
+                   : histogram;
+        ushort(*pix)[4] = (ushort(*)[4])buffers[worker];
+        for (int row = b * band; row < MIN((b + 1) * band, S.iheight); row++)
+        {
+          rgb_row(row, pix, hist);
+          ushort(*dst)[3] = rgb + size_t(row) * iwidth;
+          for (int col = 0; col < iwidth; col++)
+          {
+            dst[col][0] = pix[col][0];
+            dst[col][1] = pix[col][1];
+            dst[col][2] = pix[col][2];
+          }
+        }
+      });
+      for (int t = 0; t < workers - 1; t++)
+      {
+        const int *src = thist.data() + size_t(t) * LIBRAW_HISTOGRAM_SIZE * 4;
+        for (int i = 0; i < LIBRAW_HISTOGRAM_SIZE * 4; i++)
+          histogram[0][i] += src[i];
+      }
+    }
+
+    // copy_mem_image(): output curve and flip
+    mem_image_curve();
+    const int bytes = O.output_bps / 8;
+    const int owidth = (S.flip & 4) ? S.iheight : S.iwidth;
+    const int oheight = (S.flip & 4) ? S.iwidth : S.iheight;
+    const INT64 ds = INT64(owidth) * oheight * 3 * bytes;
+    ret = (libraw_processed_image_t *)::malloc(sizeof(libraw_processed_image_t) + ds);
+    if (!ret)
     {
-      for (unsigned c = 0; c < 4; c++)
+      release();
+      return ENOMEM;
+    }
+    memset(ret, 0, sizeof(libraw_processed_image_t));
+    ret->type = LIBRAW_IMAGE_BITMAP;
+    ret->height = oheight;
+    ret->width = owidth;
+    ret->colors = 3;
+    ret->bits = O.output_bps;
+    ret->data_size = unsigned(ds);
+
+    // output pixel index of image pixel (row, col), inverse of flip_index()
+    auto out_index = [&](int row, int col) -> INT64 {
+      if (S.flip & 2)
+        row = S.iheight - 1 - row;
+      if (S.flip & 1)
+        col = S.iwidth - 1 - col;
+      if (S.flip & 4)
+        std::swap(row, col);
+      return INT64(row) * owidth + col;
+    };
+    const INT64 ooff = out_index(0, 0);
+    const INT64 orstep = out_index(1, 0) - ooff;
+    const INT64 ocstep = out_index(0, 1) - ooff;
+    const ushort *curve = C.curve;
+    parallel_for(bands, [&](int b, int worker) {
+      ushort(*pix)[4] = (ushort(*)[4])buffers[worker];
+      for (int row = b * band; row < MIN((b + 1) * band, S.iheight); row++)
       {
-        int val = imgdata.image[i][c];
-        val = int(val * scale_mul[c]);
-        imgdata.image[i][c] = CLIP(val);
+        const size_t step = rgb ? 3 : 4;
+        const ushort *p = rgb ? rgb[size_t(row) * iwidth] : pix[0];
+        if (!rgb)
+          rgb_row(row, pix, NULL);
+        const INT64 o = ooff + row * orstep;
+        if (bytes == 1)
+          curve_rgb_run(ret->data + o * 3, ocstep * 3, p, step, iwidth, curve);
+        else
+          curve_rgb_run((ushort *)ret->data + o * 3, ocstep * 3, p, step, iwidth, curve);
       }
+    });
+    release();
+
+    // imgdata.image was not built: later output calls need dcraw_process()
+    if (imgdata.image)
+    {
+      free(imgdata.image);
+      imgdata.image = 0;
     }
+    imgdata.progress_flags = LIBRAW_PROGRESS_START | LIBRAW_PROGRESS_OPEN |
+                             LIBRAW_PROGRESS_IDENTIFY |
+                             LIBRAW_PROGRESS_SIZE_ADJUST |
+                             LIBRAW_PROGRESS_LOAD_RAW;
+    *out = ret;
+    return LIBRAW_SUCCESS;
+  }
+  catch (const std::bad_alloc&)
+  {
+    release();
+    ::free(ret);
+    recycle();
+    return LIBRAW_UNSUFFICIENT_MEMORY;
+  }
+  catch (const LibRaw_exceptions& err)
+  {
+    release();
+    ::free(ret);
+    EXCEPTION_HANDLER(err);
   }
 }
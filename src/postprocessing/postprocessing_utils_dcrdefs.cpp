@@ -18,15 +18,31 @@
 
 #include "../../internal/dcraw_defs.h"
 
+static const double(*out_rgb[])[3] = {
+    LibRaw_constants::rgb_rgb,  LibRaw_constants::adobe_rgb,
+    LibRaw_constants::wide_rgb, LibRaw_constants::prophoto_rgb,
+    LibRaw_constants::xyz_rgb,  LibRaw_constants::aces_rgb,
+    LibRaw_constants::dcip3d65_rgb,  LibRaw_constants::rec2020_rgb};
+
+// camera to output color space matrix, raw_color should be already set
+void LibRaw::convert_to_rgb_matrix(float out_cam[3][4])
+{
+  memcpy(out_cam, rgb_cam, sizeof rgb_cam);
+  if (raw_color)
+    return;
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < colors; j++)
+    {
+      out_cam[i][j] = 0.f;
+      for (int k = 0; k < 3; k++)
+        out_cam[i][j] += float(out_rgb[output_color - 1][i][k] * rgb_cam[k][j]);
+    }
+}
+
 void LibRaw::convert_to_rgb()
 {
   float out_cam[3][4];
   double num, inverse[3][3];
-  static const double(*out_rgb[])[3] = {
-      LibRaw_constants::rgb_rgb,  LibRaw_constants::adobe_rgb,
-      LibRaw_constants::wide_rgb, LibRaw_constants::prophoto_rgb,
-      LibRaw_constants::xyz_rgb,  LibRaw_constants::aces_rgb,
-      LibRaw_constants::dcip3d65_rgb,  LibRaw_constants::rec2020_rgb};
   static const char *name[] = {"sRGB",          "Adobe RGB (1998)",
                                "WideGamut D65", "ProPhoto D65",
                                "XYZ",           "ACES",
@@ -51,7 +67,6 @@ void LibRaw::convert_to_rgb()
   RUN_CALLBACK(LIBRAW_PROGRESS_CONVERT_RGB, 0, 2);
 
   gamma_curve(gamm[0], gamm[1], 0, 0);
-  memcpy(out_cam, rgb_cam, sizeof out_cam);
   raw_color |= colors == 1 || output_color < 1 || output_color > 8;
   if (!raw_color)
   {
@@ -95,11 +110,8 @@ void LibRaw::convert_to_rgb()
     strcpy((char *)oprof + pbody[2] + 8, "auto-generated by dcraw");
     if (pbody[5] + 12 + prof_desc.size() < phead[0])
 		strcpy((char *)oprof + pbody[5] + 12, prof_desc.data());
-    for (i = 0; i < 3; i++)
-      for (j = 0; j < colors; j++)
-        for (out_cam[i][j] = 0.f, k = 0; k < 3; k++)
-          out_cam[i][j] += float(out_rgb[output_color - 1][i][k] * rgb_cam[k][j]);
   }
+  convert_to_rgb_matrix(out_cam);
   convert_to_rgb_loop(out_cam);
 
   if (colors == 4 && output_color)
@@ -108,56 +120,22 @@ void LibRaw::convert_to_rgb()
   RUN_CALLBACK(LIBRAW_PROGRESS_CONVERT_RGB, 1, 2);
 }
 
-void LibRaw::scale_colors()
+// white balance is taken from image statistics (greybox)
+int LibRaw::scale_colors_auto_wb()
 {
-  unsigned bottom, right, size, row, col, ur, uc, i, x, y, c, sum[8];
-  int val;
-  double dsum[8], dmin, dmax;
-  float scale_mul[4], fr, fc;
-  ushort *img = 0, *pix;
+  return use_auto_wb ||
+         (use_camera_wb &&
+          (cam_mul[0] < -0.5 // LibRaw 0.19 and older: fallback to auto only if cam_mul[0] is set to -1
+           || (cam_mul[0] <= 0.00001f // New default: fallback to auto if no cam_mul parsed from metadata
+               && !(imgdata.rawparams.options & LIBRAW_RAWOPTIONS_CAMERAWB_FALLBACK_TO_DAYLIGHT))));
+}
 
-  RUN_CALLBACK(LIBRAW_PROGRESS_SCALE_COLORS, 0, 2);
+// pre_mul[] from camera white balance, then fix missing green multipliers
+void LibRaw::scale_colors_camera_wb()
+{
+  unsigned row, col, c, sum[8];
+  int val;
 
-  if (user_mul[0])
-    memcpy(pre_mul, user_mul, sizeof pre_mul);
-  if (use_auto_wb || (use_camera_wb && 
-      (cam_mul[0] < -0.5  // LibRaw 0.19 and older: fallback to auto only if cam_mul[0] is set to -1
-          || (cam_mul[0] <= 0.00001f  // New default: fallback to auto if no cam_mul parsed from metadata
-              && !(imgdata.rawparams.options & LIBRAW_RAWOPTIONS_CAMERAWB_FALLBACK_TO_DAYLIGHT))
-          )))
-  {
-    memset(dsum, 0, sizeof dsum);
-    bottom = MIN(greybox[1] + greybox[3], height);
-    right = MIN(greybox[0] + greybox[2], width);
-    for (row = greybox[1]; row < bottom; row += 8)
-      for (col = greybox[0]; col < right; col += 8)
-      {
-        memset(sum, 0, sizeof sum);
-        for (y = row; y < row + 8 && y < bottom; y++)
-          for (x = col; x < col + 8 && x < right; x++)
-            FORC4
-            {
-              if (filters)
-              {
-                c = fcol(y, x);
-                val = BAYER2(y, x);
-              }
-              else
-                val = image[y * width + x][c];
-              if (val > (int)maximum - 25)
-                goto skip_block;
-              if ((val -= cblack[c]) < 0)
-                val = 0;
-              sum[c] += val;
-              sum[c + 4]++;
-              if (filters)
-                break;
-            }
-        FORC(8) dsum[c] += sum[c];
-      skip_block:;
-      }
-    FORC4 if (dsum[c]) pre_mul[c] = float(dsum[c + 4] / dsum[c]);
-  }
   if (use_camera_wb && cam_mul[0] > 0.00001f)
   {
     memset(sum, 0, sizeof sum);
@@ -194,8 +172,15 @@ void LibRaw::scale_colors()
     pre_mul[1] = 1;
   if (pre_mul[3] == 0)
     pre_mul[3] = colors < 4 ? pre_mul[1] : 1;
-  if (threshold)
-    wavelet_denoise();
+}
+
+// Normalizes pre_mul[], fills scale_mul[] and folds 2x2 black pattern into
+// per-color black levels
+void LibRaw::scale_colors_mul(float scale_mul[4])
+{
+  double dmin, dmax;
+  unsigned c;
+
   maximum -= black;
   for (dmin = DBL_MAX, dmax = c = 0; c < 4; c++)
   {
@@ -217,6 +202,70 @@ void LibRaw::scale_colors()
         cblack[6 + c / 2 % cblack[4] * cblack[5] + c % 2 % cblack[5]];
     cblack[4] = cblack[5] = 0;
   }
+}
+
+void LibRaw::scale_colors()
+{
+  unsigned bottom, right, size, row, col, ur, uc, i, c;
+  double dsum[8];
+  float scale_mul[4], fr, fc;
+  ushort *img = 0, *pix;
+
+  RUN_CALLBACK(LIBRAW_PROGRESS_SCALE_COLORS, 0, 2);
+
+  if (user_mul[0])
+    memcpy(pre_mul, user_mul, sizeof pre_mul);
+  if (scale_colors_auto_wb())
+  {
+    memset(dsum, 0, sizeof dsum);
+    bottom = MIN(greybox[1] + greybox[3], height);
+    right = MIN(greybox[0] + greybox[2], width);
+    /*
+      Block sums are integers, so adding them to dsum in any order gives
+      the same result: rows of blocks are summed in parallel.
+    */
+    int brows = bottom > greybox[1] ? (bottom - greybox[1] + 7) / 8 : 0;
+    double(*rowsum)[8] = (double(*)[8])calloc(MAX(brows, 1), sizeof *rowsum);
+    parallel_for(brows, [&](int r, int) {
+      unsigned brow = greybox[1] + r * 8;
+      for (unsigned bcol = greybox[0]; bcol < right; bcol += 8)
+      {
+        unsigned bsum[8], c;
+        memset(bsum, 0, sizeof bsum);
+        for (unsigned y = brow; y < brow + 8 && y < bottom; y++)
+          for (unsigned x = bcol; x < bcol + 8 && x < right; x++)
+            FORC4
+            {
+              int val;
+              if (filters)
+              {
+                c = fcol(y, x);
+                val = BAYER2(y, x);
+              }
+              else
+                val = image[y * width + x][c];
+              if (val > (int)maximum - 25)
+                goto skip_block;
+              if ((val -= cblack[c]) < 0)
+                val = 0;
+              bsum[c] += val;
+              bsum[c + 4]++;
+              if (filters)
+                break;
+            }
+        FORC(8) rowsum[r][c] += bsum[c];
+      skip_block:;
+      }
+    });
+    for (int r = 0; r < brows; r++)
+      FORC(8) dsum[c] += rowsum[r][c];
+    free(rowsum);
+    FORC4 if (dsum[c]) pre_mul[c] = float(dsum[c + 4] / dsum[c]);
+  }
+  scale_colors_camera_wb();
+  if (threshold)
+    wavelet_denoise();
+  scale_colors_mul(scale_mul);
   size = iheight * iwidth;
   scale_colors_loop(scale_mul);
   if ((aber[0] != 1 || aber[2] != 1) && colors == 3)
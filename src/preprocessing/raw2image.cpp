@@ -219,11 +219,9 @@ int LibRaw::raw2image(void)
 void LibRaw::copy_fuji_uncropped(unsigned short cblack[4],
                                  unsigned short *dmaxp)
 {
-#if defined(LIBRAW_USE_OPENMP)
-#pragma omp parallel for schedule(dynamic) default(none) firstprivate(cblack) shared(dmaxp)
-#endif
-  for (int row = 0; row < int(S.raw_height) - int(S.top_margin) * 2; row++)
-  {
+  int workers = parallel_workers();
+  std::vector<unsigned short> wdmax(workers);
+  parallel_for(int(S.raw_height) - int(S.top_margin) * 2, [&](int row, int worker) {
     int col;
     unsigned short ldmax = 0;
     for (col = 0;
@@ -260,51 +258,70 @@ void LibRaw::copy_fuji_uncropped(unsigned short cblack[4],
             val;
       }
     }
-#if defined(LIBRAW_USE_OPENMP)
-#pragma omp critical(dataupdate)
-#endif
-    {
-      if (*dmaxp < ldmax)
-        *dmaxp = ldmax;
-    }
-  }
+    if (wdmax[worker] < ldmax)
+      wdmax[worker] = ldmax;
+  });
+  for (int i = 0; i < workers; i++)
+    if (*dmaxp < wdmax[i])
+      *dmaxp = wdmax[i];
 }
 
 void LibRaw::copy_bayer(unsigned short cblack[4], unsigned short *dmaxp)
 {
   // Both cropped and uncropped
   int maxHeight = MIN(int(S.height),int(S.raw_height)-int(S.top_margin));
-#if defined(LIBRAW_USE_OPENMP)
-#pragma omp parallel for schedule(dynamic) default(none) shared(dmaxp) firstprivate(cblack, maxHeight)
-#endif
-  for (int row = 0; row < maxHeight ; row++)
-  {
-    int col;
-    unsigned short ldmax = 0;
-    for (col = 0; col < S.width && col + S.left_margin < S.raw_width; col++)
+  int maxWidth = MIN(int(S.width), int(S.raw_width) - int(S.left_margin));
+  int workers = parallel_workers();
+  std::vector<unsigned short> wdmax(workers);
+  // With half_size both rows of a 2x2 cell land in the same image row, and
+  // X-Trans can place one color twice in a cell: keep each such row pair in
+  // one task so the last write stays deterministic
+  int step = 1 << IO.shrink;
+  parallel_for((maxHeight + step - 1) >> IO.shrink, [&](int orow, int worker) {
+    for (int row = orow << IO.shrink; row < MIN(maxHeight, (orow + 1) << IO.shrink); row++)
     {
-      unsigned short val =
-          imgdata.rawdata.raw_image[(row + S.top_margin) * S.raw_pitch / 2 +
-                                    (col + S.left_margin)];
-      int cc = fcol(row, col);
-      if (val > cblack[cc])
+      unsigned short ldmax = 0;
+      const unsigned short *src =
+          imgdata.rawdata.raw_image + (row + S.top_margin) * S.raw_pitch / 2 +
+          S.left_margin;
+      ushort(*dst)[4] = imgdata.image + (row >> IO.shrink) * S.iwidth;
+      if (imgdata.idata.filters > 1000)
       {
-        val -= cblack[cc];
-        if (val > ldmax)
-          ldmax = val;
+        // Regular Bayer: color and black level repeat every two columns
+        int cc[2] = {fcol(row, 0), fcol(row, 1)};
+        unsigned short bl[2] = {cblack[cc[0]], cblack[cc[1]]};
+        for (int col = 0; col < maxWidth; col++)
+        {
+          unsigned short val = src[col];
+          unsigned short black = bl[col & 1];
+          val = val > black ? val - black : 0;
+          if (val > ldmax)
+            ldmax = val;
+          dst[col >> IO.shrink][cc[col & 1]] = val;
+        }
       }
       else
-        val = 0;
-      imgdata.image[((row) >> IO.shrink) * S.iwidth + ((col) >> IO.shrink)][cc] = val;
-    }
-#if defined(LIBRAW_USE_OPENMP)
-#pragma omp critical(dataupdate)
-#endif
-    {
-      if (*dmaxp < ldmax)
-        *dmaxp = ldmax;
+        for (int col = 0; col < maxWidth; col++)
+        {
+          unsigned short val = src[col];
+          int cc = fcol(row, col);
+          if (val > cblack[cc])
+          {
+            val -= cblack[cc];
+            if (val > ldmax)
+              ldmax = val;
+          }
+          else
+            val = 0;
+          dst[col >> IO.shrink][cc] = val;
+        }
+      if (wdmax[worker] < ldmax)
+        wdmax[worker] = ldmax;
     }
-  }
+  });
+  for (int i = 0; i < workers; i++)
+    if (*dmaxp < wdmax[i])
+      *dmaxp = wdmax[i];
 }
 
 int LibRaw::raw2image_ex(int do_subtract_black)
@@ -21,6 +21,31 @@ int LibRaw::subtract_black()
   return subtract_black_internal();
 }
 
+LIBRAW_SIMD_CLONES
+static int subtract_black_run(ushort (*pix)[4], int count, const int cblk[4])
+{
+  int dmax = 0;
+  for (int q = 0; q < count; q++)
+    for (int c = 0; c < 4; c++)
+    {
+      int val = pix[q][c];
+      val -= cblk[c];
+      pix[q][c] = CLIP(val);
+      if (dmax < val) dmax = val;
+    }
+  return dmax;
+}
+
+LIBRAW_SIMD_CLONES
+static int max_value(const ushort *p, int count)
+{
+  int dmax = 0;
+  for (int idx = 0; idx < count; idx++)
+    if (dmax < p[idx])
+      dmax = p[idx];
+  return dmax;
+}
+
 int LibRaw::subtract_black_internal()
 {
   CHECK_ORDER_LOW(LIBRAW_PROGRESS_RAW2_IMAGE);
@@ -53,18 +78,7 @@ int LibRaw::subtract_black_internal()
         }
       }
       else
-      {
-        for (unsigned q = 0; q < (unsigned)size; q++)
-        {
-          for (unsigned c = 0; c < 4; c++)
-          {
-            int val = imgdata.image[q][c];
-            val -= cblk[c];
-            imgdata.image[q][c] = CLIP(val);
-            if (dmax < val) dmax = val;
-          }
-        }
-      }
+        dmax = subtract_black_run(imgdata.image, size, cblk);
       C.data_maximum = dmax & 0xffff;
       C.maximum -= C.black;
       ZERO(C.cblack); // Yeah, we used cblack[6+] values too!
@@ -74,13 +88,8 @@ int LibRaw::subtract_black_internal()
     {
       // Nothing to Do, maximum is already calculated, black level is 0, so no
       // change only calculate channel maximum;
-      int idx;
-      ushort *p = (ushort *)imgdata.image;
-      int dmax = 0;
-      for (idx = 0; idx < S.iheight * S.iwidth * 4; idx++)
-        if (dmax < p[idx])
-          dmax = p[idx];
-      C.data_maximum = dmax;
+      C.data_maximum =
+          max_value((ushort *)imgdata.image, S.iheight * S.iwidth * 4);
     }
     return 0;
   }
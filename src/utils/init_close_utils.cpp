@@ -60,6 +60,7 @@ LibRaw::LibRaw(unsigned int flags) : memmgr(1024)
           callbacks.interpolate_bayer_cb = callbacks.interpolate_xtrans_cb =
               callbacks.post_interpolate_cb = callbacks.pre_converttorgb_cb =
                   callbacks.post_converttorgb_cb = NULL;
+  callbacks.parallel_cb = NULL; // LibRaw's own threads (if any)
 
   memmove(&imgdata.params.aber, &aber, sizeof(aber));
   memmove(&imgdata.params.gamm, &gamm, sizeof(gamm));
@@ -92,6 +93,7 @@ LibRaw::LibRaw(unsigned int flags) : memmgr(1024)
   imgdata.params.green_matching = 0;
   imgdata.rawparams.custom_camera_strings = 0;
   imgdata.rawparams.coolscan_nef_gamma = 1.0f;
+  imgdata.rawparams.max_threads = 0;
   imgdata.parent_class = this;
   imgdata.progress_flags = 0;
   imgdata.color.dng_levels.baseline_exposure = -999.f;
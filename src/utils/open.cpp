@@ -39,13 +39,28 @@ int LibRaw::open_file(const char *fname, INT64 max_buf_size)
 #endif
 	}
 
-  LibRaw_abstract_datastream *stream;
+  LibRaw_abstract_datastream *stream = 0;
   try
   {
-    if (big)
-      stream = new LibRaw_bigfile_datastream(fname);
-    else
-      stream = new LibRaw_file_datastream(fname);
+#ifdef LIBRAW_MMAP_DATASTREAM
+    // memory mapped file unless stream type is requested explicitly
+    if (max_buf_size != LIBRAW_OPEN_BIGFILE && max_buf_size != LIBRAW_OPEN_FILE)
+    {
+      stream = new LibRaw_mmap_datastream(fname);
+      if (!stream->valid()) // not mappable: fall back to file I/O
+      {
+        delete stream;
+        stream = 0;
+      }
+    }
+#endif
+    if (!stream)
+    {
+      if (big)
+        stream = new LibRaw_bigfile_datastream(fname);
+      else
+        stream = new LibRaw_file_datastream(fname);
+    }
   }
 
   catch (const std::bad_alloc& )
@@ -157,8 +172,15 @@ int LibRaw::open_file(const char *fname)
     LibRaw_abstract_datastream *stream;
     try
     {
-#ifdef LIBRAW_WIN32_CALLS
+#if defined(LIBRAW_WIN32_CALLS)
         stream = new LibRaw_bigfile_buffered_datastream(fname);
+#elif defined(LIBRAW_MMAP_DATASTREAM)
+        stream = new LibRaw_mmap_datastream(fname);
+        if (!stream->valid()) // not mappable: fall back to file I/O
+        {
+            delete stream;
+            stream = new LibRaw_bigfile_datastream(fname);
+        }
 #else
         stream = new LibRaw_bigfile_datastream(fname);
 #endif
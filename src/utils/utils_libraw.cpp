@@ -15,6 +15,11 @@
 
 #include "../../internal/libraw_cxx_defs.h"
 #include "../../internal/libraw_checked_buffer.h"
+#ifdef LIBRAW_USE_THREAD_POOL
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
 
 #ifdef __cplusplus
 extern "C"
@@ -641,6 +646,240 @@ int LibRaw::adjust_to_raw_inset_crop(unsigned mask, float maxcrop)
     return adjindex + 1;
 }
 
+/*
+  OpenMP team size, for builds without the internal worker pool
+*/
+int LibRaw::omp_threads()
+{
+#ifdef LIBRAW_USE_OPENMP
+  int threads = omp_get_max_threads();
+  if (imgdata.rawparams.max_threads > 0)
+    threads = MIN(threads, imgdata.rawparams.max_threads);
+  return MAX(threads, 1);
+#else
+  return 1;
+#endif
+}
+
+#ifdef LIBRAW_USE_THREAD_POOL
+namespace
+{
+/*
+  Process-wide worker pool behind parallel_run(). A job gives each of its
+  worker slots one contiguous share of [0, count); a slot takes small
+  blocks from the front of its own share and, once that is empty, steals
+  the back half of the largest share left. The calling thread always
+  works on its own job as slot 0, so several LibRaw objects (and nested
+  loops) can share the pool without waiting on each other.
+*/
+class libraw_thread_pool
+{
+public:
+  static int hardware_threads()
+  {
+    static const int n = MAX(1, int(std::thread::hardware_concurrency()));
+    return n;
+  }
+  static libraw_thread_pool &instance()
+  {
+    /* never destroyed: threads idle until the process exits */
+    static libraw_thread_pool *pool = new libraw_thread_pool();
+    return *pool;
+  }
+
+  void run(int count, parallel_task_callback task, void *task_data,
+           int slots)
+  {
+    job j(count, task, task_data, slots);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      jobs.push_back(&j);
+    }
+    wake.notify_all();
+    work(j, 0);
+    std::unique_lock<std::mutex> lock(mutex);
+    for (size_t i = 0; i < jobs.size(); i++)
+      if (jobs[i] == &j)
+      {
+        jobs.erase(jobs.begin() + i);
+        break;
+      }
+    finished.wait(lock, [&j] { return j.active == 1; });
+  }
+
+private:
+  struct share
+  {
+    std::mutex lock;
+    int first, last;
+  };
+  struct job
+  {
+    parallel_task_callback task;
+    void *data;
+    int slots, grain;
+    int joined, active; /* under the pool mutex */
+    std::vector<share> shares;
+    job(int count, parallel_task_callback t, void *d, int n)
+        : task(t), data(d), slots(n), grain(MAX(1, count / (n * 8))),
+          joined(1), active(1), shares(n)
+    {
+      for (int s = 0; s < n; s++)
+      {
+        shares[s].first = int(INT64(count) * s / n);
+        shares[s].last = int(INT64(count) * (s + 1) / n);
+      }
+    }
+  };
+
+  std::mutex mutex;
+  std::condition_variable wake, finished;
+  std::vector<job *> jobs;
+
+  libraw_thread_pool()
+  {
+    try
+    {
+      for (int i = 1; i < hardware_threads(); i++)
+        std::thread(&libraw_thread_pool::worker, this).detach();
+    }
+    catch (...)
+    {
+      /* fewer threads: the callers pick up the remaining slots */
+    }
+  }
+
+  void worker()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+      job *j = NULL;
+      for (size_t i = 0; i < jobs.size() && !j; i++)
+        if (jobs[i]->joined < jobs[i]->slots)
+          j = jobs[i];
+      if (!j)
+      {
+        wake.wait(lock);
+        continue;
+      }
+      const int slot = j->joined++;
+      j->active++;
+      lock.unlock();
+      work(*j, slot);
+      lock.lock();
+      if (--j->active == 1)
+        finished.notify_all();
+    }
+  }
+
+  static void work(job &j, int slot)
+  {
+    share &own = j.shares[slot];
+    for (;;)
+    {
+      int first, last;
+      {
+        std::lock_guard<std::mutex> lock(own.lock);
+        first = own.first;
+        last = own.first = MIN(own.last, own.first + j.grain);
+      }
+      if (first < last)
+      {
+        j.task(j.data, first, last, slot);
+        continue;
+      }
+      /* steal the back half of the largest share */
+      int victim = -1, most = 0;
+      for (int s = 0; s < j.slots; s++)
+        if (s != slot)
+        {
+          std::lock_guard<std::mutex> lock(j.shares[s].lock);
+          if (j.shares[s].last - j.shares[s].first > most)
+          {
+            most = j.shares[s].last - j.shares[s].first;
+            victim = s;
+          }
+        }
+      if (victim < 0)
+        return;
+      {
+        std::lock_guard<std::mutex> lock(j.shares[victim].lock);
+        share &v = j.shares[victim];
+        first = v.first + (v.last - v.first) / 2;
+        last = v.last;
+        v.last = first;
+      }
+      if (first < last)
+      {
+        std::lock_guard<std::mutex> lock(own.lock);
+        own.first = first;
+        own.last = last;
+      }
+    }
+  }
+};
+} // namespace
+#endif
+
+int LibRaw::parallel_workers()
+{
+  int workers;
+  if (callbacks.parallel_cb)
+    workers = callbacks.parallel_workers;
+  else
+#ifdef LIBRAW_USE_THREAD_POOL
+    workers = libraw_thread_pool::hardware_threads();
+#else
+    return omp_threads();
+#endif
+  if (imgdata.rawparams.max_threads > 0)
+    workers = MIN(workers, imgdata.rawparams.max_threads);
+  return MAX(workers, 1);
+}
+
+/*
+  Runs task over [0, count): on the user executor if one is set, else on
+  the internal worker pool (thread-safe builds), else on OpenMP threads (if
+  built with OpenMP), else in the calling thread. Worker indexes passed to
+  the task are below parallel_workers() and max_workers, if that is set.
+*/
+void LibRaw::parallel_run(int count, parallel_task_callback task,
+                          void *task_data, int max_workers)
+{
+  if (count < 1)
+    return;
+  int workers = parallel_workers();
+  if (max_workers > 0)
+    workers = MIN(workers, max_workers);
+  if (workers > 1 && count > 1)
+  {
+    if (callbacks.parallel_cb)
+    {
+      if (!callbacks.parallel_cb(callbacks.parallelcb_data, task, task_data,
+                                 count, workers))
+        return;
+    }
+    else
+    {
+#if defined(LIBRAW_USE_THREAD_POOL)
+      libraw_thread_pool::instance().run(count, task, task_data,
+                                         MIN(workers, count));
+      return;
+#elif defined(LIBRAW_USE_OPENMP)
+      /* a few contiguous blocks per thread to balance uneven rows */
+      int blocks = MIN(count, workers * 8);
+#pragma omp parallel for schedule(dynamic) num_threads(workers)
+      for (int b = 0; b < blocks; b++)
+        task(task_data, int(INT64(count) * b / blocks),
+             int(INT64(count) * (b + 1) / blocks), omp_get_thread_num());
+      return;
+#endif
+    }
+  }
+  task(task_data, 0, count, 0);
+}
+
 char** LibRaw::malloc_omp_buffers(int buffer_count, size_t buffer_size)
 {
     char** buffers = (char**)calloc(sizeof(char*), buffer_count);
@@ -154,13 +154,30 @@ void LibRaw::jpeg_thumb_writer(FILE *tfp, char *t_humb, int t_humb_length)
   }
   fwrite(t_humb + 2, 1, t_humb_length - 2, tfp);
 }
+// Output curve for one PPM/TIFF row: count pixels, source step pstep
+LIBRAW_SIMD_CLONES
+static void ppm_curve_run(uchar *out, const ushort *pix, int pstep, int count, int ncolors, const ushort *tone)
+{
+    for (int col = 0; col < count; col++, pix += pstep)
+        for (int c = 0; c < ncolors; c++)
+            *out++ = uchar(tone[pix[c]] >> 8);
+}
+
+LIBRAW_SIMD_CLONES
+static void ppm_curve_run(ushort *out, const ushort *pix, int pstep, int count, int ncolors, const ushort *tone)
+{
+    for (int col = 0; col < count; col++, pix += pstep)
+        for (int c = 0; c < ncolors; c++)
+            *out++ = tone[pix[c]];
+}
+
 void LibRaw::write_ppm_tiff()
 {
     try
     {
         struct tiff_hdr th;
         ushort *ppm2;
-        int c, row, col, soff, rstep, cstep;
+        int c, row, soff, rstep, cstep;
         int perc, val, total, t_white = 0x2000;
 
         perc = int(width * height * auto_bright_thr);
@@ -226,11 +243,11 @@ void LibRaw::write_ppm_tiff()
         rstep = flip_index(1, 0) - flip_index(0, width);
         for (row = 0; row < height; row++, soff += rstep)
         {
-            for (col = 0; col < width; col++, soff += cstep)
-                if (output_bps == 8)
-                    FORCC ppm[col * colors + c] = curve[image[soff][c]] >> 8;
-                else
-                    FORCC ppm2[col * colors + c] = curve[image[soff][c]];
+            if (output_bps == 8)
+                ppm_curve_run(ppm.data(), image[soff], cstep * 4, width, colors, curve);
+            else
+                ppm_curve_run(ppm2, image[soff], cstep * 4, width, colors, curve);
+            soff += width * cstep;
             if (output_bps == 16 && !output_tiff && htons(0x55aa) != 0x55aa)
                 libraw_swab(ppm2, width * colors * 2);
             fwrite(ppm.data(), colors * output_bps / 8, width, ofp);
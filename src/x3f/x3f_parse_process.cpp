@@ -104,12 +104,21 @@ static void *lr_memmem(const void *l, size_t l_len, const void *s, size_t s_len)
   return NULL;
 }
 
+/* x3f_info_t::parallel hook: plane and row decoding go through parallel_for */
+void LibRaw::x3f_parallel_run(void *ctx, int count, void (*task)(void *, int),
+                              void *data)
+{
+  ((LibRaw *)ctx)->parallel_for(count, [&](int i, int) { task(data, i); });
+}
+
 void LibRaw::parse_x3f()
 {
   x3f_t *x3f = x3f_new_from_file(libraw_internal_data.internal_data.input);
   if (!x3f)
     return;
   _x3f_data = x3f;
+  x3f->info.parallel = x3f_parallel_run;
+  x3f->info.parallel_ctx = this;
 
   x3f_header_t *H = NULL;
 
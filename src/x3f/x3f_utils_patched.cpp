@@ -205,7 +205,11 @@ unsigned x3f_get4(LibRaw_abstract_datastream *f)
 /* Allocating Huffman tree help data                                   */
 /* --------------------------------------------------------------------- */
 
-static void cleanup_huffman_tree(x3f_hufftree_t *HTP) { free(HTP->nodes); }
+static void cleanup_huffman_tree(x3f_hufftree_t *HTP)
+{
+  free(HTP->nodes);
+  free(HTP->lut);
+}
 
 static void new_huffman_tree(x3f_hufftree_t *HTP, int bits)
 {
@@ -215,6 +219,8 @@ static void new_huffman_tree(x3f_hufftree_t *HTP, int bits)
   HTP->total_node_index = HUF_TREE_MAX_NODES(leaves);
   HTP->nodes = (x3f_huffnode_t *)x3f_limited_calloc(1, HUF_TREE_MAX_NODES(leaves) *
                                                sizeof(x3f_huffnode_t));
+  HTP->lut = (x3f_huflut_t *)x3f_limited_calloc(1 << HUF_LUT_BITS,
+                                                sizeof(x3f_huflut_t));
 }
 
 /* --------------------------------------------------------------------- */
@@ -249,6 +255,7 @@ static x3f_true_t *new_true(x3f_true_t **TRUP)
   TRU->plane_size.size = 0;
   TRU->plane_size.element = NULL;
   TRU->tree.nodes = NULL;
+  TRU->tree.lut = NULL;
   TRU->x3rgb16.data = NULL;
   TRU->x3rgb16.buf = NULL;
 
@@ -327,6 +334,7 @@ static x3f_huffman_t *new_huffman(x3f_huffman_t **HUFP)
   HUF->table.size = 0;
   HUF->table.element = NULL;
   HUF->tree.nodes = NULL;
+  HUF->tree.lut = NULL;
   HUF->row_offsets.size = 0;
   HUF->row_offsets.element = NULL;
   HUF->rgb8.data = NULL;
@@ -360,6 +368,8 @@ static x3f_huffman_t *new_huffman(x3f_huffman_t **HUFP)
     I->error = NULL;
     I->input.file = infile;
     I->output.file = NULL;
+    I->parallel = NULL;
+    I->parallel_ctx = NULL;
 
     /* Read file header */
     H = &x3f->header;
@@ -509,6 +519,7 @@ static x3f_huffman_t *new_huffman(x3f_huffman_t **HUFP)
         CAMF->table.element = NULL;
         CAMF->table.size = 0;
         CAMF->tree.nodes = NULL;
+        CAMF->tree.lut = NULL;
         CAMF->decoded_data = NULL;
         CAMF->decoded_data_size = 0;
         CAMF->entry_table.element = NULL;
@@ -780,6 +791,69 @@ static void add_code_to_tree(x3f_hufftree_t *tree, int length, uint32_t code,
   t->leaf = value;
 }
 
+/* Fill the lookup table by walking the tree with every HUF_LUT_BITS
+   bit prefix. Codes longer than that, and TRUE differences wider than
+   16 bits, are left for the bit by bit walk (length 0). For TRUE codes
+   the difference bits are folded into the entry when they fit. */
+
+static void build_huffman_lut(x3f_hufftree_t *tree, bool_t true_diff)
+{
+  int i;
+
+  for (i = 0; i < (1 << HUF_LUT_BITS); i++)
+  {
+    x3f_huflut_t *e = &tree->lut[i];
+    x3f_huffnode_t *node = &tree->nodes[0];
+    int length = 0;
+    int bits;
+
+    e->value = 0;
+    e->length = 0;
+    e->extra = 0;
+
+    while (node != NULL && (node->branch[0] != NULL || node->branch[1] != NULL) &&
+           length < HUF_LUT_BITS)
+      node = node->branch[(i >> (HUF_LUT_BITS - 1 - length++)) & 1];
+
+    if (node == NULL)
+    {
+      /* Invalid code: TRUE reads it as 0, the others fail in the walk */
+      if (true_diff)
+        e->length = length;
+      continue;
+    }
+    if (node->branch[0] != NULL || node->branch[1] != NULL)
+      continue;
+
+    if (!true_diff)
+    {
+      e->value = node->leaf;
+      e->length = length;
+      continue;
+    }
+
+    bits = (uint8_t)node->leaf;
+    if (bits == 0)
+      e->length = length;
+    else if (bits > 16)
+      continue;
+    else if (length + bits <= HUF_LUT_BITS)
+    {
+      int32_t diff = (i >> (HUF_LUT_BITS - length - bits)) & ((1 << bits) - 1);
+
+      if ((diff >> (bits - 1)) == 0)
+        diff -= (1 << bits) - 1;
+      e->value = diff;
+      e->length = length + bits;
+    }
+    else
+    {
+      e->length = length;
+      e->extra = bits;
+    }
+  }
+}
+
 static void populate_true_huffman_tree(x3f_hufftree_t *tree,
                                        x3f_true_huffman_t *table)
 {
@@ -811,6 +885,8 @@ static void populate_true_huffman_tree(x3f_hufftree_t *tree,
 #endif
     }
   }
+
+  build_huffman_lut(tree, 1);
 }
 
 static void populate_huffman_tree(x3f_hufftree_t *tree, x3f_table32_t *table,
@@ -851,6 +927,8 @@ static void populate_huffman_tree(x3f_hufftree_t *tree, x3f_table32_t *table,
 #endif
     }
   }
+
+  build_huffman_lut(tree, 0);
 }
 
 #ifdef DBG_PRNT
@@ -879,38 +957,52 @@ static void print_huffman_tree(x3f_huffnode_t *t, int length, uint32_t code)
 typedef struct bit_state_s
 {
   uint8_t *next_address;
-  uint8_t bit_offset;
-  uint8_t bits[8];
+  uint8_t *end_address; /* Zero bits are read from here on */
+  uint64_t bits;        /* Buffered bits, the next one in bit 63 */
+  int count;            /* Number of buffered bits */
 } bit_state_t;
 
-static void set_bit_state(bit_state_t *BS, uint8_t *address)
+static void set_bit_state(bit_state_t *BS, uint8_t *address, uint8_t *end)
 {
   BS->next_address = address;
-  BS->bit_offset = 8;
+  BS->end_address = end;
+  BS->bits = 0;
+  BS->count = 0;
 }
 
-static uint8_t get_bit(bit_state_t *BS)
+static inline uint32_t peek_bits(bit_state_t *BS, int n)
 {
-  if (BS->bit_offset == 8)
-  {
-    uint8_t byte = *BS->next_address;
-    int i;
-
-    for (i = 7; i >= 0; i--)
+  if (BS->count < n)
+    while (BS->count <= 56)
     {
-      BS->bits[i] = byte & 1;
-      byte = byte >> 1;
+      uint64_t byte =
+          BS->next_address < BS->end_address ? *BS->next_address++ : 0;
+
+      BS->bits |= byte << (56 - BS->count);
+      BS->count += 8;
     }
-    BS->next_address++;
-    BS->bit_offset = 0;
-  }
 
-  return BS->bits[BS->bit_offset++];
+  return (uint32_t)(BS->bits >> (64 - n));
+}
+
+static inline void skip_bits(bit_state_t *BS, int n)
+{
+  BS->bits <<= n;
+  BS->count -= n;
+}
+
+static uint8_t get_bit(bit_state_t *BS)
+{
+  uint8_t bit = (uint8_t)peek_bits(BS, 1);
+
+  skip_bits(BS, 1);
+
+  return bit;
 }
 
 /* Decode use the TRUE algorithm */
 
-static int32_t get_true_diff(bit_state_t *BS, x3f_hufftree_t *HTP)
+static int32_t get_true_diff_tree(bit_state_t *BS, x3f_hufftree_t *HTP)
 {
   int32_t diff;
   x3f_huffnode_t *node = &HTP->nodes[0];
@@ -950,6 +1042,26 @@ static int32_t get_true_diff(bit_state_t *BS, x3f_hufftree_t *HTP)
   return diff;
 }
 
+static int32_t get_true_diff(bit_state_t *BS, x3f_hufftree_t *HTP)
+{
+  const x3f_huflut_t *e = &HTP->lut[peek_bits(BS, HUF_LUT_BITS)];
+  int32_t diff;
+
+  if (e->length == 0)
+    return get_true_diff_tree(BS, HTP);
+
+  skip_bits(BS, e->length);
+  if (e->extra == 0)
+    return e->value;
+
+  diff = peek_bits(BS, e->extra);
+  skip_bits(BS, e->extra);
+  if ((diff >> (e->extra - 1)) == 0)
+    diff -= (1 << e->extra) - 1;
+
+  return diff;
+}
+
 /* This code (that decodes one of the X3F color planes, really is a
    decoding of a compression algorithm suited for Bayer CFA data. In
    Bayer CFA the data is divided into 2x2 squares that represents
@@ -977,7 +1089,8 @@ static void true_decode_one_color(x3f_image_data_t *ID, int color)
   x3f_area16_t *area = &TRU->x3rgb16;
   uint16_t *dst = area->data + color;
 
-  set_bit_state(&BS, TRU->plane_address[color]);
+  set_bit_state(&BS, TRU->plane_address[color],
+                (uint8_t *)ID->data + ID->data_size);
 
   row_start_acc[0][0] = seed;
   row_start_acc[0][1] = seed;
@@ -1032,21 +1145,38 @@ static void true_decode_one_color(x3f_image_data_t *ID, int color)
   }
 }
 
-static void true_decode(x3f_info_t * /*I*/, x3f_directory_entry_t *DE)
+/* Runs task(data, i) for i in [0, count) through the caller's
+   executor, or in order when there is none */
+
+static void x3f_parallel(x3f_info_t *I, int count,
+                         void (*task)(void *data, int i), void *data)
+{
+  int i;
+
+  if (I->parallel)
+    I->parallel(I->parallel_ctx, count, task, data);
+  else
+    for (i = 0; i < count; i++)
+      task(data, i);
+}
+
+static void true_decode_task(void *data, int color)
+{
+  true_decode_one_color((x3f_image_data_t *)data, color);
+}
+
+static void true_decode(x3f_info_t *I, x3f_directory_entry_t *DE)
 {
   x3f_directory_entry_header_t *DEH = &DE->header;
   x3f_image_data_t *ID = &DEH->data_subsection.image_data;
-  int color;
 
-  for (color = 0; color < 3; color++)
-  {
-    true_decode_one_color(ID, color);
-  }
+  /* Each color plane is a bit stream of its own */
+  x3f_parallel(I, TRUE_PLANES, true_decode_task, ID);
 }
 
 /* Decode use the huffman tree */
 
-static int32_t get_huffman_diff(bit_state_t *BS, x3f_hufftree_t *HTP)
+static int32_t get_huffman_diff_tree(bit_state_t *BS, x3f_hufftree_t *HTP)
 {
   int32_t diff;
   x3f_huffnode_t *node = &HTP->nodes[0];
@@ -1070,6 +1200,18 @@ static int32_t get_huffman_diff(bit_state_t *BS, x3f_hufftree_t *HTP)
   return diff;
 }
 
+static int32_t get_huffman_diff(bit_state_t *BS, x3f_hufftree_t *HTP)
+{
+  const x3f_huflut_t *e = &HTP->lut[peek_bits(BS, HUF_LUT_BITS)];
+
+  if (e->length == 0)
+    return get_huffman_diff_tree(BS, HTP);
+
+  skip_bits(BS, e->length);
+
+  return e->value;
+}
+
 static void huffman_decode_row(x3f_info_t * /*I*/, x3f_directory_entry_t *DE,
                                int /*bits*/, int row, int offset, int *minimum)
 {
@@ -1083,7 +1225,8 @@ static void huffman_decode_row(x3f_info_t * /*I*/, x3f_directory_entry_t *DE,
 
   if (HUF->row_offsets.element[row] > ID->data_size - 1)
 	  throw LIBRAW_EXCEPTION_IO_CORRUPT;
-  set_bit_state(&BS, (uint8_t *)ID->data + HUF->row_offsets.element[row]);
+  set_bit_state(&BS, (uint8_t *)ID->data + HUF->row_offsets.element[row],
+                (uint8_t *)ID->data + ID->data_size);
 
   for (col = 0; col < (int)ID->columns; col++)
   {
@@ -1123,6 +1266,23 @@ static void huffman_decode_row(x3f_info_t * /*I*/, x3f_directory_entry_t *DE,
   }
 }
 
+typedef struct huffman_decode_s
+{
+  x3f_info_t *I;
+  x3f_directory_entry_t *DE;
+  int bits;
+  int offset;
+  int *minimum; /* One per row */
+} huffman_decode_t;
+
+static void huffman_decode_task(void *data, int row)
+{
+  huffman_decode_t *HD = (huffman_decode_t *)data;
+
+  huffman_decode_row(HD->I, HD->DE, HD->bits, row, HD->offset,
+                     &HD->minimum[row]);
+}
+
 static void huffman_decode(x3f_info_t *I, x3f_directory_entry_t *DE, int bits)
 {
   x3f_directory_entry_header_t *DEH = &DE->header;
@@ -1130,16 +1290,20 @@ static void huffman_decode(x3f_info_t *I, x3f_directory_entry_t *DE, int bits)
 
   int row;
   int minimum = 0;
-  int offset = legacy_offset;
+  std::vector<int> row_minimum(ID->rows, 0);
+  huffman_decode_t HD = {I, DE, bits, legacy_offset, row_minimum.data()};
+
+  /* Every row starts at its own offset */
+  x3f_parallel(I, ID->rows, huffman_decode_task, &HD);
 
   for (row = 0; row < (int)ID->rows; row++)
-    huffman_decode_row(I, DE, bits, row, offset, &minimum);
+    if (row_minimum[row] < minimum)
+      minimum = row_minimum[row];
 
   if (auto_legacy_offset && minimum < 0)
   {
-    offset = -minimum;
-    for (row = 0; row < (int)ID->rows; row++)
-      huffman_decode_row(I, DE, bits, row, offset, &minimum);
+    HD.offset = -minimum;
+    x3f_parallel(I, ID->rows, huffman_decode_task, &HD);
   }
 }
 
@@ -1679,7 +1843,8 @@ static void camf_decode_type4(x3f_camf_t *CAMF)
   dst = (uint8_t *)CAMF->decoded_data;
   dst_end = dst + dst_size;
 
-  set_bit_state(&BS, CAMF->decoding_start);
+  set_bit_state(&BS, CAMF->decoding_start,
+                (uint8_t *)CAMF->data + CAMF->data_size);
 
   row_start_acc[0][0] = seed;
   row_start_acc[0][1] = seed;
@@ -1797,7 +1962,8 @@ static void camf_decode_type5(x3f_camf_t *CAMF)
 
   dst = (uint8_t *)CAMF->decoded_data;
 
-  set_bit_state(&BS, CAMF->decoding_start);
+  set_bit_state(&BS, CAMF->decoding_start,
+                (uint8_t *)CAMF->data + CAMF->data_size);
 
   for (i = 0; i < (int)CAMF->decoded_data_size; i++)
   {